@@ -0,0 +1,319 @@
+# -*- coding: utf-8 -*-
+#
+# CNTKで学習したモデル(uct_params/model.bin)を, CPUでの推論の重みファイル
+# (uct_params/model.txt)に書き出す
+#
+#   python ExportModel.py ../uct_params/model.bin ../uct_params/model.txt
+#
+# CNTK 2.xのPython API (cntk)とnumpyが必要
+# 書き出した後, 乱数の入力でCNTKの出力と書き出した重みでの計算結果を比べて表示する
+#
+# 書式はsrc/NeuralNetCpu.cppのReadModelを参照
+
+import argparse
+import sys
+
+import numpy as np
+
+# 重みファイルの形式の版 (NN_CPU_MODEL_VERSION)
+MODEL_VERSION = 1
+
+# BatchNormalizationのepsilonが取れなかったときの値 (CNTKの既定値)
+DEFAULT_EPSILON = 1e-5
+
+# ネットワークの構成
+#   ("conv", 名前, 種類, カーネル)  種類はMacros.ndlのマクロ
+#     "bnrelu" : ConvBNReLULayer
+#     "bn"     : ConvBNLayer
+#     "bias"   : ConvLayer (チャネルごとのバイアス)
+#     "point"  : ConvLayer2 (交点ごとのバイアス)
+#   ("res", 名前)  ResNetNode2
+#
+# detectの名前のノードがあればその構成とみなす (上から順に調べる)
+LAYOUTS = [
+    # ResNetV25.ndlをResNetV25_2d.melで編集したもの
+    # 価値は方策の残差ブロックの出力から分かれ, 出力にofsVを足す
+    ("ResNetV25_2d", {
+        "detect": "rnv2_conv",
+        "trunk": [("conv", "conv1", "bnrelu", 5),
+                  ("res", "rn1_1"), ("res", "rn1_2"), ("res", "rn1"),
+                  ("conv", "rnm_conv", "bnrelu", 1),
+                  ("res", "rnm_1"), ("res", "rnm_2"), ("res", "rnm_3"), ("res", "rnm")],
+        "policy": [("conv", "conv_move", "bias", 3)],
+        "value": [("conv", "rnv2_conv", "bnrelu", 3),
+                  ("res", "rnv2_1"), ("res", "rnv2"),
+                  ("conv", "conv2_value", "bn", 3)],
+        "value_scale": 0.01,
+        "value_offset": "ofsV",
+    }),
+    # ResNetV25.ndl
+    ("ResNetV25", {
+        "detect": "rnv_conv",
+        "trunk": [("conv", "conv1", "bnrelu", 5),
+                  ("res", "rn1_1"), ("res", "rn1_2"), ("res", "rn1")],
+        "policy": [("conv", "rnm_conv", "bnrelu", 1),
+                   ("res", "rnm_1"), ("res", "rnm_2"), ("res", "rnm_3"), ("res", "rnm"),
+                   ("conv", "conv_move", "bias", 3)],
+        "value": [("conv", "rnv_conv", "bnrelu", 1),
+                  ("res", "rnv_1"), ("res", "rnv_2"), ("res", "rnv_3"), ("res", "rnv"),
+                  ("conv", "conv_value", "point", 1)],
+        "value_scale": 0.01,
+        "value_offset": 0.0,
+    }),
+    # net.ndl (方策のみ)
+    ("net", {
+        "detect": "rn_1",
+        "trunk": [("conv", "conv1", "bnrelu", 5)] +
+                 [("res", "rn_%d" % i) for i in range(1, 20)] + [("res", "rn")],
+        "policy": [("conv", "conv", "bnrelu", 3),
+                   ("conv", "convX", "bn", 3)],
+        "value": [],
+    }),
+]
+
+
+class conv_t:
+    """畳み込み1層 (バイアス, BNの順にかける)"""
+
+    def __init__(self, kernel, weight, relu, bias=None, point=False, bn=None):
+        self.kernel = kernel
+        self.weight = weight    # (出力, 入力, カーネル, カーネル)
+        self.relu = relu
+        self.bias = bias        # (出力,) または (出力, 交点数)
+        self.point = point
+        self.bn = bn            # (scale, shift, mean, inv_std)
+
+
+class layer_t:
+    def __init__(self, conv, residual=False):
+        self.conv = conv        # 残差ブロックなら2層
+        self.residual = residual
+
+
+#################################
+#  CNTKのモデルの読み込み       #
+#################################
+def LoadCntkModel(filename):
+    import cntk as C
+
+    model = C.load_model(filename)
+
+    # 古い形式のモデルはBNの分散が標準偏差の逆数で保存されていて, 最初の計算で分散に直される
+    # 出力を一度計算してから値を取り出す
+    features = [a for a in model.arguments if a.name == "features"][0]
+    outputs = [model.find_by_name(name) for name in ("ol", "p")]
+    outputs = [o for o in outputs if o is not None]
+    network = C.combine(outputs)
+    network.eval({features: np.zeros((1,) + features.shape, dtype=np.float32)})
+
+    params = {}
+    for v in list(model.parameters) + list(model.constants):
+        params[v.name] = np.asarray(v.value, dtype=np.float64)
+
+    # BNのepsilonはscaleのパラメータの名前で引く
+    epsilon = {}
+    bn_nodes = C.logging.graph.depth_first_search(
+        model, lambda f: isinstance(f, C.Function) and f.op_name == "BatchNormalization")
+    for f in bn_nodes:
+        epsilon[f.inputs[1].name] = float(f.attributes.get("epsilon", DEFAULT_EPSILON))
+
+    def evaluate(x):
+        result = network.eval({features: x[np.newaxis].astype(np.float32)})
+        policy = value = None
+        for o in outputs:
+            out = result[o.output] if len(outputs) > 1 else result
+            if o.name == "ol":
+                policy = np.asarray(out).ravel()
+            else:
+                value = float(np.asarray(out).ravel()[0])
+        return policy, value
+
+    return params, epsilon, features.shape, evaluate
+
+
+#################################
+#  パラメータから層を組み立てる  #
+#################################
+def Param(params, name):
+    if name not in params:
+        prefix = name.rsplit(".", 1)[0]
+        near = sorted(n for n in params if n.startswith(prefix))
+        sys.exit("parameter %s is not found (%s)" % (name, ", ".join(near) or "none"))
+    return params[name]
+
+
+def ConvWeight(params, name, kernel):
+    w = Param(params, name)
+    # Parameter(出力, 入力 x カーネル x カーネル)はPythonからは(内積の長さ, 出力)に見える
+    if w.ndim == 2:
+        w = w.T
+    out = w.shape[0]
+    w = w.reshape(out, -1)
+    if w.shape[1] % (kernel * kernel) != 0:
+        sys.exit("bad weight shape %s : %s" % (str(w.shape), name))
+    return w.reshape(out, -1, kernel, kernel)
+
+
+def BatchNorm(params, epsilon, prefix):
+    scale = Param(params, prefix + "sc").ravel()
+    shift = Param(params, prefix + "b").ravel()
+    mean = Param(params, prefix + "m").ravel()
+    variance = Param(params, prefix + "isd").ravel()
+    eps = epsilon.get(prefix + "sc", DEFAULT_EPSILON)
+    return (scale, shift, mean, 1.0 / np.sqrt(variance + eps))
+
+
+def MakeConv(params, epsilon, name, kind, kernel, relu):
+    if kind == "bnrelu":
+        return conv_t(kernel, ConvWeight(params, name + ".c.W", kernel), relu,
+                      bn=BatchNorm(params, epsilon, name + ".c.c."))
+    if kind == "bn":
+        return conv_t(kernel, ConvWeight(params, name + ".W", kernel), relu,
+                      bn=BatchNorm(params, epsilon, name + ".c."))
+    w = ConvWeight(params, name + ".convW", kernel)
+    if kind == "bias":
+        return conv_t(kernel, w, relu, bias=Param(params, name + ".convB").ravel())
+    # ImageParameter(盤の横, 盤の縦, 出力)は(出力, 盤の縦, 盤の横)に見える
+    return conv_t(kernel, w, relu, bias=Param(params, name + ".b").reshape(w.shape[0], -1), point=True)
+
+
+def MakeTower(params, epsilon, layout):
+    tower = []
+    for entry in layout:
+        if entry[0] == "res":
+            name = entry[1]
+            tower.append(layer_t([MakeConv(params, epsilon, name + ".c1", "bnrelu", 3, True),
+                                  MakeConv(params, epsilon, name + ".c2", "bn", 3, False)], True))
+        else:
+            _, name, kind, kernel = entry
+            tower.append(layer_t([MakeConv(params, epsilon, name, kind, kernel, kind == "bnrelu")]))
+    return tower
+
+
+def MakeNetwork(params, epsilon, layout):
+    net = {}
+    for tower in ("trunk", "policy", "value"):
+        net[tower] = MakeTower(params, epsilon, layout[tower])
+    offset = layout.get("value_offset", 0.0)
+    if isinstance(offset, str):
+        offset = float(Param(params, offset).ravel()[0])
+    net["value_scale"] = layout.get("value_scale", 1.0)
+    net["value_offset"] = offset
+    return net
+
+
+#################################
+#  重みファイルの書き出し        #
+#################################
+def WriteValues(fp, values):
+    fp.write(" ".join("%.9g" % v for v in np.asarray(values).ravel()))
+    fp.write("\n")
+
+
+def WriteConv(fp, conv):
+    out, inp = conv.weight.shape[0], conv.weight.shape[1]
+    bias_type = "none" if conv.bias is None else "point" if conv.point else "channel"
+    fp.write("conv %d %d %d %s %s %s\n" % (conv.kernel, inp, out, "relu" if conv.relu else "linear",
+                                          bias_type, "nobn" if conv.bn is None else "bn"))
+    WriteValues(fp, conv.weight)
+    if conv.bias is not None:
+        WriteValues(fp, conv.bias)
+    if conv.bn is not None:
+        WriteValues(fp, np.concatenate(conv.bn))
+
+
+def WriteModel(filename, net, board):
+    input_channels = net["trunk"][0].conv[0].weight.shape[1]
+    with open(filename, "w") as fp:
+        fp.write("ray-nn %d\n" % MODEL_VERSION)
+        fp.write("board %d\n" % board)
+        fp.write("input %d\n" % input_channels)
+        for tower in ("trunk", "policy", "value"):
+            if not net[tower]:
+                continue
+            fp.write("tower %s %d\n" % (tower, len(net[tower])))
+            for layer in net[tower]:
+                if layer.residual:
+                    fp.write("res %d\n" % layer.conv[0].weight.shape[0])
+                for conv in layer.conv:
+                    WriteConv(fp, conv)
+        fp.write("value %.9g %.9g\n" % (net["value_scale"], net["value_offset"]))
+        fp.write("end\n")
+
+
+#################################
+#  書き出した重みでの計算        #
+#################################
+def Convolution(conv, x, residual=None):
+    channels, height, width = x.shape
+    pad = conv.kernel // 2
+    xp = np.pad(x, ((0, 0), (pad, pad), (pad, pad)))
+    y = np.zeros((conv.weight.shape[0], height * width))
+    for ky in range(conv.kernel):
+        for kx in range(conv.kernel):
+            y += conv.weight[:, :, ky, kx] @ xp[:, ky:ky + height, kx:kx + width].reshape(channels, -1)
+    if conv.bias is not None:
+        y += conv.bias if conv.point else conv.bias[:, np.newaxis]
+    if conv.bn is not None:
+        scale, shift, mean, inv_std = (v[:, np.newaxis] for v in conv.bn)
+        y = scale * (y - mean) * inv_std + shift
+    y = y.reshape(-1, height, width)
+    if residual is not None:
+        y += residual
+    return np.maximum(y, 0) if conv.relu or residual is not None else y
+
+
+def RunTower(tower, x):
+    for layer in tower:
+        if layer.residual:
+            x = Convolution(layer.conv[1], Convolution(layer.conv[0], x), x)
+        else:
+            x = Convolution(layer.conv[0], x)
+    return x
+
+
+def Evaluate(net, x):
+    trunk = RunTower(net["trunk"], x)
+    policy = RunTower(net["policy"], trunk).ravel()
+    value = None
+    if net["value"]:
+        out = RunTower(net["value"], trunk)
+        value = float(np.tanh(net["value_scale"] * np.tanh(out).sum() + net["value_offset"]))
+    return policy, value
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Export a CNTK model for the cpu NN backend")
+    parser.add_argument("model", help="CNTK model (uct_params/model.bin)")
+    parser.add_argument("output", help="output file (uct_params/model.txt)")
+    parser.add_argument("--layout", choices=[name for name, _ in LAYOUTS],
+                        help="network layout (detected from node names by default)")
+    args = parser.parse_args()
+
+    params, epsilon, input_shape, evaluate = LoadCntkModel(args.model)
+
+    names = {n.split(".")[0] for n in params}
+    for name, layout in LAYOUTS:
+        if name == args.layout or (args.layout is None and layout["detect"] in names):
+            break
+    else:
+        sys.exit("unknown network layout, use --layout")
+    print("layout : %s" % name)
+
+    net = MakeNetwork(params, epsilon, layout)
+    board = input_shape[-1]
+    WriteModel(args.output, net, board)
+    print("write : %s" % args.output)
+
+    # 乱数の局面でCNTKの出力と比べる
+    rng = np.random.RandomState(1)
+    x = (rng.randint(0, 3, size=input_shape) == 0).astype(np.float64)
+    policy, value = Evaluate(net, x)
+    cntk_policy, cntk_value = evaluate(x)
+    print("policy max diff : %g" % np.abs(policy - cntk_policy).max())
+    if value is not None and cntk_value is not None:
+        print("value diff : %g (%f / %f)" % (abs(value - cntk_value), value, cntk_value))
+
+
+if __name__ == "__main__":
+    main()
@@ -8,6 +8,8 @@
 #include "GoBoard.h"
 #include "Gtp.h"
 #include "Message.h"
+#include "NNCache.h"
+#include "ParamBundle.h"
 #include "UctSearch.h"
 #include "ZobristHash.h"
 
@@ -19,6 +21,7 @@ const string command[COMMAND_MAX] = {
   "--size",
   "--const-time",
   "--thread",
+  "--cpu-affinity",
   "--komi",
   "--handicap",
   "--reuse-subtree",
@@ -29,7 +32,16 @@ const string command[COMMAND_MAX] = {
   "--no-early-pass",
   "--no-nn",
   "--no-gpu",
+  "--nn-backend",
+  "--nn-threads",
+  "--nn-int8",
+  "--nn-calibrate",
+  "--make-nn-model",
+  "--nn-cache",
   "--no-expand",
+  "--params",
+  "--make-params",
+  "--verify-params",
 };
 
 const string errmessage[COMMAND_MAX] = {
@@ -38,6 +50,7 @@ const string errmessage[COMMAND_MAX] = {
   "Set board size",
   "Set mode const time, and set thinking time per move",
   "Set threads",
+  "Bind each search thread to a CPU",
   "Set komi",
   "Set the number of handicap stones (for testing)",
   "Reuse subtree",
@@ -48,7 +61,16 @@ const string errmessage[COMMAND_MAX] = {
   "No early pass",
   "Don't use NN",
   "Don't use GPU",
+  "Set NN backend (cntk, cpu, stub)",
+  "Set threads for CPU NN backend",
+  "Use INT8 inference in CPU NN backend",
+  "Calibrate INT8 inference from the features file and check its accuracy",
+  "Convert uct_params/model.txt into the mapped CPU NN model file",
+  "Set positions kept in NN evaluation cache (0 to disable)",
   "No MCTS",
+  "Set parameter bundle file",
+  "Compile sim_params and uct_params into the parameter bundle file",
+  "Verify the checksum of the whole parameter files at startup",
 };
 
 
@@ -93,6 +115,9 @@ AnalyzeCommand( int argc, char **argv )
       case COMMAND_THREAD:
 	SetThread(atoi(argv[++i]));
 	break;
+      case COMMAND_CPU_AFFINITY:
+	SetThreadAffinity(true);
+	break;
       case COMMAND_KOMI:
 	SetKomi(atof(argv[++i]));
 	break;
@@ -125,9 +150,48 @@ AnalyzeCommand( int argc, char **argv )
       case COMMAND_NO_GPU:
 	SetUseGPU(false);
 	break;
+      case COMMAND_NN_BACKEND:
+	{
+	  NN_BACKEND backend = GetNNBackend(argv[++i]);
+	  if (backend == NN_BACKEND_MAX) {
+	    fprintf(stderr, "Unknown NN backend : %s\n", argv[i]);
+	    exit(1);
+	  }
+	  SetNNBackend(backend);
+	}
+	break;
+      case COMMAND_NN_THREADS:
+	SetNNThreads(atoi(argv[++i]));
+	break;
+      case COMMAND_NN_INT8:
+	SetNNInt8(true);
+	break;
+      case COMMAND_NN_CALIBRATE:
+	SetNNCalibration(argv[++i]);
+	break;
+      case COMMAND_MAKE_NN_MODEL:
+	SetMakeNNModel(true);
+	break;
+      case COMMAND_NN_CACHE:
+	SetNNCacheSize(atoi(argv[++i]));
+	break;
       case COMMAND_NO_EXPAND:
         SetNoExpand(true);
         break;
+      case COMMAND_PARAMS:
+	i++;
+	if (strlen(argv[i]) >= sizeof(param_bundle_path)) {
+	  fprintf(stderr, "Too long path : %s\n", argv[i]);
+	  exit(1);
+	}
+	strcpy(param_bundle_path, argv[i]);
+	break;
+      case COMMAND_MAKE_PARAMS:
+	SetMakeParamBundle(true);
+	break;
+      case COMMAND_VERIFY_PARAMS:
+	SetVerifyParamFiles(true);
+	break;
       default:
 	for (j = 0; j < COMMAND_MAX; j++){
 	  fprintf(stderr, "%-22s : %s\n", command[j].c_str(), errmessage[j].c_str());
@@ -7,6 +7,7 @@ enum COMMAND {
   COMMAND_SIZE,
   COMMAND_CONST_TIME,
   COMMAND_THREAD,
+  COMMAND_CPU_AFFINITY,
   COMMAND_KOMI,
   COMMAND_HANDICAP,
   COMMAND_REUSE_SUBTREE,
@@ -17,7 +18,16 @@ enum COMMAND {
   COMMAND_NO_EARLY_PASS,
   COMMAND_NO_NN,
   COMMAND_NO_GPU,
+  COMMAND_NN_BACKEND,
+  COMMAND_NN_THREADS,
+  COMMAND_NN_INT8,
+  COMMAND_NN_CALIBRATE,
+  COMMAND_MAKE_NN_MODEL,
+  COMMAND_NN_CACHE,
   COMMAND_NO_EXPAND,
+  COMMAND_PARAMS,
+  COMMAND_MAKE_PARAMS,
+  COMMAND_VERIFY_PARAMS,
   COMMAND_MAX,
 };
 
@@ -12,6 +12,7 @@
 #include "UctSearch.h"
 #include "Ladder.h"
 #include "Rating.h"
+#include "Simulation.h"
 
 using namespace std;
 
@@ -50,6 +51,7 @@ int border_dis_y[BOARD_MAX];                     // y方向の距離
 int move_dis[PURE_BOARD_SIZE][PURE_BOARD_SIZE];  // 着手距離  
 
 int onboard_pos[PURE_BOARD_MAX];  //  実際の盤上の位置との対応
+int onboard_index[BOARD_MAX];     //  onboard_posの逆引き
 int first_move_candidate[PURE_BOARD_MAX]; // 初手の候補手
 
 int corner[4];
@@ -84,12 +86,15 @@ static void RemoveLiberty( game_info_t *game, string_t *string, int pos );
 static void PoRemoveLiberty( game_info_t *game, string_t *string, int pos, int color );
 
 // 石1つの連を作る
+template <int SIZE = 0>
 static void MakeString( game_info_t *game, int pos, int color );
 
 // 連と1つの石の接続
+template <int SIZE = 0>
 static void AddStone( game_info_t *game, int pos, int color, int id );
 
 /// 2つ以上の連の接続
+template <int SIZE = 0>
 static void ConnectString( game_info_t *game, int pos, int color, int connection, int id[] );
 
 // 2つ以上の連のマージ
@@ -104,6 +109,7 @@ static int RemoveString( game_info_t *game, string_t *string );
 
 // 連を盤上から除去
 // 取り除いた石の数を返す
+template <int SIZE = 0>
 static int PoRemoveString( game_info_t *game, string_t *string, int color );
 
 // 隣接する連IDの追加
@@ -112,6 +118,15 @@ static void AddNeighbor( string_t *string, int id, int head );
 // 隣接する連IDの削除
 static void RemoveNeighborString( string_t *string, int id );
 
+// 着手を戻すための情報の記録
+static void RecordUndo( game_info_t *game, int pos, int color );
+
+// 連の退避
+static void SaveUndoString( game_info_t *game, int id, int string_begin );
+
+// 座標の退避
+static void SaveUndoPoint( game_info_t *game, int pos );
+
 
 ///////////////////////
 //  盤の大きさの設定  //
@@ -132,6 +147,7 @@ SetBoardSize( int size )
   i = 0;
   for (y = board_start; y <= board_end; y++) {
     for (x = board_start; x <= board_end; x++) {
+      onboard_index[POS(x, y)] = i;
       onboard_pos[i++] = POS(x, y);
       board_x[POS(x, y)] = x;
       board_y[POS(x, y)] = y;
@@ -190,6 +206,9 @@ SetBoardSize( int size )
   corner_neighbor[2][1] = SOUTH(POS(board_end, board_start));
   corner_neighbor[3][0] = NORTH(POS(board_end, board_end));
   corner_neighbor[3][1] = WEST(POS(board_end, board_end));
+
+  // シミュレーションを盤の大きさに特殊化した実装に切り替える
+  SetSimulationBoardSize(size);
 }
 
 //////////////////////
@@ -208,18 +227,6 @@ SetKomi( double new_komi )
 }
 
 
-////////////////////////////
-//  上下左右の座標の導出  //
-////////////////////////////
-void
-GetNeighbor4( int neighbor4[4], int pos )
-{
-  neighbor4[0] = NORTH(pos);
-  neighbor4[1] =  WEST(pos);
-  neighbor4[2] =  EAST(pos);
-  neighbor4[3] = SOUTH(pos);
-}
-
 ////////////////////////
 //  メモリ領域の確保  //
 ////////////////////////
@@ -244,6 +251,33 @@ FreeGame( game_info_t *game )
 }
 
 
+////////////////////////
+//  着手の記録の確保  //
+//////////////////////////
+game_journal_t *
+AllocateJournal( void )
+{
+  game_journal_t *journal = new game_journal_t;
+
+  journal->moves.reserve(MAX_RECORDS);
+  journal->string_ids.reserve(MAX_STRING);
+  journal->strings.reserve(MAX_STRING);
+  journal->points.reserve(PURE_BOARD_MAX);
+
+  return journal;
+}
+
+
+////////////////////////
+//  着手の記録の解放  //
+//////////////////////////
+void
+FreeJournal( game_journal_t *journal )
+{
+  delete journal;
+}
+
+
 ////////////////////////
 //  対局情報の初期化  //
 ////////////////////////
@@ -298,6 +332,7 @@ InitializeBoard( game_info_t *game )
   for (i = 0; i < MAX_STRING; i++) {
     game->string[i].flag = false;
   }
+  game->strings = 0;
 
   ClearPattern(game->pat);
 
@@ -376,14 +411,13 @@ CopyGame( game_info_t *dst, const game_info_t *src )
   memset(dst->tactical_features1, 0, sizeof(unsigned int) * board_max);  
   memset(dst->tactical_features2, 0, sizeof(unsigned int) * board_max);  
 
-
-  for (i = 0; i < MAX_STRING; i++) {
-    if (src->string[i].flag) {
-      memcpy(&dst->string[i], &src->string[i], sizeof(string_t));
-    } else {
-      dst->string[i].flag = false;
-    }
+  // 連のデータは使用された連番号の範囲だけをまとめてコピーし,
+  // コピー先に残っている範囲外の連は無効にする
+  memcpy(dst->string, src->string, sizeof(string_t) * src->strings);
+  for (i = src->strings; i < dst->strings; i++) {
+    dst->string[i].flag = false;
   }
+  dst->strings = src->strings;
 
   dst->current_hash = src->current_hash;
   dst->previous1_hash = src->previous1_hash;
@@ -414,6 +448,7 @@ InitializeConst( void )
   i = 0;
   for (y = board_start; y <= board_end; y++) {
     for (x = board_start; x <= board_end; x++) {
+      onboard_index[POS(x, y)] = i;
       onboard_pos[i++] = POS(x, y);
       board_x[POS(x, y)] = x;
       board_y[POS(x, y)] = y;
@@ -824,8 +859,8 @@ IsFalseEyeConnection( game_info_t *game, int pos, int color )
     if (board[neighbor4[i]] == color) {
       id = string_id[neighbor4[i]];
       if (string[id].libs == 2) {
-	lib = string[id].lib[0];
-	if (lib == pos) lib = string[id].lib[lib];
+	lib = FirstLiberty(&string[id]);
+	if (lib == pos) lib = NextLiberty(&string[id], lib);
 	if (IsSelfAtari(game, color, lib)) return true;
       }
       already_checked = false;
@@ -836,7 +871,7 @@ IsFalseEyeConnection( game_info_t *game, int pos, int color )
 	}
       }
       if (already_checked) continue;
-      lib = string[id].lib[0];
+      lib = FirstLiberty(&string[id]);
       count = 0;
       while (lib != LIBERTY_END) {
 	if (lib != pos) {
@@ -852,7 +887,7 @@ IsFalseEyeConnection( game_info_t *game, int pos, int color )
 	    count++;
 	  }
 	}
-	lib = string[id].lib[lib];
+	lib = NextLiberty(&string[id], lib);
       }
       libs += count;
       string_liberties[strings] = string[id].libs;
@@ -865,13 +900,13 @@ IsFalseEyeConnection( game_info_t *game, int pos, int color )
     lib_sum += string_liberties[i] - 1;
   }
 
-  neighbor = string[checked_string[0]].neighbor[0];
+  neighbor = FirstNeighbor(&string[checked_string[0]]);
   while (neighbor != NEIGHBOR_END) {
     if (string[neighbor].libs == 1 &&
-	string[checked_string[1]].neighbor[neighbor] != 0) {
+	IsNeighborString(&string[checked_string[1]], neighbor)) {
       return false;
     }
-    neighbor = string[checked_string[0]].neighbor[neighbor];
+    neighbor = NextNeighbor(&string[checked_string[0]], neighbor);
   }
 
   // 隣接する連が一続きなら眼なのでfalseを返す
@@ -892,9 +927,11 @@ IsFalseEyeConnection( game_info_t *game, int pos, int color )
 ////////////////////////////////////
 //  合法手でかつ目でないかを判定  //
 ////////////////////////////////////
+template <int SIZE>
 bool
 IsLegalNotEye( game_info_t *game, int pos, int color )
 {
+  const int board_size = FixedBoardSize<SIZE>();
   int *string_id = game->string_id;
   string_t *string = game->string;
 
@@ -919,7 +956,7 @@ IsLegalNotEye( game_info_t *game, int pos, int color )
 
     // 自殺手かどうか
     if (nb4_empty[Pat3(game->pat, pos)] == 0 &&
-	IsSuicide(game, string, color, pos)) {
+	IsSuicide<SIZE>(game, string, color, pos)) {
       return false;
     }
 
@@ -952,6 +989,7 @@ IsLegalNotEye( game_info_t *game, int pos, int color )
 ////////////////////
 //  自殺手の判定  //
 ////////////////////
+template <int SIZE>
 bool
 IsSuicide( const game_info_t *game, const string_t *string, int color, int pos )
 {
@@ -960,7 +998,7 @@ IsSuicide( const game_info_t *game, const string_t *string, int color, int pos )
   int other = FLIP_COLOR(color);
   int neighbor4[4], i;
 
-  GetNeighbor4(neighbor4, pos);
+  GetNeighbor4<SIZE>(neighbor4, pos);
 
   // 隣接するの石についての判定
   // 隣接する石が相手でも、その石を含む連の呼吸点が1の時は合法手
@@ -995,6 +1033,11 @@ PutStone( game_info_t *game, int pos, int color )
   int neighbor[4];
   int i;
 
+  // 着手を戻すための情報を記録
+  if (game->journal != NULL) {
+    RecordUndo(game, pos, color);
+  }
+
   // この手番の着手で打ち上げた石の数を0にする
   game->capture_num[color] = 0;
 
@@ -1065,7 +1108,7 @@ PutStone( game_info_t *game, int pos, int color )
     if (prisoner == 1 &&
 	string[string_id[pos]].libs == 1) {
       game->ko_move = game->moves;
-      game->ko_pos = string[string_id[pos]].lib[0];
+      game->ko_pos = FirstLiberty(&string[string_id[pos]]);
       game->current_hash ^= hash_bit[game->ko_pos][HASH_KO];
     }
   } else if (connection == 1) {
@@ -1082,6 +1125,7 @@ PutStone( game_info_t *game, int pos, int color )
 ////////////////
 //  石を置く  //
 ////////////////
+template <int SIZE>
 void
 PoPutStone( game_info_t *game, int pos, int color )
 {
@@ -1121,18 +1165,14 @@ PoPutStone( game_info_t *game, int pos, int color )
   game->tactical_features2[pos] = 0;
 
   // 着手箇所のレートを0に戻す
-  game->sum_rate[0] -= game->rate[0][pos];
-  game->sum_rate_row[0][board_y[pos]] -= game->rate[0][pos];
-  game->rate[0][pos] = 0;
-  game->sum_rate[1] -= game->rate[1][pos];
-  game->sum_rate_row[1][board_y[pos]] -= game->rate[1][pos];
-  game->rate[1][pos] = 0;
+  UpdateRate(&game->rate[0], pos, 0);
+  UpdateRate(&game->rate[1], pos, 0);
 
   // パターンの更新(MD2)  
-  UpdateMD2Stone(game->pat, color, pos);
+  UpdateMD2Stone<SIZE>(game->pat, color, pos);
 
   // 着手箇所の上下左右の座標の導出
-  GetNeighbor4(neighbor, pos);
+  GetNeighbor4<SIZE>(neighbor, pos);
 
   // 着手箇所の上下左右の確認
   // 自分の連があれば, その連の呼吸点を1つ減らし, 接続候補に入れる
@@ -1144,7 +1184,7 @@ PoPutStone( game_info_t *game, int pos, int color )
     } else if (board[neighbor[i]] == other) {
       PoRemoveLiberty(game, &string[string_id[neighbor[i]]], pos, color);
       if (string[string_id[neighbor[i]]].libs == 0) {
-	prisoner += PoRemoveString(game, &string[string_id[neighbor[i]]], color);
+	prisoner += PoRemoveString<SIZE>(game, &string[string_id[neighbor[i]]], color);
       }
     }
   }
@@ -1156,16 +1196,16 @@ PoPutStone( game_info_t *game, int pos, int color )
   // 接続候補が1つならば, その連に石を追加する
   // 接続候補が2つ以上ならば, 連同士を繋ぎ合わせて, 石を追加する  
   if (connection == 0) {
-    MakeString(game, pos, color);
+    MakeString<SIZE>(game, pos, color);
     if (prisoner == 1 &&
 	string[string_id[pos]].libs == 1) {
       game->ko_move = game->moves;
-      game->ko_pos = string[string_id[pos]].lib[0];
+      game->ko_pos = FirstLiberty(&string[string_id[pos]]);
     }
   } else if (connection == 1) {
-    AddStone(game, pos, color, connect[0]);
+    AddStone<SIZE>(game, pos, color, connect[0]);
   } else {
-    ConnectString(game, pos, color, connection, connect);
+    ConnectString<SIZE>(game, pos, color, connection, connect);
   }
 
   // 手数を進める
@@ -1173,9 +1213,226 @@ PoPutStone( game_info_t *game, int pos, int color )
 }
 
 
+//////////////////////////////////
+//  着手を戻すための情報の記録  //
+//////////////////////////////////
+static void
+RecordUndo( game_info_t *game, int pos, int color )
+// game_info_t *game : 盤面の情報を示すポインタ
+// int pos           : 着手する座標
+// int color         : 着手する色
+{
+  game_journal_t *journal = game->journal;
+  const string_t *string = game->string;
+  const int *string_id = game->string_id;
+  const int *string_next = game->string_next;
+  const char *board = game->board;
+  int other = FLIP_COLOR(color);
+  int neighbor4[4], own_id[4], own = 0;
+  int i, j, id, neighbor, stone, lib;
+  bool checked;
+  undo_move_t undo;
+
+  undo.pos = pos;
+  undo.color = color;
+  if (game->moves < MAX_RECORDS) {
+    undo.record = game->record[game->moves];
+  }
+  undo.prisoner = game->prisoner[color];
+  undo.ko_pos = game->ko_pos;
+  undo.ko_move = game->ko_move;
+  undo.pass_count = game->pass_count;
+  undo.capture_num = game->capture_num[color];
+  undo.strings = game->strings;
+  undo.current_hash = game->current_hash;
+  undo.previous1_hash = game->previous1_hash;
+  undo.previous2_hash = game->previous2_hash;
+  undo.tactical_features1 = game->tactical_features1[pos];
+  undo.tactical_features2 = game->tactical_features2[pos];
+  undo.string_begin = (int)journal->string_ids.size();
+  undo.point_begin = (int)journal->points.size();
+
+  if (pos != PASS) {
+    // 着手箇所
+    SaveUndoPoint(game, pos);
+
+    GetNeighbor4(neighbor4, pos);
+
+    for (i = 0; i < 4; i++) {
+      if (board[neighbor4[i]] != color &&
+	  board[neighbor4[i]] != other) continue;
+
+      id = string_id[neighbor4[i]];
+
+      // 同じ連は1度だけ確認する
+      checked = false;
+      for (j = 0; j < i; j++) {
+	if (string_id[neighbor4[j]] == id) checked = true;
+      }
+      if (checked) continue;
+
+      SaveUndoString(game, id, undo.string_begin);
+
+      // 呼吸点が1つになる連は残った呼吸点が候補手に戻る
+      if (string[id].libs == 2) {
+	lib = FirstLiberty(&string[id]);
+	while (lib != LIBERTY_END) {
+	  SaveUndoPoint(game, lib);
+	  lib = NextLiberty(&string[id], lib);
+	}
+      }
+
+      if (board[neighbor4[i]] == color) {
+	// 接続する連は石の繋がりが変わる
+	own_id[own++] = id;
+	stone = string[id].origin;
+	while (stone != STRING_END) {
+	  SaveUndoPoint(game, stone);
+	  stone = string_next[stone];
+	}
+      } else if (string[id].libs == 1) {
+	// 取られる連の石と, 呼吸点が増える周囲の連
+	stone = string[id].origin;
+	while (stone != STRING_END) {
+	  SaveUndoPoint(game, stone);
+	  stone = string_next[stone];
+	}
+	neighbor = FirstNeighbor(&string[id]);
+	while (neighbor != NEIGHBOR_END) {
+	  SaveUndoString(game, neighbor, undo.string_begin);
+	  neighbor = NextNeighbor(&string[id], neighbor);
+	}
+      }
+    }
+
+    if (own == 0) {
+      // 新しい連を作る先
+      id = 1;
+      while (string[id].flag) { id++; }
+      SaveUndoString(game, id, undo.string_begin);
+    } else if (own >= 2) {
+      // 連同士を繋ぐときは隣接する敵連の情報も変わる
+      for (j = 0; j < own; j++) {
+	neighbor = FirstNeighbor(&string[own_id[j]]);
+	while (neighbor != NEIGHBOR_END) {
+	  SaveUndoString(game, neighbor, undo.string_begin);
+	  neighbor = NextNeighbor(&string[own_id[j]], neighbor);
+	}
+      }
+    }
+  }
+
+  journal->moves.push_back(undo);
+}
+
+
+////////////////
+//  連の退避  //
+////////////////
+static void
+SaveUndoString( game_info_t *game, int id, int string_begin )
+// game_info_t *game : 盤面の情報を示すポインタ
+// int id            : 退避する連のID
+// int string_begin  : この手で退避した連の先頭
+{
+  game_journal_t *journal = game->journal;
+  int i;
+
+  // 既にこの手で退避していれば何もしない
+  for (i = string_begin; i < (int)journal->string_ids.size(); i++) {
+    if (journal->string_ids[i] == id) return;
+  }
+
+  journal->string_ids.push_back(id);
+  journal->strings.push_back(game->string[id]);
+}
+
+
+//////////////////
+//  座標の退避  //
+//////////////////
+static void
+SaveUndoPoint( game_info_t *game, int pos )
+// game_info_t *game : 盤面の情報を示すポインタ
+// int pos           : 退避する座標
+{
+  undo_point_t point;
+
+  point.pos = pos;
+  point.string_id = game->string_id[pos];
+  point.string_next = game->string_next[pos];
+  point.board = game->board[pos];
+  point.candidate = game->candidates[pos];
+
+  game->journal->points.push_back(point);
+}
+
+
+////////////////////////
+//  直前の着手を戻す  //
+//////////////////////////
+void
+UndoMove( game_info_t *game )
+{
+  game_journal_t *journal = game->journal;
+  const undo_move_t *undo = &journal->moves.back();
+  const undo_point_t *point;
+  char *board = game->board;
+  int color = undo->color;
+  int i;
+
+  // 手数を戻す
+  game->moves--;
+
+  // 座標の状態を戻す
+  // 後に退避したものから戻すので, 重複して退避した座標も着手前の状態になる
+  for (i = (int)journal->points.size() - 1; i >= undo->point_begin; i--) {
+    point = &journal->points[i];
+    if (board[point->pos] != point->board) {
+      if (point->board == S_EMPTY) {
+	UpdatePatternEmpty(game->pat, point->pos);
+      } else {
+	UpdatePatternStone(game->pat, point->board, point->pos);
+      }
+      board[point->pos] = point->board;
+    }
+    game->string_id[point->pos] = point->string_id;
+    game->string_next[point->pos] = point->string_next;
+    game->candidates[point->pos] = point->candidate;
+  }
+
+  // 連のデータを戻す
+  for (i = (int)journal->string_ids.size() - 1; i >= undo->string_begin; i--) {
+    game->string[journal->string_ids[i]] = journal->strings[i];
+  }
+
+  // 局面の情報を戻す
+  if (game->moves < MAX_RECORDS) {
+    game->record[game->moves] = undo->record;
+  }
+  game->tactical_features1[undo->pos] = undo->tactical_features1;
+  game->tactical_features2[undo->pos] = undo->tactical_features2;
+  game->prisoner[color] = undo->prisoner;
+  game->ko_pos = undo->ko_pos;
+  game->ko_move = undo->ko_move;
+  game->pass_count = undo->pass_count;
+  game->capture_num[color] = undo->capture_num;
+  game->strings = undo->strings;
+  game->current_hash = undo->current_hash;
+  game->previous1_hash = undo->previous1_hash;
+  game->previous2_hash = undo->previous2_hash;
+
+  journal->points.resize(undo->point_begin);
+  journal->strings.resize(undo->string_begin);
+  journal->string_ids.resize(undo->string_begin);
+  journal->moves.pop_back();
+}
+
+
 //////////////////////
 //  新しい連の作成  //
 //////////////////////
+template <int SIZE>
 static void
 MakeString( game_info_t *game, int pos, int color )
 {
@@ -1191,14 +1448,15 @@ MakeString( game_info_t *game, int pos, int color )
   // 未使用の連のインデックスを見つける
   while (string[id].flag) { id++; }
 
+  // 使用された連番号の上限を更新
+  if (id >= game->strings) game->strings = id + 1;
+
   // 新しく連のデータを格納する箇所を保持
   new_string = &game->string[id];
 
   // 連のデータの初期化
-  memset(new_string->lib, 0, sizeof(short) * STRING_LIB_MAX);
-  memset(new_string->neighbor, 0, sizeof(short) * MAX_NEIGHBOR);
-  new_string->lib[0] = LIBERTY_END;
-  new_string->neighbor[0] = NEIGHBOR_END;
+  memset(new_string->lib_bits, 0, sizeof(unsigned long long) * LIB_BITS_WORDS);
+  memset(new_string->neighbor_bits, 0, sizeof(unsigned long long) * NEIGHBOR_BITS_WORDS);
   new_string->libs = 0;
   new_string->color = (char)color;
   new_string->origin = pos;
@@ -1208,7 +1466,7 @@ MakeString( game_info_t *game, int pos, int color )
   game->string_next[pos] = STRING_END;
 
   // 上下左右の座標の導出
-  GetNeighbor4(neighbor4, pos);
+  GetNeighbor4<SIZE>(neighbor4, pos);
 
   // 新しく作成した連の上下左右の座標を確認
   // 空点ならば, 作成した連に呼吸点を追加する
@@ -1271,6 +1529,7 @@ AddStoneToString( game_info_t *game, string_t *string, int pos, int head )
 ////////////////////////
 //  連に石を追加する  //
 ////////////////////////
+template <int SIZE>
 static void
 AddStone( game_info_t *game, int pos, int color, int id )
 // game_info_t *game : 盤面の情報を示すポインタ
@@ -1296,7 +1555,7 @@ AddStone( game_info_t *game, int pos, int color, int id )
   AddStoneToString(game, add_str, pos, 0);
 
   // 上下左右の座標の導出
-  GetNeighbor4(neighbor4, pos);
+  GetNeighbor4<SIZE>(neighbor4, pos);
 
   // 空点なら呼吸点を追加し
   // 敵の石があれば隣接する敵連の情報を更新
@@ -1315,6 +1574,7 @@ AddStone( game_info_t *game, int pos, int color, int id )
 //////////////////////////
 //  連同士の結合の判定  //
 //////////////////////////
+template <int SIZE>
 static void
 ConnectString( game_info_t *game, int pos, int color, int connection, int id[] )
 // game_info_t *game : 盤面の情報を示すポインタ
@@ -1350,7 +1610,7 @@ ConnectString( game_info_t *game, int pos, int color, int connection, int id[] )
   }
 
   // 石を追加
-  AddStone(game, pos, color, min);
+  AddStone<SIZE>(game, pos, color, min);
 
   // 複数の連が接続するときの処理
   if (connections > 0) {
@@ -1381,10 +1641,10 @@ MergeString( game_info_t *game, string_t *dst, string_t *src[3], int n )
 
     // 呼吸点をマージ
     prev = 0;
-    pos = src[i]->lib[0];
+    pos = FirstLiberty(src[i]);
     while (pos != LIBERTY_END) {
       prev = AddLiberty(dst, pos, prev);
-      pos = src[i]->lib[pos];
+      pos = NextLiberty(src[i], pos);
     }
 
     // 連のIDを更新
@@ -1400,13 +1660,13 @@ MergeString( game_info_t *game, string_t *dst, string_t *src[3], int n )
 
     // 隣接する敵連の情報をマージ
     prev = 0;
-    neighbor = src[i]->neighbor[0];
+    neighbor = FirstNeighbor(src[i]);
     while (neighbor != NEIGHBOR_END) {
       RemoveNeighborString(&string[neighbor], rm_id);
       AddNeighbor(dst, neighbor, prev);
       AddNeighbor(&string[neighbor], id, prev);
       prev = neighbor;
-      neighbor = src[i]->neighbor[neighbor];
+      neighbor = NextNeighbor(src[i], neighbor);
     }
 
     // 使用済みフラグをオフ
@@ -1422,24 +1682,16 @@ static int
 AddLiberty( string_t *string, int pos, int head )
 // string_t *string : 呼吸点を追加する対象の連
 // int pos        : 追加する呼吸点の座標
-// int head       : 探索対象の先頭のインデックス
+// int head       : 探索対象の先頭のインデックス(ビット集合では不要)
 {
-  int lib;
+  int index = onboard_index[pos];
+  unsigned long long bit = 1ULL << (index & 63);
 
   // 既に追加されている場合は何もしない
-  if (string->lib[pos] != 0) return pos;
-
-  // 探索対象の先頭のインデックスを代入
-  lib = head;
-
-  // 追加する場所を見つけるまで進める
-  while (string->lib[lib] < pos) {
-    lib = string->lib[lib];
-  }
+  if (string->lib_bits[index >> 6] & bit) return pos;
 
   // 呼吸点の座標を追加する
-  string->lib[pos] = string->lib[lib];
-  string->lib[lib] = (short)pos;
+  string->lib_bits[index >> 6] |= bit;
 
   // 呼吸点の数を1つ増やす
   string->libs++;
@@ -1458,26 +1710,21 @@ RemoveLiberty( game_info_t *game, string_t *string, int pos )
 // string_t *string  : 呼吸点を取り除く対象の連
 // int pos         : 取り除かれる呼吸点
 {
-  int lib = 0;
+  int index = onboard_index[pos];
+  unsigned long long bit = 1ULL << (index & 63);
 
   // 既に取り除かれている場合は何もしない
-  if (string->lib[pos] == 0) return;
-
-  // 取り除く呼吸点の座標を見つけるまで進める
-  while (string->lib[lib] != pos) {
-    lib = string->lib[lib];
-  }
+  if ((string->lib_bits[index >> 6] & bit) == 0) return;
 
   // 呼吸点の座標の情報を取り除く
-  string->lib[lib] = string->lib[string->lib[lib]];
-  string->lib[pos] = (short)0;
+  string->lib_bits[index >> 6] &= ~bit;
 
   // 連の呼吸点の数を1つ減らす
   string->libs--;
 
   // 呼吸点が1つならば, その連の呼吸点を候補手に追加
   if (string->libs == 1) {
-    game->candidates[string->lib[0]] = true;
+    game->candidates[FirstLiberty(string)] = true;
   }
 }
 
@@ -1493,19 +1740,15 @@ PoRemoveLiberty( game_info_t *game, string_t *string, int pos, int color )
 // int pos         : 取り除かれる呼吸点
 // int color       : その手番の色
 {
-  int lib = 0;
+  int index = onboard_index[pos];
+  unsigned long long bit = 1ULL << (index & 63);
+  int lib;
 
   // 既に取り除かれている場合は何もしない
-  if (string->lib[pos] == 0) return;
-
-  // 取り除く呼吸点の座標を見つけるまで進める
-  while (string->lib[lib] != pos) {
-    lib = string->lib[lib];
-  }
+  if ((string->lib_bits[index >> 6] & bit) == 0) return;
 
   // 呼吸点の座標の情報を取り除く
-  string->lib[lib] = string->lib[string->lib[lib]];
-  string->lib[pos] = 0;
+  string->lib_bits[index >> 6] &= ~bit;
 
   // 呼吸点の数を1つ減らす
   string->libs--;
@@ -1514,9 +1757,10 @@ PoRemoveLiberty( game_info_t *game, string_t *string, int pos, int color )
   // 呼吸点が1つならば, その呼吸点を候補手に戻して, レートの更新対象に加える
   // 呼吸点が2つならば, レートの更新対象に加える
   if (string->libs == 1) {
-    game->candidates[string->lib[0]] = true;
-    game->update_pos[color][game->update_num[color]++] = string->lib[0];
-    game->seki[string->lib[0]] = false;
+    lib = FirstLiberty(string);
+    game->candidates[lib] = true;
+    game->update_pos[color][game->update_num[color]++] = lib;
+    game->seki[lib] = false;
   }
 }
 
@@ -1570,10 +1814,10 @@ RemoveString( game_info_t *game, string_t *string )
   } while (pos != STRING_END);
 
   // 取り除いた連に隣接する連から隣接情報を取り除く
-  neighbor = string->neighbor[0];
+  neighbor = FirstNeighbor(string);
   while (neighbor != NEIGHBOR_END) {
     RemoveNeighborString(&str[neighbor], rm_id);
-    neighbor = string->neighbor[neighbor];
+    neighbor = NextNeighbor(string, neighbor);
   }
 
   // 連の存在フラグをオフ
@@ -1587,12 +1831,14 @@ RemoveString( game_info_t *game, string_t *string )
 ////////////////
 //  連の除去  //
 ////////////////
+template <int SIZE>
 static int
 PoRemoveString( game_info_t *game, string_t *string, int color )
 // game_info_t *game : 盤面の情報を示すポインタ
 // string_t *string  : 取り除く対象の連
 // int color       : 手番の色(連を構成する色とは違う色)
 {
+  const int board_size = FixedBoardSize<SIZE>();
   string_t *str = game->string;
   int *string_next = game->string_next;
   int *string_id = game->string_id;
@@ -1607,17 +1853,17 @@ PoRemoveString( game_info_t *game, string_t *string, int color )
   int lib;
   
   // 隣接する連の呼吸点を更新の対象に加える
-  neighbor = string->neighbor[0];
+  neighbor = FirstNeighbor(string);
   while (neighbor != NEIGHBOR_END) {
     if (str[neighbor].libs < 3) {
-      lib = str[neighbor].lib[0];
+      lib = FirstLiberty(&str[neighbor]);
       while (lib != LIBERTY_END) {
 	update_pos[(*update_num)++] = lib;
 	game->seki[lib] = false;
-	lib = str[neighbor].lib[lib];
+	lib = NextLiberty(&str[neighbor], lib);
       }
     }
-    neighbor = string->neighbor[neighbor];
+    neighbor = NextNeighbor(string, neighbor);
   }
   
   do {
@@ -1630,7 +1876,7 @@ PoRemoveString( game_info_t *game, string_t *string, int color )
     capture_pos[(*capture_num)++] = pos;
 
     // 3x3のパターンの更新
-    UpdateMD2Empty(game->pat, pos);
+    UpdateMD2Empty<SIZE>(game->pat, pos);
     
     // 上下左右を確認する
     // 隣接する連があれば呼吸点を追加する
@@ -1652,10 +1898,10 @@ PoRemoveString( game_info_t *game, string_t *string, int color )
   } while (pos != STRING_END);
 
   // 取り除いた連に隣接する連から隣接情報を取り除く
-  neighbor = string->neighbor[0];
+  neighbor = FirstNeighbor(string);
   while (neighbor != NEIGHBOR_END) {
     RemoveNeighborString(&str[neighbor], rm_id);
-    neighbor = string->neighbor[neighbor];
+    neighbor = NextNeighbor(string, neighbor);
   }
 
   // 連の存在フラグをオフ
@@ -1673,24 +1919,15 @@ static void
 AddNeighbor( string_t *string, int id, int head )
 // string_t *string : 隣接情報を追加する連
 // int id         : 追加される連ID
-// int head       : 探索対象の先頭のインデックス
+// int head       : 探索対象の先頭のインデックス(ビット集合では不要)
 {
-  int neighbor = 0;
+  unsigned long long bit = 1ULL << (id & 63);
 
   // 既に追加されている場合は何もしない
-  if (string->neighbor[id] != 0) return;
-
-  // 探索対象の先頭のインデックスを代入
-  neighbor = head;
-
-  // 追加場所を見つけるまで進める
-  while (string->neighbor[neighbor] < id) {
-    neighbor = string->neighbor[neighbor];
-  }
+  if (string->neighbor_bits[id >> 6] & bit) return;
 
   // 隣接する連IDを追加する
-  string->neighbor[id] = string->neighbor[neighbor];
-  string->neighbor[neighbor] = (short)id;
+  string->neighbor_bits[id >> 6] |= bit;
 
   // 隣接する連の数を1つ増やす
   string->neighbors++;
@@ -1705,19 +1942,13 @@ RemoveNeighborString( string_t *string, int id )
 // string_t *string : 隣接する連のIDを取り除く対象の連
 // int id         : 取り除く連のID
 {
-  int neighbor = 0;
+  unsigned long long bit = 1ULL << (id & 63);
 
   // 既に除外されていれば何もしない
-  if (string->neighbor[id] == 0) return;
-
-  // 取り除く隣接する連IDを見つけるまで進める
-  while (string->neighbor[neighbor] != id) {
-    neighbor = string->neighbor[neighbor];
-  }
+  if ((string->neighbor_bits[id >> 6] & bit) == 0) return;
 
   // 隣接する連IDを取り除く
-  string->neighbor[neighbor] = string->neighbor[string->neighbor[neighbor]];
-  string->neighbor[id] = 0;
+  string->neighbor_bits[id >> 6] &= ~bit;
 
   // 隣接する連の数を1つ減らす
   string->neighbors--;
@@ -1750,18 +1981,18 @@ CheckBentFourInTheCorner( game_info_t *game )
 	string[id].libs == 2 &&
 	string[id].neighbors == 1) {
       color = string[id].color;
-      lib1 = string[id].lib[0];
-      lib2 = string[id].lib[lib1];
+      lib1 = FirstLiberty(&string[id]);
+      lib2 = NextLiberty(&string[id], lib1);
       if ((board[corner_neighbor[i][0]] == S_EMPTY ||
 	   board[corner_neighbor[i][0]] == color) &&
 	  (board[corner_neighbor[i][1]] == S_EMPTY ||
 	   board[corner_neighbor[i][1]] == color)) {
-	neighbor = string[id].neighbor[0];
+	neighbor = FirstNeighbor(&string[id]);
 	if (string[neighbor].libs == 2 &&
 	    string[neighbor].size > 6) {
 	  // 呼吸点を共有しているかの確認
-	  neighbor_lib1 = string[neighbor].lib[0];
-	  neighbor_lib2 = string[neighbor].lib[neighbor_lib1];
+	  neighbor_lib1 = FirstLiberty(&string[neighbor]);
+	  neighbor_lib2 = NextLiberty(&string[neighbor], neighbor_lib1);
 	  if ((neighbor_lib1 == lib1 && neighbor_lib2 == lib2) ||
 	      (neighbor_lib1 == lib2 && neighbor_lib2 == lib1)) {
 	    pos = string[neighbor].origin;
@@ -1769,9 +2000,9 @@ CheckBentFourInTheCorner( game_info_t *game )
 	      board[pos] = (char)color;
 	      pos = string_next[pos];
 	    }
-	    pos = string[neighbor].lib[0];
+	    pos = FirstLiberty(&string[neighbor]);
 	    board[pos] = (char)color;
-	    pos = string[neighbor].lib[pos];
+	    pos = NextLiberty(&string[neighbor], pos);
 	    board[pos] = (char)color;
 	  }
 	}
@@ -1974,12 +2205,13 @@ WritePlanes(
     if (!data2)
       return;
     const statistic_t *statistic = root->statistic;
+    const int count = GetStatisticCount(root);
     for (int i = 1, y = board_start; y <= board_end; y++, i++) {
       // cerr << setw(2) << (pure_board_size + 1 - i) << ":|";
       for (int x = board_start; x <= board_end; x++) {
 	int pos = TransformMove(POS(x, y), tran);
 	// int pos = POS(x, y);
-	double owner = (double)statistic[pos].colors[color] / root->move_count;
+	double owner = (statistic == NULL || count <= 0) ? 0.5 : (double)statistic[pos].colors[color] / count;
 	/*
 	if (owner > 0.5) {
 	player++;
@@ -1995,3 +2227,17 @@ WritePlanes(
     }
   }
 }
+
+
+//////////////////////////////////////////
+//  盤の大きさごとのテンプレートの実体化  //
+//////////////////////////////////////////
+#define INSTANTIATE_GO_BOARD(size) \
+  template bool IsLegalNotEye<size>( game_info_t *game, int pos, int color ); \
+  template bool IsSuicide<size>( const game_info_t *game, const string_t *string, int color, int pos ); \
+  template void PoPutStone<size>( game_info_t *game, int pos, int color );
+
+INSTANTIATE_GO_BOARD(0)
+INSTANTIATE_GO_BOARD(9)
+INSTANTIATE_GO_BOARD(13)
+INSTANTIATE_GO_BOARD(19)
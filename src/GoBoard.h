@@ -2,6 +2,9 @@
 #define _GO_BOARD_H_
 
 #include <vector>
+#if defined (_MSC_VER)
+#include <intrin.h>
+#endif
 #include "Pattern.h"
 
 ////////////////
@@ -29,6 +32,12 @@ const int STRING_END = (STRING_POS_MAX - 1); // 連の終端を表す値
 const int NEIGHBOR_END = (MAX_NEIGHBOR - 1);  // 隣接する敵連の終端を表す値
 const int LIBERTY_END = (STRING_LIB_MAX - 1); // 呼吸点の終端を表す値
 
+const int RATE_LANES = 32;  // レートの累積和の要素の数の最大値 (盤の1辺の最大値以上)
+
+const int LIB_BITS_WORDS = ((PURE_BOARD_MAX + 63) / 64);      // 呼吸点のビット集合の語数
+const int NEIGHBOR_BITS_WORDS = ((MAX_NEIGHBOR + 63) / 64);  // 隣接する敵連のビット集合の語数
+const int SEKI_BITS_WORDS = ((PURE_BOARD_MAX + 63) / 64);      // セキの箇所のビット集合の語数
+
 const int MAX_RECORDS = (PURE_BOARD_MAX * 3); // 記録する着手の最大数 
 const int MAX_MOVES = (MAX_RECORDS - 1);      // 着手数の最大値
 
@@ -89,18 +98,67 @@ struct move {
   int pos;    // 着手箇所の座標
 };
 
-// 連を表す構造体 (19x19 : 1987bytes)
+// 連を表す構造体 (19x19 : 120bytes)
+// 呼吸点は盤上の位置のインデックス(onboard_index), 
+// 隣接する敵連は連番号をビット位置とするビット集合で保持する
 struct string_t {
-  char color;                    // 連の色
-  int libs;                      // 連の持つ呼吸点数
-  short lib[STRING_LIB_MAX];     // 連の持つ呼吸点の座標
-  int neighbors;                 // 隣接する敵の連の数
-  short neighbor[MAX_NEIGHBOR];  // 隣接する敵の連の連番号
-  int origin;                    // 連の始点の座標
-  int size;                      // 連を構成する石の数
-  bool flag;                     // 連の存在フラグ
+  char color;                                           // 連の色
+  int libs;                                             // 連の持つ呼吸点数
+  unsigned long long lib_bits[LIB_BITS_WORDS];          // 連の持つ呼吸点の集合
+  int neighbors;                                        // 隣接する敵の連の数
+  unsigned long long neighbor_bits[NEIGHBOR_BITS_WORDS]; // 隣接する敵の連の連番号の集合
+  int origin;                                           // 連の始点の座標
+  int size;                                             // 連を構成する石の数
+  bool flag;                                            // 連の存在フラグ
+};
+
+
+// 着手を戻すための1手分の記録
+struct undo_move_t {
+  int pos;                             // 着手箇所
+  int color;                           // 着手した色
+  move record;                         // 上書きされる着手の記録
+  int prisoner;                        // 着手前のアゲハマ
+  int ko_pos;                          // 着手前の劫の箇所
+  int ko_move;                         // 着手前の劫となった時の着手数
+  int pass_count;                      // 着手前のパスの回数
+  int capture_num;                     // 着手前の打ち上げた石の数
+  int strings;                         // 着手前の連番号の上限
+  unsigned long long current_hash;     // 着手前のハッシュ値
+  unsigned long long previous1_hash;   // 着手前の1手前のハッシュ値
+  unsigned long long previous2_hash;   // 着手前の2手前のハッシュ値
+  unsigned int tactical_features1;     // 着手箇所の戦術的特徴
+  unsigned int tactical_features2;     // 着手箇所の戦術的特徴
+  int string_begin;                    // この手で退避した連の先頭
+  int point_begin;                     // この手で退避した座標の先頭
+};
+
+// 着手で変化する座標の退避
+struct undo_point_t {
+  int pos;          // 座標
+  int string_id;    // 連のID
+  int string_next;  // 連を構成する次の石
+  char board;       // 石の色
+  bool candidate;   // 候補手かどうかのフラグ
 };
 
+// 着手の記録(PutStoneで記録し, UndoMoveで戻す)
+struct game_journal_t {
+  std::vector<undo_move_t> moves;    // 1手ごとの記録
+  std::vector<int> string_ids;       // 退避した連のID
+  std::vector<string_t> strings;     // 退避した連のデータ
+  std::vector<undo_point_t> points;  // 退避した座標のデータ
+};
+
+// シミュレーション時のレート
+struct rate_table_t {
+  long long point[BOARD_MAX];                          // 各座標のレート
+  long long row[PURE_BOARD_SIZE];                      // 各行のレートの合計値
+  long long sum;                                       // 全体のレートの合計値
+  unsigned int dirty;                                  // 累積和を求め直す行のビット集合
+  long long row_prefix[RATE_LANES];                    // 先頭の行からその行までのレートの合計値
+  long long point_prefix[PURE_BOARD_SIZE][RATE_LANES]; // 行の先頭からその座標までのレートの合計値
+};
 
 // 局面を表す構造体
 struct game_info_t {
@@ -120,7 +178,8 @@ struct game_info_t {
 
   pattern pat[BOARD_MAX];    // 周囲の石の配置 
 
-  string_t string[MAX_STRING];        // 連のデータ(19x19 : 573,845bytes)
+  string_t string[MAX_STRING];        // 連のデータ(19x19 : 34,560bytes)
+  int strings;                        // 使用された連番号の上限(string[0]〜string[strings - 1]のみ有効)
   int string_id[STRING_POS_MAX];    // 各座標の連のID
   int string_next[STRING_POS_MAX];  // 連を構成する石のデータ構造
 
@@ -136,9 +195,9 @@ struct game_info_t {
   int update_num[S_OB];                    // 戦術的特徴が更新された数
   int update_pos[S_OB][PURE_BOARD_MAX];    // 戦術的特徴が更新された座標 
 
-  long long rate[2][BOARD_MAX];           // シミュレーション時の各座標のレート 
-  long long sum_rate_row[2][BOARD_SIZE];  // シミュレーション時の各列のレートの合計値  
-  long long sum_rate[2];                  // シミュレーション時の全体のレートの合計値
+  rate_table_t rate[2];  // シミュレーション時のレート
+
+  game_journal_t *journal;  // 着手の記録(NULLなら記録しない, CopyGameではコピーしない)
 };
 
 
@@ -203,9 +262,195 @@ extern int move_dis[PURE_BOARD_SIZE][PURE_BOARD_SIZE];
 // 盤上の位置からデータ上の位置の対応
 extern int onboard_pos[PURE_BOARD_MAX];
 
+// データ上の位置から盤上の位置の対応(onboard_posの逆引き)
+extern int onboard_index[BOARD_MAX];
+
 // 初手の候補手
 extern int first_move_candidate[PURE_BOARD_MAX];
 
+////////////////////////////////////////
+//  盤の大きさを固定した座標計算      //
+////////////////////////////////////////
+// テンプレート引数SIZEに盤の大きさ(9, 13, 19)を与えると定数を返し,
+// SIZEが0の時は実行時に設定された盤の大きさを返す
+// 関数の先頭でboard_sizeなどを同名の局所変数として宣言しておくと,
+// POS, NORTH, SOUTHなどのマクロの座標計算が定数に畳み込まれる
+
+// 特殊化した盤の大きさの配列の大きさ(SIZEが0の時は19路)
+#define FIXED_BOARD_MAX(size) ((size) == 0 ? BOARD_MAX : ((size) + OB_SIZE * 2) * ((size) + OB_SIZE * 2))
+
+// 盤外を含む盤の辺の大きさ
+template <int SIZE>
+inline int
+FixedBoardSize( void )
+{
+  return (SIZE == 0) ? board_size : SIZE + OB_SIZE * 2;
+}
+
+// 盤外を含む盤の大きさ
+template <int SIZE>
+inline int
+FixedBoardMax( void )
+{
+  return (SIZE == 0) ? board_max : FIXED_BOARD_MAX(SIZE);
+}
+
+// 盤の大きさ
+template <int SIZE>
+inline int
+FixedPureBoardMax( void )
+{
+  return (SIZE == 0) ? pure_board_max : SIZE * SIZE;
+}
+
+// 盤の右(下)端
+template <int SIZE>
+inline int
+FixedBoardEnd( void )
+{
+  return (SIZE == 0) ? board_end : SIZE + OB_SIZE - 1;
+}
+
+// 上下左右の座標の計算
+template <int SIZE = 0>
+inline void
+GetNeighbor4( int neighbor4[4], int pos )
+{
+  const int board_size = FixedBoardSize<SIZE>();
+
+  neighbor4[0] = NORTH(pos);
+  neighbor4[1] =  WEST(pos);
+  neighbor4[2] =  EAST(pos);
+  neighbor4[3] = SOUTH(pos);
+}
+
+//////////////////////////////////////////
+//  シミュレーション時のレートの管理    //
+//////////////////////////////////////////
+// 行の累積和と行内の累積和の2段で保持する
+// レートの更新では各行と全体の合計値だけを変えて行に印をつけ,
+// 着手の選択の前に印のついた行の累積和を求め直す
+// 累積和の探索は固定長の要素の処理なので, コンパイラがSIMD命令にできる
+
+// 累積和で使う要素の数 (盤の1辺の大きさを4の倍数に切り上げた数)
+// これより後ろの要素は使わない
+template <int SIZE>
+inline int
+FixedRateLanes( void )
+{
+  return (((SIZE == 0) ? pure_board_size : SIZE) + 3) & ~3;
+}
+
+// 座標posのレートをnew_rateに変更する
+inline void
+UpdateRate( rate_table_t *rate, int pos, long long new_rate )
+{
+  const long long diff = new_rate - rate->point[pos];
+  const int y = board_y[pos] - OB_SIZE;
+
+  rate->point[pos] = new_rate;
+  rate->row[y] += diff;
+  rate->sum += diff;
+  rate->dirty |= 1u << y;
+}
+
+// point[]に設定済みのレートから各行と全体の合計値を求める
+template <int SIZE = 0>
+inline void
+BuildRate( rate_table_t *rate )
+{
+  const int board_size = FixedBoardSize<SIZE>();
+  const int pure_board_size = board_size - OB_SIZE * 2;
+  int x, y;
+
+  rate->sum = 0;
+  for (y = 0; y < pure_board_size; y++) {
+    const long long *point = &rate->point[POS(OB_SIZE, y + OB_SIZE)];
+    rate->row[y] = 0;
+    for (x = 0; x < pure_board_size; x++) {
+      rate->row[y] += point[x];
+    }
+    rate->sum += rate->row[y];
+  }
+  rate->dirty = (1u << pure_board_size) - 1;
+}
+
+// 印のついた行の累積和と, 行の累積和を求め直す
+// 盤の外にあたる要素には, 行や全体の合計値を入れておく
+template <int SIZE = 0>
+inline void
+UpdateRatePrefix( rate_table_t *rate )
+{
+  const int board_size = FixedBoardSize<SIZE>();
+  const int pure_board_size = board_size - OB_SIZE * 2;
+  const int lanes = FixedRateLanes<SIZE>();
+  unsigned int dirty = rate->dirty;
+  long long sum;
+  int x, y;
+
+  if (dirty == 0) return;
+
+  while (dirty != 0) {
+    y = __builtin_ctz(dirty);
+    dirty &= dirty - 1;
+    const long long *point = &rate->point[POS(OB_SIZE, y + OB_SIZE)];
+    long long *point_prefix = rate->point_prefix[y];
+    sum = 0;
+    for (x = 0; x < pure_board_size; x++) {
+      sum += point[x];
+      point_prefix[x] = sum;
+    }
+    for (; x < lanes; x++) {
+      point_prefix[x] = sum;
+    }
+  }
+
+  sum = 0;
+  for (y = 0; y < pure_board_size; y++) {
+    sum += rate->row[y];
+    rate->row_prefix[y] = sum;
+  }
+  for (; y < lanes; y++) {
+    rate->row_prefix[y] = sum;
+  }
+
+  rate->dirty = 0;
+}
+
+// 累積和がrand_num未満の要素の数
+// 累積和とrand_numは非負なので, 差の符号ビットを数える
+template <int SIZE = 0>
+inline int
+CountBelow( const long long *prefix, long long rand_num )
+{
+  const int lanes = FixedRateLanes<SIZE>();
+  unsigned long long count = 0;
+
+  for (int i = 0; i < lanes; i++) {
+    count += (unsigned long long)(prefix[i] - rand_num) >> 63;
+  }
+
+  return (int)count;
+}
+
+// レートの累積値がrand_num(1〜sum)に達する座標を返す
+template <int SIZE = 0>
+inline int
+SampleRate( rate_table_t *rate, long long rand_num )
+{
+  const int board_size = FixedBoardSize<SIZE>();
+  int y;
+
+  UpdateRatePrefix<SIZE>(rate);
+
+  y = CountBelow<SIZE>(rate->row_prefix, rand_num);
+  if (y > 0) {
+    rand_num -= rate->row_prefix[y - 1];
+  }
+
+  return POS(CountBelow<SIZE>(rate->point_prefix[y], rand_num) + OB_SIZE, y + OB_SIZE);
+}
+
 //////////////
 //   関数   //
 //////////////
@@ -222,6 +467,12 @@ void FreeGame( game_info_t *game );
 // 盤面情報のコピー
 void CopyGame( game_info_t *dst, const game_info_t *src );
 
+// 着手の記録の確保
+game_journal_t *AllocateJournal( void );
+
+// 着手の記録の解放
+void FreeJournal( game_journal_t *journal );
+
 // 定数の初期化
 void InitializeConst( void );
 
@@ -237,18 +488,25 @@ bool IsLegal( const game_info_t *game, int pos, int color );
 
 // 合法手かつ眼でないか判定
 // 合法手かつ眼でなければtrueを返す
+template <int SIZE = 0>
 bool IsLegalNotEye( game_info_t *game, int pos, int color );
 
 // 自殺手判定
 // 自殺手ならばtrueを返す
+template <int SIZE = 0>
 bool IsSuicide( const game_info_t *game, const string_t *string, int color, int pos );
 
 // 石を置く
 void PutStone( game_info_t *game, int pos, int color );
 
 // 石を置く(プレイアウト用)
+template <int SIZE = 0>
 void PoPutStone( game_info_t *game, int pos, int color );
 
+// 直前の着手を戻す
+// game->journalに記録されたPutStoneの着手のみ戻せる
+void UndoMove( game_info_t *game );
+
 // 隅のマガリ四目の確認
 void CheckBentFourInTheCorner( game_info_t *game );
 
@@ -258,9 +516,6 @@ int CalculateScore( game_info_t *game );
 // コミの値の設定
 void SetKomi( double new_komi );
 
-// 上下左右の座標の計算
-void GetNeighbor4( int neighbor4[4], int pos );
-
 
 struct uct_node_t;
 
@@ -273,6 +528,86 @@ int TransformMove(int p, int i);
 
 int RevTransformMove(int p, int i);
 
+////////////////////////////////////
+//  呼吸点, 隣接する敵連の走査    //
+////////////////////////////////////
+
+// 最下位の立っているビットの位置
+inline int
+LowestBit( unsigned long long bits )
+{
+#if defined (_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, bits);
+  return (int)index;
+#else
+  return __builtin_ctzll(bits);
+#endif
+}
+
+// start以降で最初に立っているビットの位置(なければ-1)
+inline int
+NextBit( const unsigned long long *bits, int words, int start )
+{
+  int w = start >> 6;
+  unsigned long long b;
+
+  if (w >= words) return -1;
+  b = bits[w] & (~0ULL << (start & 63));
+  while (b == 0) {
+    if (++w >= words) return -1;
+    b = bits[w];
+  }
+  return (w << 6) + LowestBit(b);
+}
+
+// 連の先頭の呼吸点(なければLIBERTY_END)
+inline int
+FirstLiberty( const string_t *string )
+{
+  int index = NextBit(string->lib_bits, LIB_BITS_WORDS, 0);
+  return (index < 0) ? LIBERTY_END : onboard_pos[index];
+}
+
+// 呼吸点libの次の呼吸点(なければLIBERTY_END)
+inline int
+NextLiberty( const string_t *string, int lib )
+{
+  int index = NextBit(string->lib_bits, LIB_BITS_WORDS, onboard_index[lib] + 1);
+  return (index < 0) ? LIBERTY_END : onboard_pos[index];
+}
+
+// posが連の呼吸点か
+inline bool
+IsLiberty( const string_t *string, int pos )
+{
+  int index = onboard_index[pos];
+  return ((string->lib_bits[index >> 6] >> (index & 63)) & 1) != 0;
+}
+
+// 先頭の隣接する敵連(なければNEIGHBOR_END)
+inline int
+FirstNeighbor( const string_t *string )
+{
+  int id = NextBit(string->neighbor_bits, NEIGHBOR_BITS_WORDS, 0);
+  return (id < 0) ? NEIGHBOR_END : id;
+}
+
+// 隣接する敵連idの次の敵連(なければNEIGHBOR_END)
+inline int
+NextNeighbor( const string_t *string, int id )
+{
+  int next = NextBit(string->neighbor_bits, NEIGHBOR_BITS_WORDS, id + 1);
+  return (next < 0) ? NEIGHBOR_END : next;
+}
+
+// 連番号idの連が隣接する敵連か
+inline bool
+IsNeighborString( const string_t *string, int id )
+{
+  return ((string->neighbor_bits[id >> 6] >> (id & 63)) & 1) != 0;
+}
+
 inline bool IsNeighbor( int pos0, int pos1 ) {
   int index_distance = pos0 - pos1;
   return index_distance == 1
@@ -38,6 +38,7 @@ static game_info_t *game;
 static game_info_t *game_prev;
 static game_info_t *store_game;
 static uct_node_t store_node;
+static statistic_t store_statistic[BOARD_MAX];
 static double store_winning_percentage;
 
 static unique_ptr<ofstream> stream_ptr;
@@ -233,7 +234,6 @@ GTP_boardsize( void )
       size <= PURE_BOARD_SIZE && size > 0) {
     SetBoardSize(size);
     SetParameter();
-    SetNeighbor();
     InitializeNakadeHash();
   }
 
@@ -1022,7 +1022,25 @@ void GTP_features_store(void)
   UctSearchStat(store_game, color, 100);
 
   const uct_node_t *root = &uct_node[current_root];
-  memcpy(&store_node, root, sizeof(uct_node_t));
+  const statistic_t *statistic = root->statistic;
+  // WritePlanesが使う探索回数と統計情報だけを保存する
+  // 子ノードの領域と統計情報は木の整理で移動するので, 統計情報は保存用の領域にコピーし,
+  // 子ノードは参照しない
+  store_node.move_count = root->move_count.load();
+  store_node.win = root->win.load();
+  store_node.statistic_base = root->statistic_base;
+  store_node.child_num = 0;
+  store_node.child = NULL;
+  if (statistic != NULL) {
+    for (int i = 0; i < board_max; i++) {
+      for (int j = 0; j < 3; j++) {
+	store_statistic[i].colors[j].store(statistic[i].colors[j].load(memory_order_relaxed), memory_order_relaxed);
+      }
+    }
+    store_node.statistic = store_statistic;
+  } else {
+    store_node.statistic = NULL;
+  }
   double winning_percentage = (double)root->win / root->move_count;
   if (color == S_BLACK) {
     store_winning_percentage = winning_percentage;
@@ -1183,9 +1201,7 @@ GTP_stat_po(void)
   int pass_count;
 
   // レートの初期化  
-  game_prev->sum_rate[0] = game_prev->sum_rate[1] = 0;
-  memset(game_prev->sum_rate_row, 0, sizeof(long long) * 2 * BOARD_SIZE);
-  memset(game_prev->rate, 0, sizeof(long long) * 2 * BOARD_MAX);
+  memset(game_prev->rate, 0, sizeof(game_prev->rate));
 
   pass_count = (game_prev->record[game_prev->moves - 1].pos == PASS && game_prev->moves > 1);
 
@@ -1193,13 +1209,13 @@ GTP_stat_po(void)
   auto begin_time = ray_clock::now();
   for (int i = 0; i < 1000; i++) {
     // 黒番のレートの計算
-    Rating(game_prev, S_BLACK, &game_prev->sum_rate[0], game_prev->sum_rate_row[0], game_prev->rate[0]);
+    Rating(game_prev, S_BLACK, &game_prev->rate[0]);
     // 白番のレートの計算
-    Rating(game_prev, S_WHITE, &game_prev->sum_rate[1], game_prev->sum_rate_row[1], game_prev->rate[1]);
+    Rating(game_prev, S_WHITE, &game_prev->rate[1]);
   }
   auto finish_time = GetSpendTime(begin_time) * 1000;
 
-  long long *rate = game_prev->rate[color - 1];
+  long long *rate = game_prev->rate[color - 1].point;
 
   long long max_rate = 0;
   int max_pos = PASS;
@@ -1,5 +1,5 @@
+#include <atomic>
 #include <iostream>
-#include <mutex>
 
 #include "Message.h"
 #include "Ladder.h"
@@ -12,83 +12,352 @@ using namespace std;
 #define DEAD  false
 
 
-// IsLadderCaptured関数用
-static game_info_t search_game[100];
+// シチョウ探索の最大の深さ
+const int LADDER_DEPTH_MAX = 100;
 
-static mutex mutex_ladder;
+// 1回のシチョウ探索で打つ手の上限
+// 深さの上限と同様に, 超えた場合は逃げられるとみなす
+const int LADDER_NODE_MAX = 4096;
+
+// シチョウ探索用の作業領域
+// スレッドごとに持つので, 複数のスレッドから同時にシチョウを読める
+// 盤面は1つだけ持ち, 着手と UndoMove による巻き戻しで探索する
+struct ladder_work_t {
+  game_info_t *shicho_game;        // 探索用の盤面
+  int nodes;                       // 探索中に打った手の数
+  int x_min, y_min, x_max, y_max;  // 探索中に石を置いた範囲
+
+  ladder_work_t( void ) : shicho_game(NULL), nodes(0), x_min(0), y_min(0), x_max(0), y_max(0) {}
+
+  ~ladder_work_t( void ) {
+    if (shicho_game != NULL) {
+      FreeJournal(shicho_game->journal);
+      FreeGame(shicho_game);
+    }
+  }
+};
+
+static thread_local ladder_work_t ladder_work;
+
+
+////////////////////////////
+//  シチョウの結果の置換表  //
+////////////////////////////
+// (局面のハッシュ値, 連の始点, 色)からシチョウの結果を引く
+// 各要素はキーとデータの排他的論理和とデータの2語で持ち,
+// 複数のスレッドが同時に書き込んで壊れた要素は読み出し時の照合で弾く
+// 結果には探索中に石を置いた範囲を依存する範囲として記録しておく
+
+// 置換表の要素数(2のべき乗)
+const int LADDER_CACHE_SIZE = 65536;
+
+// 1つの結果に記録できる印の数
+const int LADDER_MARK_MAX = 3;
+
+// 置換表の結果の種類
+enum LADDER_CACHE_KIND {
+  LADDER_CACHE_EXTENSION,  // LadderExtensionの連ごとの結果
+  LADDER_CACHE_CHECK,      // CheckLadderExtensionの結果
+};
+
+// シチョウの結果
+struct ladder_result_t {
+  int marks;                       // 印をつける座標の数
+  int mark[LADDER_MARK_MAX];       // 印をつける座標(逃げても取られる着手)
+  int x_min, y_min, x_max, y_max;  // 結果が依存する範囲
+};
+
+// 置換表の要素
+struct ladder_cache_entry_t {
+  atomic<unsigned long long> check;  // キーとデータの排他的論理和
+  atomic<unsigned long long> data;   // 結果を詰めたデータ
+};
+
+// データの有効フラグ
+const unsigned long long LADDER_CACHE_VALID = 1ULL << 63;
+
+static ladder_cache_entry_t ladder_cache[LADDER_CACHE_SIZE];
+
+// 置換表のキーの計算
+static unsigned long long LadderCacheKey( const game_info_t *game, int origin, int color, int kind );
+
+// 置換表から結果を引く
+static bool ProbeLadderCache( unsigned long long key, ladder_result_t *result );
+
+// 置換表に結果を書き込む
+static void StoreLadderCache( unsigned long long key, const ladder_result_t *result );
+
+// 結果の記録の開始
+static void BeginLadderResult( ladder_result_t *result, int origin );
+
+// 結果の記録の終了
+static void EndLadderResult( ladder_result_t *result );
+
+// シチョウで取られる着手箇所の記録
+static void AddLadderMark( ladder_result_t *result, int pos );
+
+// 探索中の着手
+static void PlayLadderMove( game_info_t *game, int pos, int color );
+
+
+// 探索用の盤面にgameを写す
+static game_info_t *PrepareShichoGame( const game_info_t *game );
+
+// posに打った後, ren_xyの連がシチョウで取られるか
+static bool ReadLadder( game_info_t *game, int pos, int color, int ren_xy );
+
+
+//////////////////////////////
+//  置換表のキーの計算      //
+//////////////////////////////
+static unsigned long long
+LadderCacheKey( const game_info_t *game, int origin, int color, int kind )
+{
+  unsigned long long salt;
+
+  // 劫の状態は局面のハッシュ値に含まれている
+  salt = ((unsigned long long)origin << 16) | ((unsigned long long)board_size << 8) | (color << 2) | kind;
+  salt *= 0x9E3779B97F4A7C15ULL;
+
+  return game->current_hash ^ salt ^ (salt >> 31);
+}
+
+
+//////////////////////////////
+//  置換表から結果を引く    //
+//////////////////////////////
+static bool
+ProbeLadderCache( unsigned long long key, ladder_result_t *result )
+{
+  const ladder_cache_entry_t *entry = &ladder_cache[key & (LADDER_CACHE_SIZE - 1)];
+  unsigned long long data = entry->data.load(memory_order_relaxed);
+  unsigned long long check = entry->check.load(memory_order_relaxed);
+  int i;
+
+  if ((data & LADDER_CACHE_VALID) == 0 || (check ^ data) != key) {
+    return false;
+  }
+
+  // 座標10bit x 3, 印の数2bit, 範囲5bit x 4
+  for (i = 0; i < LADDER_MARK_MAX; i++) {
+    result->mark[i] = (int)((data >> (i * 10)) & 0x3FF);
+  }
+  result->marks = (int)((data >> 30) & 0x3);
+  result->x_min = (int)((data >> 32) & 0x1F);
+  result->y_min = (int)((data >> 37) & 0x1F);
+  result->x_max = (int)((data >> 42) & 0x1F);
+  result->y_max = (int)((data >> 47) & 0x1F);
+
+  return true;
+}
+
+
+//////////////////////////////
+//  置換表に結果を書き込む  //
+//////////////////////////////
+static void
+StoreLadderCache( unsigned long long key, const ladder_result_t *result )
+{
+  ladder_cache_entry_t *entry = &ladder_cache[key & (LADDER_CACHE_SIZE - 1)];
+  unsigned long long data = LADDER_CACHE_VALID;
+  int i;
+
+  // 記録できる数を超えた時は書き込まない
+  if (result->marks > LADDER_MARK_MAX) return;
+
+  for (i = 0; i < result->marks; i++) {
+    data |= (unsigned long long)result->mark[i] << (i * 10);
+  }
+  data |= (unsigned long long)result->marks << 30;
+  data |= (unsigned long long)result->x_min << 32;
+  data |= (unsigned long long)result->y_min << 37;
+  data |= (unsigned long long)result->x_max << 42;
+  data |= (unsigned long long)result->y_max << 47;
+
+  entry->data.store(data, memory_order_relaxed);
+  entry->check.store(key ^ data, memory_order_relaxed);
+}
+
+
+//////////////////////////
+//  結果の記録の開始    //
+//////////////////////////
+static void
+BeginLadderResult( ladder_result_t *result, int origin )
+{
+  result->marks = 0;
+  ladder_work.x_min = ladder_work.x_max = X(origin);
+  ladder_work.y_min = ladder_work.y_max = Y(origin);
+}
+
+
+//////////////////////////
+//  結果の記録の終了    //
+//////////////////////////
+static void
+EndLadderResult( ladder_result_t *result )
+{
+  result->x_min = ladder_work.x_min;
+  result->y_min = ladder_work.y_min;
+  result->x_max = ladder_work.x_max;
+  result->y_max = ladder_work.y_max;
+}
+
+
+////////////////////////////////////////////
+//  シチョウで取られる着手箇所の記録      //
+////////////////////////////////////////////
+static void
+AddLadderMark( ladder_result_t *result, int pos )
+{
+  if (result->marks < LADDER_MARK_MAX) {
+    result->mark[result->marks] = pos;
+  }
+  result->marks++;
+}
+
+
+//////////////////////
+//  探索中の着手    //
+//////////////////////
+static void
+PlayLadderMove( game_info_t *game, int pos, int color )
+{
+  const int x = X(pos), y = Y(pos);
+
+  ladder_work.nodes++;
+  if (x < ladder_work.x_min) ladder_work.x_min = x;
+  if (x > ladder_work.x_max) ladder_work.x_max = x;
+  if (y < ladder_work.y_min) ladder_work.y_min = y;
+  if (y > ladder_work.y_max) ladder_work.y_max = y;
+
+  PutStone(game, pos, color);
+}
+
+
+//////////////////////////////////
+//  探索用の盤面にgameを写す    //
+//////////////////////////////////
+static game_info_t *
+PrepareShichoGame( const game_info_t *game )
+{
+  if (ladder_work.shicho_game == NULL) {
+    ladder_work.shicho_game = AllocateGame();
+    ladder_work.shicho_game->journal = AllocateJournal();
+  }
+  CopyGame(ladder_work.shicho_game, game);
+
+  return ladder_work.shicho_game;
+}
+
+
+////////////////////////////////////////////////
+//  posに打った後, 連がシチョウで取られるか  //
+////////////////////////////////////////////////
+static bool
+ReadLadder( game_info_t *game, int pos, int color, int ren_xy )
+{
+  bool result;
+
+  ladder_work.nodes = 0;
+  PlayLadderMove(game, pos, color);
+  result = IsLadderCaptured(0, game, ren_xy, FLIP_COLOR(color));
+  UndoMove(game);
+
+  return result;
+}
 
 
 void
 LadderExtension( const game_info_t *game, int color, bool *ladder_pos )
 {
-  lock_guard<mutex> lock(mutex_ladder);
   const string_t *string = game->string;
   int i, ladder = PASS;
-  static game_info_t *shicho_game = AllocateGame();
+  game_info_t *shicho_game = NULL;
   bool checked[BOARD_MAX] = { false };  
-  int neighbor;
+  int neighbor, capture;
   bool flag;
+  unsigned long long key;
+  ladder_result_t result;
 
-  for (i = 0; i < MAX_STRING; i++) {
+  for (i = 0; i < game->strings; i++) {
     if (!string[i].flag ||
 	string[i].color != color) {
       continue;
     }
     // アタリから逃げる着手箇所
-    ladder = string[i].lib[0];
+    ladder = FirstLiberty(&string[i]);
 
     flag = false;
 
     // アタリを逃げる手で未探索のものを確認
     if (!checked[ladder] && string[i].libs == 1) {
+      checked[ladder] = true;
+
+      // 1子の連は取られても印をつけないので読まない
+      if (string[i].size < 2) continue;
+
+      // 置換表に結果があればそれを使う
+      key = LadderCacheKey(game, string[i].origin, color, LADDER_CACHE_EXTENSION);
+      if (ProbeLadderCache(key, &result)) {
+	for (int j = 0; j < result.marks; j++) {
+	  ladder_pos[result.mark[j]] = true;
+	}
+	continue;
+      }
+
+      // 探索用の盤面は必要になった時に1度だけ写す
+      if (shicho_game == NULL) {
+	shicho_game = PrepareShichoGame(game);
+      }
+
+      BeginLadderResult(&result, string[i].origin);
+
       // 隣接する敵連を取って助かるかを確認
-      neighbor = string[i].neighbor[0];
+      neighbor = FirstNeighbor(&string[i]);
       while (neighbor != NEIGHBOR_END) {
 	if (string[neighbor].libs == 1) {
-	  CopyGame(shicho_game, game);
-	  PutStone(shicho_game, string[neighbor].lib[0], color);
-	  if (IsLadderCaptured(0, shicho_game, string[i].origin, FLIP_COLOR(color)) == DEAD) {
-	    if (string[i].size >= 2) { 
-	      ladder_pos[string[neighbor].lib[0]] = true;
-	    }
+	  capture = FirstLiberty(&string[neighbor]);
+	  if (ReadLadder(shicho_game, capture, color, string[i].origin) == DEAD) {
+	    ladder_pos[capture] = true;
+	    AddLadderMark(&result, capture);
 	  } else {
 	    flag = true;
 	    break;
 	  }
 	}
-	neighbor = string[i].neighbor[neighbor];
+	neighbor = NextNeighbor(&string[i], neighbor);
       }
 
       // 取って助からない時は逃げてみる
       if (!flag) {
 	if (IsLegal(game, ladder, color)) {
-	  CopyGame(shicho_game, game);
-	  PutStone(shicho_game, ladder, color);
-	  if (string[i].size >= 2 && 
-	      IsLadderCaptured(0, shicho_game, ladder, FLIP_COLOR(color)) == DEAD){
-	      ladder_pos[ladder] = true;
+	  if (ReadLadder(shicho_game, ladder, color, ladder) == DEAD){
+	    ladder_pos[ladder] = true;
+	    AddLadderMark(&result, ladder);
 	  }
 	}
       }
-      checked[ladder] = true;
+
+      EndLadderResult(&result);
+      StoreLadderCache(key, &result);
     }
   }
-  
-  //FreeGame(shicho_game);
 }
 
 
 bool
-IsLadderCaptured( int depth, const game_info_t *game, int ren_xy, int turn_color )
+IsLadderCaptured( int depth, game_info_t *game, int ren_xy, int turn_color )
 {
   const string_t *string = game->string;
   int str = game->string_id[ren_xy];
   int escape_color, capture_color;
   int escape_xy, capture_xy;
   const char *board = game->board;
-  int neighbor;
+  int neighbor, capture;
+  bool result;
 
-  if (depth >= 100) {
+  if (depth >= LADDER_DEPTH_MAX || ladder_work.nodes >= LADDER_NODE_MAX) {
     return ALIVE;
   }
 
@@ -104,46 +373,50 @@ IsLadderCaptured( int depth, const game_info_t *game, int ren_xy, int turn_color
   if (turn_color == escape_color) {
     // 周囲の敵連が取れるか確認し,
     // 取れるなら取って探索を続ける
-    neighbor = string[str].neighbor[0];
+    neighbor = FirstNeighbor(&string[str]);
     while (neighbor != NEIGHBOR_END) {
       if (string[neighbor].libs == 1) {
-	if (IsLegal(game, string[neighbor].lib[0], escape_color)) {
-	  CopyGame(&search_game[depth], game);
-	  PutStone(&search_game[depth], string[neighbor].lib[0], escape_color);
-	  if (IsLadderCaptured(depth + 1, &search_game[depth], ren_xy, FLIP_COLOR(turn_color)) == ALIVE) {
+	capture = FirstLiberty(&string[neighbor]);
+	if (IsLegal(game, capture, escape_color)) {
+	  PlayLadderMove(game, capture, escape_color);
+	  result = IsLadderCaptured(depth + 1, game, ren_xy, FLIP_COLOR(turn_color));
+	  UndoMove(game);
+	  if (result == ALIVE) {
 	    return ALIVE;
 	  }
 	}
       }
-      neighbor = string[str].neighbor[neighbor];
+      neighbor = NextNeighbor(&string[str], neighbor);
     }
 
     // 逃げる手を打ってみて探索を続ける
-    escape_xy = string[str].lib[0];
+    escape_xy = FirstLiberty(&string[str]);
     while (escape_xy != LIBERTY_END) {
       if (IsLegal(game, escape_xy, escape_color)) {
-	CopyGame(&search_game[depth], game);
-	PutStone(&search_game[depth], escape_xy, escape_color);
-	if (IsLadderCaptured(depth + 1, &search_game[depth], ren_xy, FLIP_COLOR(turn_color)) == ALIVE) {
+	PlayLadderMove(game, escape_xy, escape_color);
+	result = IsLadderCaptured(depth + 1, game, ren_xy, FLIP_COLOR(turn_color));
+	UndoMove(game);
+	if (result == ALIVE) {
 	  return ALIVE;
 	}
       }
-      escape_xy = string[str].lib[escape_xy];
+      escape_xy = NextLiberty(&string[str], escape_xy);
     }
     return DEAD;
   } else {
     if (string[str].libs == 1) return DEAD;
     // 追いかける側なのでアタリにする手を打ってみる
-    capture_xy = string[str].lib[0];
+    capture_xy = FirstLiberty(&string[str]);
     while (capture_xy != LIBERTY_END) {
       if (IsLegal(game, capture_xy, capture_color)) {
-	CopyGame(&search_game[depth], game);
-	PutStone(&search_game[depth], capture_xy, capture_color);
-	if (IsLadderCaptured(depth + 1, &search_game[depth], ren_xy, FLIP_COLOR(turn_color)) == DEAD) {
+	PlayLadderMove(game, capture_xy, capture_color);
+	result = IsLadderCaptured(depth + 1, game, ren_xy, FLIP_COLOR(turn_color));
+	UndoMove(game);
+	if (result == DEAD) {
 	  return DEAD;
 	}
       }
-      capture_xy = string[str].lib[capture_xy];
+      capture_xy = NextLiberty(&string[str], capture_xy);
     }
   }
 
@@ -157,35 +430,40 @@ IsLadderCaptured( int depth, const game_info_t *game, int ren_xy, int turn_color
 bool
 CheckLadderExtension( const game_info_t *game, int color, int pos )
 {
-  lock_guard<mutex> lock(mutex_ladder);
   const char *board = game->board;
   const string_t *string = game->string;
   const int *string_id = game->string_id;
   int ladder = PASS;
-  game_info_t *shicho_game = AllocateGame();
   bool flag = false;
   int id;
+  unsigned long long key;
+  ladder_result_t result;
 
   if (board[pos] != color){
-    FreeGame(shicho_game);
     return false;
   }
 
   id = string_id[pos];
 
-  ladder = string[id].lib[0];
+  ladder = FirstLiberty(&string[id]);
 
   if (string[id].libs == 1 && IsLegal(game, ladder, color)){
-    CopyGame(shicho_game, game);
-    PutStone(shicho_game, ladder, color);
-    if (IsLadderCaptured(0, shicho_game, ladder, FLIP_COLOR(color)) == DEAD) {
+    // 置換表に結果があればそれを使う
+    key = LadderCacheKey(game, string[id].origin, color, LADDER_CACHE_CHECK);
+    if (ProbeLadderCache(key, &result)) {
+      return result.marks > 0;
+    }
+
+    BeginLadderResult(&result, string[id].origin);
+    if (ReadLadder(PrepareShichoGame(game), ladder, color, ladder) == DEAD) {
       flag = true;
+      AddLadderMark(&result, ladder);
     } else {
       flag = false;
     }
+    EndLadderResult(&result);
+    StoreLadderCache(key, &result);
   }
 
-  FreeGame(shicho_game);
-
   return flag;
 }
@@ -7,7 +7,9 @@
 void LadderExtension( const game_info_t *game, int color, bool *ladder_pos );
 
 // シチョウ探索
-bool IsLadderCaptured( int depth, const game_info_t *game, int ren_xy, int turn_color );
+// gameに着手して探索し, 戻ってくる時には元の局面に巻き戻している
+// (gameにはUndoMoveのための着手の記録が必要)
+bool IsLadderCaptured( int depth, game_info_t *game, int ren_xy, int turn_color );
 
 // 戦術的特徴用の関数
 bool CheckLadderExtension( const game_info_t *game, int color, int pos );
@@ -97,7 +97,7 @@ PrintRate( const game_info_t *game )
       cerr << setw(2) << (pure_board_size + 1 - i) << ":|";
       for (x = board_start; x <= board_end; x++) {
 	pos = POS(x, y);
-	cerr << " " << setw(9) << min(game->rate[c][pos], 999999999LL);
+	cerr << " " << setw(9) << min(game->rate[c].point[pos], 999999999LL);
       }
       cerr << " |" << endl;
     }
@@ -134,13 +134,13 @@ PrintString( const game_info_t *game )
 	cerr << "White String   ";
       }
       cerr << "ID : " << i << " (libs : " << string[i].libs << ", size : " << string[i].size << ")" << endl;
-      pos = string[i].lib[0];
+      pos = FirstLiberty(&string[i]);
 
       cerr << "  Liberty : " << endl;
       cerr << "  ";
       while (pos != STRING_END) {
 	cerr << GOGUI_X(pos) << GOGUI_Y(pos) << " ";
-	pos = string[i].lib[pos];
+	pos = NextLiberty(&string[i], pos);
       }
       cerr << endl;
 
@@ -154,13 +154,13 @@ PrintString( const game_info_t *game )
       }
       cerr << endl;
 
-      neighbor = string[i].neighbor[0];
+      neighbor = FirstNeighbor(&string[i]);
       if (neighbor == 0) getchar();
       cerr << "  Neighbor : " << endl;
       cerr << "    ";
       while (neighbor < NEIGHBOR_END) {
 	cerr << neighbor << " ";
-	neighbor = string[i].neighbor[neighbor];
+	neighbor = NextNeighbor(&string[i], neighbor);
       }
       cerr << endl;
     }
@@ -250,12 +250,13 @@ PrintOwner( const uct_node_t *root, int color, double *own )
   double owner;
   int player = 0, opponent = 0;
   double score;
-  auto statistic = root->statistic;
+  const statistic_t *statistic = root->statistic;
+  int count = GetStatisticCount(root);
 
   for (i = 1, y = board_start; y <= board_end; y++, i++) {
     for (x = board_start; x <= board_end; x++) {
       pos = POS(x, y);
-      owner = (double)statistic[pos].colors[color] / root->move_count;
+      owner = (statistic == NULL || count <= 0) ? 0.5 : (double)statistic[pos].colors[color] / count;
       if (owner > 0.5) {
 	player++;
       } else {
@@ -485,6 +486,38 @@ PrintPlayoutInformation( const uct_node_t *root, const po_info_t *po_info, doubl
 }
 
 
+//////////////////////////////////////////
+//  ノードのロックの競合の統計の出力    //
+//////////////////////////////////////////
+void
+PrintNodeLockStatistic( const node_lock_stat_t *stat )
+{
+  if (!debug_message) return ;
+
+  cerr << "Node Lock Contended:  " << setw(7) << stat->contended << endl;
+  cerr << "Node Lock Spin     :  " << setw(7) << stat->spin << endl;
+  cerr << "Node Lock Yield    :  " << setw(7) << stat->yield << endl;
+}
+
+
+//////////////////////////////////////////////////
+//  NNの評価結果のキャッシュの参照の統計の出力  //
+//////////////////////////////////////////////////
+void
+PrintNNCacheStatistic( const nn_cache_stat_t *stat )
+{
+  if (!debug_message) return ;
+
+  const long long policy_lookup = stat->policy_lookup, policy_hit = stat->policy_hit;
+  const long long value_lookup = stat->value_lookup, value_hit = stat->value_hit;
+
+  cerr << "NN Cache Policy    :  " << setw(7) << policy_hit << "/" << policy_lookup
+       << " (" << (policy_lookup > 0 ? 100.0 * policy_hit / policy_lookup : 0.0) << "%)" << endl;
+  cerr << "NN Cache Value     :  " << setw(7) << value_hit << "/" << value_lookup
+       << " (" << (value_lookup > 0 ? 100.0 * value_hit / value_lookup : 0.0) << "%)" << endl;
+}
+
+
 //////////////////
 //  座標の出力  //
 //////////////////
@@ -563,3 +596,15 @@ PrintReuseCount( int count )
 
   cerr << "Reuse : " << count << " Playouts" << endl;
 }
+
+
+////////////////////////////////////////
+//  木の整理で残したノード数の出力    //
+////////////////////////////////////////
+void
+PrintCollectedNodes( unsigned int before, unsigned int after )
+{
+  if (!debug_message) return ;
+
+  cerr << "Collect Tree : " << before << " -> " << after << " Nodes" << endl;
+}
@@ -3,6 +3,7 @@
 
 #include <string>
 #include "GoBoard.h"
+#include "NNCache.h"
 #include "UctSearch.h"
 
 
@@ -40,6 +41,12 @@ void PrintBestSequence( const game_info_t *game, const uct_node_t *uct_node, int
 //  探索の情報の表示
 void PrintPlayoutInformation( const uct_node_t *root, const po_info_t *po_info, double finish_time, int pre_simulated );
 
+//  ノードのロックの競合の統計の表示
+void PrintNodeLockStatistic( const node_lock_stat_t *stat );
+
+//  NNの評価結果のキャッシュの参照の統計の表示
+void PrintNNCacheStatistic( const nn_cache_stat_t *stat );
+
 //  座標の出力
 void PrintPoint( int pos );
 std::string FormatMove( int pos );
@@ -56,4 +63,7 @@ void PrintPlayoutLimits( double time_limit, int playout_limit );
 //  再利用した探索回数の出力
 void PrintReuseCount( int count );
 
+//  木の整理で残したノード数の出力
+void PrintCollectedNodes( unsigned int before, unsigned int after );
+
 #endif
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "NNCache.h"
+
+using namespace std;
+
+
+////////////////////////////////////////////
+//  NNの評価結果のキャッシュ              //
+//  局面のキーから分割と要素を直接決め,   //
+//  別の局面とぶつかったら上書きする      //
+////////////////////////////////////////////
+class nn_cache_t {
+public:
+  // entries個の要素をNN_CACHE_SHARDS個に分けて確保する (要素ごとにwidth個のfloat)
+  void Initialize( size_t entries, int width );
+
+  bool Lookup( unsigned long long key, float *data );
+
+  void Store( unsigned long long key, const float *data );
+
+private:
+  // キャッシュの1分割
+  struct shard_t {
+    std::mutex mutex;                      // 分割のロック
+    std::vector<unsigned long long> key;   // 要素の局面のキー
+    std::vector<char> used;                // 要素を使っているか
+    std::vector<float> data;               // 要素の値 (width個ずつ)
+  };
+
+  std::unique_ptr<shard_t[]> shard;
+  size_t slots = 0;  // 分割あたりの要素数 (2のべき乗)
+  int width = 0;
+};
+
+
+// キャッシュする局面数
+static int nn_cache_size = NN_CACHE_SIZE;
+
+// 方策のキャッシュ
+static nn_cache_t policy_cache;
+
+// 価値のキャッシュ
+static nn_cache_t value_cache;
+
+// キャッシュの参照の統計
+nn_cache_stat_t nn_cache_stat;
+
+
+void
+nn_cache_t::Initialize( size_t entries, int width )
+{
+  size_t n = 1;
+
+  while (n * NN_CACHE_SHARDS < entries) n <<= 1;
+
+  shard.reset();
+  slots = 0;
+  this->width = width;
+  if (entries == 0) return;
+
+  shard.reset(new shard_t[NN_CACHE_SHARDS]);
+  slots = n;
+  for (int i = 0; i < NN_CACHE_SHARDS; i++) {
+    shard[i].key.assign(slots, 0);
+    shard[i].used.assign(slots, 0);
+    shard[i].data.assign(slots * width, 0.0f);
+  }
+}
+
+
+bool
+nn_cache_t::Lookup( unsigned long long key, float *data )
+{
+  if (slots == 0) return false;
+
+  shard_t &s = shard[key & (NN_CACHE_SHARDS - 1)];
+  const size_t slot = (size_t)(key >> 32) & (slots - 1);
+  lock_guard<mutex> lock(s.mutex);
+
+  if (!s.used[slot] || s.key[slot] != key) return false;
+
+  copy_n(&s.data[slot * width], width, data);
+
+  return true;
+}
+
+
+void
+nn_cache_t::Store( unsigned long long key, const float *data )
+{
+  if (slots == 0) return;
+
+  shard_t &s = shard[key & (NN_CACHE_SHARDS - 1)];
+  const size_t slot = (size_t)(key >> 32) & (slots - 1);
+  lock_guard<mutex> lock(s.mutex);
+
+  s.key[slot] = key;
+  s.used[slot] = 1;
+  copy_n(data, width, &s.data[slot * width]);
+}
+
+
+//////////////////////////////////////
+//  キャッシュする局面数の設定      //
+//////////////////////////////////////
+void
+SetNNCacheSize( int size )
+{
+  nn_cache_size = max(size, 0);
+}
+
+
+////////////////////////
+//  キャッシュの確保  //
+////////////////////////
+void
+InitializeNNCache( void )
+{
+  // 方策は盤の大きさを変えても並びが変わらないように最大の交点数分を持つ
+  policy_cache.Initialize((size_t)nn_cache_size, PURE_BOARD_MAX);
+  value_cache.Initialize((size_t)nn_cache_size * NN_CACHE_VALUE_RATIO, 1);
+
+  ClearNNCacheStatistic();
+}
+
+
+//////////////////////
+//  局面のキー      //
+//////////////////////
+unsigned long long
+GetNNCacheKey( const game_info_t *game, int color )
+{
+  unsigned long long salt;
+
+  // 盤面のハッシュ値に含まれない情報を1語にまとめ, splitmix64の最後の処理で混ぜる
+  salt = ((unsigned long long)pure_board_size << 56) ^
+    ((unsigned long long)game->moves << 24) ^
+    ((unsigned long long)game->ko_pos << 2) ^
+    (unsigned long long)color;
+  salt = (salt ^ (salt >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  salt = (salt ^ (salt >> 27)) * 0x94D049BB133111EBULL;
+  salt ^= salt >> 31;
+
+  return game->current_hash ^ salt;
+}
+
+
+////////////////////
+//  方策の参照    //
+////////////////////
+bool
+LookupNNPolicy( unsigned long long key, float *policy )
+{
+  float data[PURE_BOARD_MAX];
+
+  nn_cache_stat.policy_lookup.fetch_add(1, memory_order_relaxed);
+  if (!policy_cache.Lookup(key, data)) return false;
+  nn_cache_stat.policy_hit.fetch_add(1, memory_order_relaxed);
+
+  copy_n(data, pure_board_max, policy);
+
+  return true;
+}
+
+
+////////////////////
+//  方策の登録    //
+////////////////////
+void
+StoreNNPolicy( unsigned long long key, const float *policy )
+{
+  float data[PURE_BOARD_MAX] = { 0.0f };
+
+  copy_n(policy, pure_board_max, data);
+  policy_cache.Store(key, data);
+}
+
+
+////////////////////
+//  価値の参照    //
+////////////////////
+bool
+LookupNNValue( unsigned long long key, float *value )
+{
+  nn_cache_stat.value_lookup.fetch_add(1, memory_order_relaxed);
+  if (!value_cache.Lookup(key, value)) return false;
+  nn_cache_stat.value_hit.fetch_add(1, memory_order_relaxed);
+
+  return true;
+}
+
+
+////////////////////
+//  価値の登録    //
+////////////////////
+void
+StoreNNValue( unsigned long long key, float value )
+{
+  value_cache.Store(key, &value);
+}
+
+
+////////////////////////////////
+//  参照の統計のクリア        //
+////////////////////////////////
+void
+ClearNNCacheStatistic( void )
+{
+  nn_cache_stat.policy_lookup = 0;
+  nn_cache_stat.policy_hit = 0;
+  nn_cache_stat.value_lookup = 0;
+  nn_cache_stat.value_hit = 0;
+}
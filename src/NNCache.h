@@ -0,0 +1,74 @@
+#ifndef _NN_CACHE_H_
+#define _NN_CACHE_H_
+
+#include <atomic>
+
+#include "GoBoard.h"
+
+////////////////
+//    定数    //
+////////////////
+
+// 方策をキャッシュする局面数の既定値 (1局面あたり盤の交点数分のfloat)
+const int NN_CACHE_SIZE = 32768;
+
+// 価値をキャッシュする局面数 (方策の局面数の何倍か)
+const int NN_CACHE_VALUE_RATIO = 8;
+
+// キャッシュの分割数 (分割ごとにロックを持つ, 2のべき乗)
+const int NN_CACHE_SHARDS = 64;
+
+
+//////////////////
+//  構造体宣言  //
+//////////////////
+
+// キャッシュの参照の統計
+struct nn_cache_stat_t {
+  std::atomic<long long> policy_lookup;  // 方策を引いた回数
+  std::atomic<long long> policy_hit;     // 方策が見つかった回数
+  std::atomic<long long> value_lookup;   // 価値を引いた回数
+  std::atomic<long long> value_hit;      // 価値が見つかった回数
+};
+
+
+////////////////
+//    変数    //
+////////////////
+
+// キャッシュの参照の統計
+extern nn_cache_stat_t nn_cache_stat;
+
+
+//////////////
+//   関数   //
+//////////////
+
+// キャッシュする局面数の設定 (0ならキャッシュしない)
+void SetNNCacheSize( int size );
+
+// キャッシュの確保
+// 探索スレッドと評価スレッドが止まっているときに呼び出す
+void InitializeNNCache( void );
+
+// 局面のキー
+// 盤面のハッシュ値(劫とパスを含む)に手番, 劫の位置, 手数, 盤の大きさを混ぜる
+unsigned long long GetNNCacheKey( const game_info_t *game, int color );
+
+// 方策の参照
+// 見つかればpolicyに盤上の位置の順(onboard_posの順)でpure_board_max個書き込む
+bool LookupNNPolicy( unsigned long long key, float *policy );
+
+// 方策の登録 (policyは盤の向きを戻したsoftmax後の値)
+void StoreNNPolicy( unsigned long long key, const float *policy );
+
+// 価値の参照
+bool LookupNNValue( unsigned long long key, float *value );
+
+// 価値の登録 (valueは推論の実装が返した-1から1の値)
+void StoreNNValue( unsigned long long key, float value );
+
+// 参照の統計のクリア
+void ClearNNCacheStatistic( void );
+
+#endif
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <cstring>
+
+#include "NeuralNet.h"
+
+using namespace std;
+
+
+////////////////////////////////////////////////////
+//  決まった値を返すだけの実装                    //
+//  学習済みの重みがない環境でのビルドや,         //
+//  探索と評価待ちの処理の計測に使う              //
+////////////////////////////////////////////////////
+class stub_evaluator_t : public nn_evaluator_t {
+public:
+  bool Load( const nn_config_t & ) override {
+    return true;
+  }
+
+  // 全ての交点を同じ評価値にする
+  bool EvaluatePolicy( const float *, int batch, int, int board_size, float *policy ) override {
+    fill_n(policy, batch * board_size * board_size, 0.0f);
+    return true;
+  }
+
+  // 全ての局面を互角とする
+  bool EvaluateValue( const float *, int batch, int, int, float *value ) override {
+    fill_n(value, batch, 0.0f);
+    return true;
+  }
+};
+
+
+////////////////////////////////
+//  名前から推論の実装を引く  //
+////////////////////////////////
+NN_BACKEND
+GetNNBackend( const char *name )
+{
+  for (int i = 0; i < NN_BACKEND_MAX; i++) {
+    if (!strcmp(name, nn_backend_name[i].c_str())) {
+      return (NN_BACKEND)i;
+    }
+  }
+  return NN_BACKEND_MAX;
+}
+
+
+////////////////////////////////////////
+//  推論の実装がこのビルドで使えるか  //
+////////////////////////////////////////
+bool
+IsNNBackendAvailable( NN_BACKEND backend )
+{
+  switch (backend) {
+    case NN_BACKEND_CNTK:
+#if defined(USE_CNTK)
+      return true;
+#else
+      return false;
+#endif
+    case NN_BACKEND_CPU:
+    case NN_BACKEND_STUB:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+////////////////////////////
+//  推論の実装を生成する  //
+////////////////////////////
+nn_evaluator_t *
+CreateNNEvaluator( NN_BACKEND backend )
+{
+  if (!IsNNBackendAvailable(backend)) {
+    return nullptr;
+  }
+
+  switch (backend) {
+#if defined(USE_CNTK)
+    case NN_BACKEND_CNTK:
+      return CreateCntkEvaluator();
+#endif
+    case NN_BACKEND_CPU:
+      return CreateCpuEvaluator();
+    case NN_BACKEND_STUB:
+      return new stub_evaluator_t();
+    default:
+      return nullptr;
+  }
+}
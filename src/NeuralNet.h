@@ -0,0 +1,91 @@
+#ifndef _NEURAL_NET_H_
+#define _NEURAL_NET_H_
+
+#include <string>
+
+////////////////
+//    定数    //
+////////////////
+
+// ニューラルネットワークの推論の実装
+enum NN_BACKEND {
+  NN_BACKEND_CNTK,   // CNTKのEvalライブラリ
+  NN_BACKEND_CPU,    // CPUでの推論(NeuralNetCpu.cpp)
+  NN_BACKEND_STUB,   // 決まった値を返すだけの実装(ビルドや計測用)
+  NN_BACKEND_MAX,
+};
+
+// 推論の実装の名前
+const std::string nn_backend_name[NN_BACKEND_MAX] = {
+  "cntk",
+  "cpu",
+  "stub",
+};
+
+// 指定がないときの推論の実装
+#if defined(USE_CNTK)
+const NN_BACKEND NN_BACKEND_DEFAULT = NN_BACKEND_CNTK;
+#else
+const NN_BACKEND NN_BACKEND_DEFAULT = NN_BACKEND_CPU;
+#endif
+
+
+//////////////////
+//  構造体宣言  //
+//////////////////
+
+// 推論の実装に渡す設定
+struct nn_config_t {
+  std::string params_path;  // 重みファイルを置いたディレクトリ
+  bool use_gpu;             // GPUを使うか
+  int threads;              // CPUでの推論に使うスレッド数
+  bool int8;                // CPUでの推論をINT8で行うか
+};
+
+// 方策と価値を求める推論の実装
+// 入力は局面ごとに (チャネル, 盤の縦, 盤の横) の順に並べたfloatの連続領域で,
+// batch局面分をつなげて渡す
+class nn_evaluator_t {
+public:
+  virtual ~nn_evaluator_t() {}
+
+  // 重みを読み込む
+  virtual bool Load( const nn_config_t &config ) = 0;
+
+  // 着手の評価値(softmax前)を盤の交点の順にbatch * board_size * board_size個書き込む
+  virtual bool EvaluatePolicy( const float *input, int batch, int channels, int board_size, float *policy ) = 0;
+
+  // 手番側から見た局面の評価値(-1から1)をbatch個書き込む
+  virtual bool EvaluateValue( const float *input, int batch, int channels, int board_size, float *value ) = 0;
+};
+
+
+//////////////
+//   関数   //
+//////////////
+
+// 名前から推論の実装を引く(なければNN_BACKEND_MAX)
+NN_BACKEND GetNNBackend( const char *name );
+
+// 推論の実装がこのビルドで使えるか
+bool IsNNBackendAvailable( NN_BACKEND backend );
+
+// 推論の実装を生成する(使えなければnullptr)
+nn_evaluator_t *CreateNNEvaluator( NN_BACKEND backend );
+
+// CNTKの実装の生成(NeuralNetCntk.cpp)
+nn_evaluator_t *CreateCntkEvaluator( void );
+
+// CPUでの推論の実装の生成(NeuralNetCpu.cpp)
+nn_evaluator_t *CreateCpuEvaluator( void );
+
+// CPUでの推論のINT8化の較正
+// data_fileの局面から各層の入力の刻みを求めて保存し, FP32との一致度を表示する
+bool CalibrateCpuEvaluator( const nn_config_t &config, const char *data_file );
+
+// CPUでの推論の重みファイル(model.txt)を, BNのたたみ込みと重みの並べ替えを済ませた
+// 変換済みの重みファイル(model.nnw)に書き出す
+// 変換済みの重みファイルは推論の実装がそのままメモリに割り当てて使う
+bool ConvertCpuModel( const nn_config_t &config );
+
+#endif
@@ -0,0 +1,115 @@
+#if defined(USE_CNTK)
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Eval.h"
+
+#include "NeuralNet.h"
+
+using namespace std;
+
+typedef std::pair<std::wstring, std::vector<float>*> MapEntry;
+typedef std::map<std::wstring, std::vector<float>*> Layer;
+
+
+////////////////////////////////////
+//  CNTKのEvalライブラリでの推論  //
+////////////////////////////////////
+class cntk_evaluator_t : public nn_evaluator_t {
+public:
+  bool Load( const nn_config_t &config ) override;
+  bool EvaluatePolicy( const float *input, int batch, int channels, int board_size, float *policy ) override;
+  bool EvaluateValue( const float *input, int batch, int channels, int board_size, float *value ) override;
+
+private:
+  // 出力層nameの値をsize個outputに書き出す
+  bool Evaluate( const float *input, int input_size, const wchar_t *name, int size, float *output );
+
+  Microsoft::MSR::CNTK::IEvaluateModel<float> *model = nullptr;
+  std::vector<float> input_data;
+};
+
+
+//////////////////////
+//  重みの読み込み  //
+//////////////////////
+bool
+cntk_evaluator_t::Load( const nn_config_t &config )
+{
+  cerr << "Init CNTK" << endl;
+  GetEvalF(&model);
+  if (!model) {
+    cerr << "Get EvalModel failed\n";
+    return false;
+  }
+
+  // Load model with desired outputs
+  std::string networkConfiguration;
+  // with the ones specified.
+  //networkConfiguration += "outputNodeNames=\"h1.z:ol.z\"\n";
+  if (!config.use_gpu)
+    networkConfiguration += "deviceId=-1\n";
+  networkConfiguration += "modelPath=\"";
+  networkConfiguration += config.params_path;
+  networkConfiguration += "/model.bin\"";
+  model->CreateNetwork(networkConfiguration);
+
+  cerr << "ok" << endl;
+
+  return true;
+}
+
+
+//////////////
+//  推論    //
+//////////////
+bool
+cntk_evaluator_t::Evaluate( const float *input, int input_size, const wchar_t *name, int size, float *output )
+{
+  input_data.assign(input, input + input_size);
+
+  Layer inputLayer;
+  inputLayer.insert(MapEntry(L"features", &input_data));
+  Layer outputLayer;
+  std::vector<float> output_data;
+  output_data.reserve(size);
+  outputLayer.insert(MapEntry(name, &output_data));
+
+  model->Evaluate(inputLayer, outputLayer);
+
+  if ((int)output_data.size() != size) {
+    cerr << "Eval error " << output_data.size() << endl;
+    return false;
+  }
+  std::copy(output_data.begin(), output_data.end(), output);
+
+  return true;
+}
+
+bool
+cntk_evaluator_t::EvaluatePolicy( const float *input, int batch, int channels, int board_size, float *policy )
+{
+  const int board = board_size * board_size;
+
+  return Evaluate(input, batch * channels * board, L"ol", batch * board, policy);
+}
+
+bool
+cntk_evaluator_t::EvaluateValue( const float *input, int batch, int channels, int board_size, float *value )
+{
+  const int board = board_size * board_size;
+
+  return Evaluate(input, batch * channels * board, L"p", batch, value);
+}
+
+
+nn_evaluator_t *
+CreateCntkEvaluator( void )
+{
+  return new cntk_evaluator_t();
+}
+
+#endif
@@ -0,0 +1,1657 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "NeuralNet.h"
+#include "ParamBundle.h"
+
+// NN_NO_AVX2を定義すると, 常に移植性のある実装で計算する
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(NN_NO_AVX2)
+#define NN_USE_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define NN_TARGET_AVX2
+#define NN_TARGET_VNNI
+#else
+#define NN_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define NN_TARGET_VNNI __attribute__((target("avx2,fma,avx512f,avx512vl,avx512vnni")))
+#endif
+#endif
+
+using namespace std;
+
+
+////////////////
+//    定数    //
+////////////////
+
+// 重みファイルの名前
+const char NN_CPU_MODEL_FILE[] = "model.txt";
+
+// 重みファイルの形式の版
+const int NN_CPU_MODEL_VERSION = 1;
+
+// 変換済みの重みファイルの名前
+const char NN_CPU_BINARY_FILE[] = "model.nnw";
+
+// 変換済みの重みファイルの形式の版 (並べ方や構造体の配置を変えたら上げる)
+const unsigned int NN_CPU_BINARY_VERSION = 2;
+
+// 変換済みの重みファイルの識別子
+const char NN_CPU_BINARY_MAGIC[8] = { 'R', 'A', 'Y', 'N', 'N', 'C', 'P', 'U' };
+
+// バイト順の確認用の値
+const unsigned int NN_CPU_BINARY_BYTE_ORDER = 0x01020304;
+
+// 行列積で一度に計算する出力チャネル数
+const int GEMM_MR = 4;
+
+// 行列積で一度に計算する交点数 (盤の交点数はこの倍数に切り上げる)
+const int GEMM_NR = 24;
+
+// 行列積の内積方向の分割幅 (L1に載る大きさ)
+const int GEMM_KC = 256;
+
+// INT8化した入力のスケールのファイルの名前
+const char NN_CPU_INT8_FILE[] = "model_int8.txt";
+
+// INT8化した入力のスケールのファイルの形式の版
+const int NN_CPU_INT8_VERSION = 1;
+
+// 量子化した入力の最大値
+// AVX2のvpmaddubswは2つの積の和を16bitで飽和させるので, 入力を7bitに収める
+const int INT8_INPUT_MAX = 127;
+
+// 量子化した重みの最大値
+const int INT8_WEIGHT_MAX = 127;
+
+// 較正に使う局面の最大数
+const int NN_CALIBRATION_POSITIONS = 1024;
+
+// 較正に使わずに精度の確認に回す局面の割合 (この数に1つ)
+const int NN_CALIBRATION_CHECK_RATE = 5;
+
+
+//////////////////
+//  構造体宣言  //
+//////////////////
+
+// 畳み込み層 (Batch Normalizationは読み込み時にたたみ込む)
+struct nn_conv_t {
+  int id;                     // 畳み込み層の通し番号
+  int kernel;                 // カーネルの大きさ
+  int in_channels;            // 入力チャネル数
+  int out_channels;           // 出力チャネル数
+  bool relu;                  // ReLUをかけるか
+  bool point_bias;            // バイアスが交点ごとか
+  const float *weight;        // GEMM_MRチャネルずつ並べ替えた重み
+  const float *bias;          // チャネルごと, または交点ごとのバイアス
+  size_t weight_size;         // 重みの要素数
+  size_t bias_size;           // バイアスの要素数
+  std::vector<float> weight_data;  // テキストから読み込んだ重みの置き場所
+  std::vector<float> bias_data;    // テキストから読み込んだバイアスの置き場所
+  bool int8_input;            // INT8化: 入力が負にならず量子化できるか (できなければFP32で計算する)
+  float input_scale;          // INT8化: 入力の量子化の刻み
+  std::vector<int8_t> weight_q;  // INT8化: 量子化した重み (内積方向は4つずつ)
+  std::vector<float> dequant;    // INT8化: 出力チャネルごとの積の刻み
+};
+
+// 層の並び
+// 残差ブロックは2つの畳み込みの後に入力を足してReLUをかける
+struct nn_layer_t {
+  bool residual;              // 残差ブロックか
+  nn_conv_t conv[2];          // 畳み込み (残差ブロック以外はconv[0]のみ)
+};
+
+// 変換済みの重みファイルのヘッダ
+// 後ろに畳み込み層の表と, PARAM_SECTION_ALIGNに揃えた重みとバイアスが続く
+struct nn_binary_header_t {
+  char magic[8];                // "RAYNNCPU"
+  unsigned int version;         // 形式の版
+  unsigned int byte_order;      // バイト順の確認用の値
+  unsigned int gemm_mr;         // 重みを並べ替えた時のGEMM_MR
+  unsigned int gemm_nr;         // 交点ごとのバイアスを並べた時のGEMM_NR
+  int board;                    // 盤の大きさ
+  int input_channels;           // 入力チャネル数
+  int layers[3];                // 共通部分, 方策, 価値の層の数
+  unsigned int convs;           // 畳み込み層の数
+  float value_scale;            // 価値の出力の倍率
+  float value_offset;           // 価値の出力のオフセット
+  unsigned long long file_size; // ファイル全体の大きさ
+  unsigned long long checksum;  // ヘッダ以降のチェックサム (--verify-params の時に確認する)
+  unsigned long long table_checksum; // 畳み込み層の表のチェックサム (読み込む度に確認する)
+};
+
+// 変換済みの重みファイルの畳み込み層の表の要素 (通し番号順)
+struct nn_binary_conv_t {
+  int tower;                    // 共通部分(0), 方策(1), 価値(2)
+  int residual;                 // 残差ブロックの何番目の畳み込みか (残差ブロックでなければ0)
+  int kernel;                   // カーネルの大きさ
+  int in_channels;              // 入力チャネル数
+  int out_channels;             // 出力チャネル数
+  int relu;                     // ReLUをかけるか
+  int point_bias;               // バイアスが交点ごとか
+  int reserved;                 // 予約
+  unsigned long long weight_offset;  // 重みのファイル先頭からの位置
+  unsigned long long weight_size;    // 重みの要素数
+  unsigned long long bias_offset;    // バイアスのファイル先頭からの位置
+  unsigned long long bias_size;      // バイアスの要素数
+};
+
+// 推論に使う作業領域 (スレッドごと)
+struct nn_scratch_t {
+  std::vector<float> col;     // 畳み込みの入力を展開した行列
+  std::vector<uint8_t> col_q; // 量子化して展開した行列
+  std::vector<float> act[3];  // 各層の出力
+  std::vector<float> input_max;  // 較正中の各層の入力の最大値
+};
+
+// 行列積の後処理
+struct gemm_epilogue_t {
+  const float *bias;          // バイアス
+  bool point_bias;            // バイアスが交点ごとか
+  const float *residual;      // 足し込む残差 (なければNULL)
+  bool relu;                  // ReLUをかけるか
+};
+
+// 出力チャネルGEMM_MR本 x 交点GEMM_NR個を計算する関数
+typedef void (*gemm_kernel_t)( const float *a, const float *b, float *c, int k, int ldb, int ldc, bool first, const gemm_epilogue_t *ep );
+
+// INT8化した出力チャネルGEMM_MR本 x 交点GEMM_NR個を計算する関数
+// 内積方向は4つずつ組にして, k4組分を積算する
+typedef void (*gemm_int8_kernel_t)( const int8_t *a, const uint8_t *b, float *c, int k4, int ldc, const float *dequant, const gemm_epilogue_t *ep );
+
+
+/////////////////////
+//  行列積 (汎用)  //
+/////////////////////
+static void
+GemmKernelGeneric( const float *a, const float *b, float *c, int k, int ldb, int ldc, bool first, const gemm_epilogue_t *ep )
+{
+  float acc[GEMM_MR][GEMM_NR];
+
+  for (int r = 0; r < GEMM_MR; r++) {
+    for (int j = 0; j < GEMM_NR; j++) {
+      acc[r][j] = first ? 0.0f : c[r * ldc + j];
+    }
+  }
+
+  for (int p = 0; p < k; p++) {
+    const float *bp = b + p * ldb;
+    for (int r = 0; r < GEMM_MR; r++) {
+      const float ar = a[p * GEMM_MR + r];
+      for (int j = 0; j < GEMM_NR; j++) {
+        acc[r][j] += ar * bp[j];
+      }
+    }
+  }
+
+  for (int r = 0; r < GEMM_MR; r++) {
+    for (int j = 0; j < GEMM_NR; j++) {
+      float v = acc[r][j];
+      if (ep) {
+        v += ep->point_bias ? ep->bias[r * ldc + j] : ep->bias[r];
+        if (ep->residual) v += ep->residual[r * ldc + j];
+        if (ep->relu) v = max(v, 0.0f);
+      }
+      c[r * ldc + j] = v;
+    }
+  }
+}
+
+
+static void
+GemmInt8KernelGeneric( const int8_t *a, const uint8_t *b, float *c, int k4, int ldc, const float *dequant, const gemm_epilogue_t *ep )
+{
+  int32_t acc[GEMM_MR][GEMM_NR] = { { 0 } };
+
+  for (int g = 0; g < k4; g++) {
+    const uint8_t *bg = b + g * GEMM_NR * 4;
+    for (int r = 0; r < GEMM_MR; r++) {
+      const int8_t *ar = a + (g * GEMM_MR + r) * 4;
+      for (int j = 0; j < GEMM_NR; j++) {
+        const uint8_t *bj = bg + j * 4;
+        acc[r][j] += ar[0] * bj[0] + ar[1] * bj[1] + ar[2] * bj[2] + ar[3] * bj[3];
+      }
+    }
+  }
+
+  for (int r = 0; r < GEMM_MR; r++) {
+    for (int j = 0; j < GEMM_NR; j++) {
+      float v = acc[r][j] * dequant[r];
+      v += ep->point_bias ? ep->bias[r * ldc + j] : ep->bias[r];
+      if (ep->residual) v += ep->residual[r * ldc + j];
+      if (ep->relu) v = max(v, 0.0f);
+      c[r * ldc + j] = v;
+    }
+  }
+}
+
+
+#if defined(NN_USE_AVX2)
+/////////////////////////
+//  行列積 (AVX2/FMA)  //
+/////////////////////////
+// バイアスと残差を足してReLUをかける
+NN_TARGET_AVX2 static inline __m256
+EpilogueAvx2( __m256 v, const gemm_epilogue_t *ep, int r, int j, int ldc )
+{
+  if (ep->point_bias) {
+    v = _mm256_add_ps(v, _mm256_loadu_ps(ep->bias + r * ldc + j * 8));
+  } else {
+    v = _mm256_add_ps(v, _mm256_broadcast_ss(ep->bias + r));
+  }
+  if (ep->residual) v = _mm256_add_ps(v, _mm256_loadu_ps(ep->residual + r * ldc + j * 8));
+  if (ep->relu) v = _mm256_max_ps(v, _mm256_setzero_ps());
+  return v;
+}
+
+NN_TARGET_AVX2 static void
+GemmKernelAvx2( const float *a, const float *b, float *c, int k, int ldb, int ldc, bool first, const gemm_epilogue_t *ep )
+{
+  __m256 acc[GEMM_MR][3];
+
+  for (int r = 0; r < GEMM_MR; r++) {
+    for (int j = 0; j < 3; j++) {
+      acc[r][j] = first ? _mm256_setzero_ps() : _mm256_loadu_ps(c + r * ldc + j * 8);
+    }
+  }
+
+  for (int p = 0; p < k; p++) {
+    const float *bp = b + p * ldb;
+    const __m256 b0 = _mm256_loadu_ps(bp);
+    const __m256 b1 = _mm256_loadu_ps(bp + 8);
+    const __m256 b2 = _mm256_loadu_ps(bp + 16);
+    for (int r = 0; r < GEMM_MR; r++) {
+      const __m256 ar = _mm256_broadcast_ss(a + p * GEMM_MR + r);
+      acc[r][0] = _mm256_fmadd_ps(ar, b0, acc[r][0]);
+      acc[r][1] = _mm256_fmadd_ps(ar, b1, acc[r][1]);
+      acc[r][2] = _mm256_fmadd_ps(ar, b2, acc[r][2]);
+    }
+  }
+
+  for (int r = 0; r < GEMM_MR; r++) {
+    for (int j = 0; j < 3; j++) {
+      const __m256 v = ep ? EpilogueAvx2(acc[r][j], ep, r, j, ldc) : acc[r][j];
+      _mm256_storeu_ps(c + r * ldc + j * 8, v);
+    }
+  }
+}
+
+
+// INT8の積算結果を実数に戻して書き込む
+NN_TARGET_AVX2 static inline void
+StoreInt8Avx2( __m256i acc[GEMM_MR][3], float *c, int ldc, const float *dequant, const gemm_epilogue_t *ep )
+{
+  for (int r = 0; r < GEMM_MR; r++) {
+    const __m256 scale = _mm256_broadcast_ss(dequant + r);
+    for (int j = 0; j < 3; j++) {
+      const __m256 v = _mm256_mul_ps(_mm256_cvtepi32_ps(acc[r][j]), scale);
+      _mm256_storeu_ps(c + r * ldc + j * 8, EpilogueAvx2(v, ep, r, j, ldc));
+    }
+  }
+}
+
+
+////////////////////////////////
+//  INT8の行列積 (AVX2)       //
+////////////////////////////////
+NN_TARGET_AVX2 static void
+GemmInt8KernelAvx2( const int8_t *a, const uint8_t *b, float *c, int k4, int ldc, const float *dequant, const gemm_epilogue_t *ep )
+{
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i acc[GEMM_MR][3];
+
+  for (int r = 0; r < GEMM_MR; r++) {
+    for (int j = 0; j < 3; j++) {
+      acc[r][j] = _mm256_setzero_si256();
+    }
+  }
+
+  for (int g = 0; g < k4; g++) {
+    const uint8_t *bg = b + g * GEMM_NR * 4;
+    const __m256i b0 = _mm256_loadu_si256((const __m256i *)bg);
+    const __m256i b1 = _mm256_loadu_si256((const __m256i *)(bg + 32));
+    const __m256i b2 = _mm256_loadu_si256((const __m256i *)(bg + 64));
+    for (int r = 0; r < GEMM_MR; r++) {
+      int32_t w;
+      memcpy(&w, a + (g * GEMM_MR + r) * 4, sizeof(w));
+      const __m256i ar = _mm256_set1_epi32(w);
+      // 入力(符号なし) x 重み(符号付き)の隣り合う2つの和を16bitで求め, 4つの和にする
+      acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_madd_epi16(_mm256_maddubs_epi16(b0, ar), ones));
+      acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_madd_epi16(_mm256_maddubs_epi16(b1, ar), ones));
+      acc[r][2] = _mm256_add_epi32(acc[r][2], _mm256_madd_epi16(_mm256_maddubs_epi16(b2, ar), ones));
+    }
+  }
+
+  StoreInt8Avx2(acc, c, ldc, dequant, ep);
+}
+
+
+////////////////////////////////
+//  INT8の行列積 (VNNI)       //
+////////////////////////////////
+NN_TARGET_VNNI static void
+GemmInt8KernelVnni( const int8_t *a, const uint8_t *b, float *c, int k4, int ldc, const float *dequant, const gemm_epilogue_t *ep )
+{
+  __m256i acc[GEMM_MR][3];
+
+  for (int r = 0; r < GEMM_MR; r++) {
+    for (int j = 0; j < 3; j++) {
+      acc[r][j] = _mm256_setzero_si256();
+    }
+  }
+
+  for (int g = 0; g < k4; g++) {
+    const uint8_t *bg = b + g * GEMM_NR * 4;
+    const __m256i b0 = _mm256_loadu_si256((const __m256i *)bg);
+    const __m256i b1 = _mm256_loadu_si256((const __m256i *)(bg + 32));
+    const __m256i b2 = _mm256_loadu_si256((const __m256i *)(bg + 64));
+    for (int r = 0; r < GEMM_MR; r++) {
+      int32_t w;
+      memcpy(&w, a + (g * GEMM_MR + r) * 4, sizeof(w));
+      const __m256i ar = _mm256_set1_epi32(w);
+      acc[r][0] = _mm256_dpbusd_epi32(acc[r][0], b0, ar);
+      acc[r][1] = _mm256_dpbusd_epi32(acc[r][1], b1, ar);
+      acc[r][2] = _mm256_dpbusd_epi32(acc[r][2], b2, ar);
+    }
+  }
+
+  StoreInt8Avx2(acc, c, ldc, dequant, ep);
+}
+
+
+/////////////////////////////////
+//  AVX2とFMAが使えるかの確認  //
+/////////////////////////////////
+static bool
+HasAvx2( void )
+{
+#if defined(_MSC_VER)
+  int info[4];
+
+  __cpuid(info, 1);
+  const bool fma = (info[2] & (1 << 12)) != 0;
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  __cpuidex(info, 7, 0);
+  const bool avx2 = (info[1] & (1 << 5)) != 0;
+
+  return fma && avx2 && osxsave && (_xgetbv(0) & 6) == 6;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+
+//////////////////////////////////////////
+//  AVX512-VNNIが使えるかの確認         //
+//////////////////////////////////////////
+static bool
+HasVnni( void )
+{
+  if (!HasAvx2()) return false;
+#if defined(_MSC_VER)
+  int info[4];
+
+  __cpuidex(info, 7, 0);
+  const bool avx512f = (info[1] & (1 << 16)) != 0;
+  const bool avx512vl = (info[1] & (1 << 31)) != 0;
+  const bool vnni = (info[2] & (1 << 11)) != 0;
+
+  return avx512f && avx512vl && vnni && (_xgetbv(0) & 0xe6) == 0xe6;
+#else
+  return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+         __builtin_cpu_supports("avx512vnni");
+#endif
+}
+#endif
+
+
+///////////////////////////////////
+//  CPUでのニューラルネット推論  //
+///////////////////////////////////
+class cpu_evaluator_t : public nn_evaluator_t {
+public:
+  ~cpu_evaluator_t();
+
+  bool Load( const nn_config_t &config ) override;
+  bool EvaluatePolicy( const float *input, int batch, int channels, int board_size, float *policy ) override;
+  bool EvaluateValue( const float *input, int batch, int channels, int board_size, float *value ) override;
+
+  // INT8化の較正と精度の確認
+  bool Calibrate( const nn_config_t &config, const char *data_file );
+
+  // テキストの重みファイルを変換済みの重みファイルに書き出す
+  bool Convert( const nn_config_t &config );
+
+private:
+  bool ReadModel( const std::string &filename );
+  bool ReadConv( FILE *fp, nn_conv_t &conv );
+  bool ReadTower( FILE *fp, std::vector<nn_layer_t> &tower );
+
+  // 変換済みの重みファイル
+  bool MapModel( const std::string &filename );
+  bool WriteModel( const std::string &filename );
+
+  // 層のつながりを確かめ, 畳み込み層に通し番号を振る
+  bool CheckModel( const std::string &filename );
+
+  // 畳み込み1層の計算
+  void Convolution( const nn_conv_t &conv, const float *in, float *out, const float *residual, int board_size, nn_scratch_t &scratch );
+  void ConvolutionInt8( const nn_conv_t &conv, const float *in, float *out, const float *residual, int board_size, nn_scratch_t &scratch );
+
+  // INT8化
+  bool ReadScales( const std::string &filename );
+  bool WriteScales( const std::string &filename );
+  void QuantizeWeights( void );
+
+  // 層の並びの計算 (結果の入ったバッファの番号を返す)
+  int RunTower( const std::vector<nn_layer_t> &tower, int cur, int board_size, nn_scratch_t &scratch );
+
+  // 入力を並べ替えて共通部分を計算する
+  int RunTrunk( const float *input, int board_size, nn_scratch_t &scratch );
+
+  // batch局面をスレッドに分けて計算する
+  void RunBatch( int batch, const std::function<void(int, nn_scratch_t &)> &job );
+
+  void Worker( int id );
+
+  int board;                            // 重みの前提とする盤の大きさ
+  int input_channels;                   // 入力チャネル数
+  int max_channels;                     // 最大のチャネル数
+  int max_col;                          // 展開した入力の最大の行数
+  int max_col_q;                        // 量子化して展開した入力の最大の行数
+  std::vector<nn_layer_t> trunk;        // 共通部分
+  std::vector<nn_layer_t> policy_head;  // 方策の出力部分
+  std::vector<nn_layer_t> value_head;   // 価値の出力部分
+  float value_scale, value_offset;      // 価値の出力の変換
+  std::vector<nn_conv_t *> convs;       // 全ての畳み込み層 (通し番号順)
+  const unsigned char *mapped = nullptr;  // メモリに割り当てた変換済みの重みファイル
+  size_t mapped_size = 0;               // 割り当てた大きさ
+
+  gemm_kernel_t gemm_kernel = GemmKernelGeneric;
+  gemm_int8_kernel_t gemm_int8_kernel = GemmInt8KernelGeneric;
+  bool int8 = false;                    // INT8で推論するか
+  bool calibrating = false;             // 各層の入力の最大値を記録するか
+
+  // 推論スレッド
+  std::vector<std::thread> workers;
+  std::vector<nn_scratch_t> scratch;
+  std::mutex mutex_job;
+  std::condition_variable job_ready, job_done;
+  const std::function<void(int, nn_scratch_t &)> *job = nullptr;
+  int job_batch = 0;
+  int job_generation = 0;
+  int job_running = 0;
+  std::atomic<int> job_next;
+  bool quit = false;
+};
+
+
+// 交点数をGEMM_NRの倍数に切り上げた値 (作業領域の行の幅)
+static inline int
+PaddedBoard( int board_size )
+{
+  const int n = board_size * board_size;
+  return (n + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+}
+
+// チャネル数をGEMM_MRの倍数に切り上げた値
+static inline int
+PaddedChannels( int channels )
+{
+  return (channels + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+}
+
+// 内積の長さを4の倍数に切り上げた値
+static inline int
+PaddedDepth( int k )
+{
+  return (k + 3) / 4 * 4;
+}
+
+
+cpu_evaluator_t::~cpu_evaluator_t()
+{
+  {
+    lock_guard<mutex> lock(mutex_job);
+    quit = true;
+  }
+  job_ready.notify_all();
+  for (auto &t : workers) {
+    t.join();
+  }
+  if (mapped) {
+    UnmapParamFile(mapped, mapped_size);
+  }
+}
+
+
+//////////////////////
+//  重みの読み込み  //
+//////////////////////
+bool
+cpu_evaluator_t::Load( const nn_config_t &config )
+{
+  const std::string filename = config.params_path + "/" + NN_CPU_MODEL_FILE;
+  const std::string binary = config.params_path + "/" + NN_CPU_BINARY_FILE;
+
+  cerr << "Init CPU NN" << endl;
+
+  // 変換済みの重みファイルがあればそのままメモリに割り当てる
+  if (MapModel(binary)) {
+    if (!CheckModel(binary)) {
+      return false;
+    }
+  } else if (!ReadModel(filename) || !CheckModel(filename)) {
+    return false;
+  }
+
+#if defined(NN_USE_AVX2)
+  if (HasAvx2()) {
+    gemm_kernel = GemmKernelAvx2;
+    gemm_int8_kernel = HasVnni() ? GemmInt8KernelVnni : GemmInt8KernelAvx2;
+  }
+#endif
+
+  // INT8化した入力のスケールがあれば重みを量子化する
+  if (config.int8) {
+    if (ReadScales(config.params_path + "/" + NN_CPU_INT8_FILE)) {
+      QuantizeWeights();
+      int8 = true;
+      const int fp32_convs = (int)count_if(convs.begin(), convs.end(),
+                                           [](const nn_conv_t *conv) { return !conv->int8_input; });
+      if (fp32_convs > 0) {
+        cerr << fp32_convs << " layers without ReLU inputs use FP32" << endl;
+      }
+    } else {
+      cerr << "INT8 scales are not available, use FP32" << endl;
+    }
+  }
+
+  // 呼び出し側のスレッドも計算に加わる
+  const int threads = max(config.threads, 1);
+  scratch.resize(threads);
+  job_next = 0;
+  for (int i = 1; i < threads; i++) {
+    workers.emplace_back(&cpu_evaluator_t::Worker, this, i);
+  }
+
+  const char *kernel = gemm_kernel == GemmKernelGeneric ? "generic" : "avx2";
+  if (int8) {
+#if defined(NN_USE_AVX2)
+    kernel = gemm_int8_kernel == GemmInt8KernelGeneric ? "int8 generic" :
+             gemm_int8_kernel == GemmInt8KernelAvx2 ? "int8 avx2" : "int8 vnni";
+#else
+    kernel = "int8 generic";
+#endif
+  }
+  cerr << "ok (" << kernel << ", " << threads << " threads)" << endl;
+
+  return true;
+}
+
+
+// 重みファイルの読み込み
+// 書式は空白区切りのテキストで,
+//   ray-nn <版>
+//   board <盤の大きさ>
+//   input <入力チャネル数>
+//   tower trunk|policy|value <層の数>
+//     conv <カーネル> <入力> <出力> relu|linear none|channel|point bn|nobn
+//       <重み 出力 x 入力 x カーネル x カーネル> <バイアス> <BNのscale, bias, mean, inv_std>
+//     res <チャネル数>
+//       conv ...
+//       conv ...
+//   value <倍率> <オフセット>
+//   end
+// 価値は tanh(倍率 * Σ tanh(出力) + オフセット)
+bool
+cpu_evaluator_t::ReadModel( const std::string &filename )
+{
+  FILE *fp;
+  char token[64];
+  int version;
+  bool ok = true;
+
+#if defined (_WIN32)
+  if (fopen_s(&fp, filename.c_str(), "r") != 0) fp = NULL;
+#else
+  fp = fopen(filename.c_str(), "r");
+#endif
+  if (fp == NULL) {
+    cerr << "can not open -" << filename << "-" << endl;
+    cerr << "(export it from model.bin with cntk/ExportModel.py)" << endl;
+    return false;
+  }
+
+  if (fscanf(fp, "%63s %d", token, &version) != 2 ||
+      strcmp(token, "ray-nn") != 0 || version != NN_CPU_MODEL_VERSION) {
+    cerr << "Bad model header : " << filename << endl;
+    fclose(fp);
+    return false;
+  }
+
+  board = 0;
+  input_channels = 0;
+  value_scale = 1.0f;
+  value_offset = 0.0f;
+
+  while (ok && fscanf(fp, "%63s", token) == 1) {
+    if (!strcmp(token, "end")) {
+      break;
+    } else if (!strcmp(token, "board")) {
+      ok = fscanf(fp, "%d", &board) == 1;
+    } else if (!strcmp(token, "input")) {
+      ok = fscanf(fp, "%d", &input_channels) == 1;
+    } else if (!strcmp(token, "tower")) {
+      ok = fscanf(fp, "%63s", token) == 1;
+      if (!ok) break;
+      if (!strcmp(token, "trunk")) {
+        ok = ReadTower(fp, trunk);
+      } else if (!strcmp(token, "policy")) {
+        ok = ReadTower(fp, policy_head);
+      } else if (!strcmp(token, "value")) {
+        ok = ReadTower(fp, value_head);
+      } else {
+        ok = false;
+      }
+    } else if (!strcmp(token, "value")) {
+      ok = fscanf(fp, "%f %f", &value_scale, &value_offset) == 2;
+    } else {
+      ok = false;
+    }
+  }
+  fclose(fp);
+
+  if (!ok) {
+    cerr << "Read Error : " << filename << " (" << token << ")" << endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+// 層のつながりの確認
+bool
+cpu_evaluator_t::CheckModel( const std::string &filename )
+{
+  if (trunk.empty() || trunk[0].residual || trunk[0].conv[0].in_channels != input_channels) {
+    cerr << "Bad input layer : " << filename << endl;
+    return false;
+  }
+
+  // 層の間でチャネル数がつながっているか
+  // 残差ブロックは入力と出力のチャネル数が同じ
+  for (auto *tower : { &trunk, &policy_head, &value_head }) {
+    for (size_t i = 0; i < tower->size(); i++) {
+      const nn_layer_t &layer = (*tower)[i];
+      bool ok = true;
+      if (i > 0) {
+        const nn_layer_t &prev = (*tower)[i - 1];
+        ok = layer.conv[0].in_channels == prev.conv[prev.residual ? 1 : 0].out_channels;
+      }
+      if (layer.residual) {
+        const int channels = layer.conv[0].in_channels;
+        ok = ok && layer.conv[0].out_channels == channels &&
+          layer.conv[1].in_channels == channels && layer.conv[1].out_channels == channels;
+      }
+      if (!ok) {
+        cerr << "Channel mismatch : " << filename << endl;
+        return false;
+      }
+    }
+  }
+
+  // 出力部分は共通部分の出力を受け取り, 1チャネルで終わる
+  const nn_layer_t &trunk_out = trunk.back();
+  for (auto *head : { &policy_head, &value_head }) {
+    if (!head->empty() &&
+        ((*head)[0].conv[0].in_channels != trunk_out.conv[trunk_out.residual ? 1 : 0].out_channels ||
+         head->back().residual || head->back().conv[0].out_channels != 1)) {
+      cerr << "Bad output layer : " << filename << endl;
+      return false;
+    }
+  }
+
+  // 畳み込み層に通し番号を振り, 作業領域の大きさを求める
+  // INT8化では入力を0以上に切り詰めるので, 入力がReLUの後でない層はINT8化しない
+  // (入力の特徴は0か1, 残差ブロックの出力はReLUの後)
+  convs.clear();
+  max_channels = input_channels;
+  max_col = 0;
+  max_col_q = 0;
+  bool trunk_relu = true;
+  for (auto *tower : { &trunk, &policy_head, &value_head }) {
+    bool relu = tower == &trunk ? true : trunk_relu;
+    for (auto &layer : *tower) {
+      for (int i = 0; i < (layer.residual ? 2 : 1); i++) {
+        nn_conv_t &conv = layer.conv[i];
+        const int k = conv.in_channels * conv.kernel * conv.kernel;
+        conv.int8_input = relu;
+        relu = conv.relu;
+        conv.id = (int)convs.size();
+        convs.push_back(&conv);
+        max_channels = max(max_channels, PaddedChannels(conv.out_channels));
+        max_col = max(max_col, k);
+        max_col_q = max(max_col_q, PaddedDepth(k));
+      }
+    }
+    if (tower == &trunk) trunk_relu = relu;
+  }
+
+  return true;
+}
+
+
+// 層の並びの読み込み
+bool
+cpu_evaluator_t::ReadTower( FILE *fp, std::vector<nn_layer_t> &tower )
+{
+  char token[64];
+  int layers, channels;
+
+  if (fscanf(fp, "%d", &layers) != 1) return false;
+
+  tower.clear();
+  tower.resize(layers);
+  for (auto &layer : tower) {
+    if (fscanf(fp, "%63s", token) != 1) return false;
+
+    if (!strcmp(token, "conv")) {
+      layer.residual = false;
+      if (!ReadConv(fp, layer.conv[0])) return false;
+    } else if (!strcmp(token, "res")) {
+      layer.residual = true;
+      if (fscanf(fp, "%d", &channels) != 1) return false;
+      for (int i = 0; i < 2; i++) {
+        if (fscanf(fp, "%63s", token) != 1 || strcmp(token, "conv")) return false;
+        if (!ReadConv(fp, layer.conv[i])) return false;
+        if (layer.conv[i].in_channels != channels ||
+            layer.conv[i].out_channels != channels) return false;
+      }
+      // 2つ目の畳み込みのReLUは残差を足した後にかける
+      layer.conv[0].relu = true;
+      layer.conv[1].relu = true;
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// 畳み込み層の読み込み
+// BNは重みとバイアスにたたみ込み, 重みは行列積の順に並べ替える
+bool
+cpu_evaluator_t::ReadConv( FILE *fp, nn_conv_t &conv )
+{
+  char activation[16], bias_type[16], bn_type[16];
+
+  if (fscanf(fp, "%d %d %d %15s %15s %15s", &conv.kernel, &conv.in_channels, &conv.out_channels,
+             activation, bias_type, bn_type) != 6) {
+    return false;
+  }
+  if (conv.kernel <= 0 || conv.kernel % 2 == 0 || conv.in_channels <= 0 || conv.out_channels <= 0) {
+    return false;
+  }
+
+  conv.relu = !strcmp(activation, "relu");
+  conv.point_bias = !strcmp(bias_type, "point");
+  const bool has_bias = conv.point_bias || !strcmp(bias_type, "channel");
+  const bool has_bn = !strcmp(bn_type, "bn");
+  if (conv.point_bias && board <= 0) {
+    return false;
+  }
+
+  const int out = conv.out_channels;
+  const int k = conv.in_channels * conv.kernel * conv.kernel;
+  const int points = conv.point_bias ? board * board : 1;
+  std::vector<float> weight(out * k), bias(out * points, 0.0f);
+
+  for (auto &w : weight) {
+    if (fscanf(fp, "%f", &w) != 1) return false;
+  }
+  if (has_bias) {
+    for (auto &b : bias) {
+      if (fscanf(fp, "%f", &b) != 1) return false;
+    }
+  }
+  if (has_bn) {
+    std::vector<float> bn(out * 4);
+    for (auto &v : bn) {
+      if (fscanf(fp, "%f", &v) != 1) return false;
+    }
+    // y = scale * (x - mean) * inv_std + shift
+    for (int m = 0; m < out; m++) {
+      const float mul = bn[m] * bn[out * 3 + m];
+      for (int i = 0; i < k; i++) {
+        weight[m * k + i] *= mul;
+      }
+      for (int p = 0; p < points; p++) {
+        bias[m * points + p] = (bias[m * points + p] - bn[out * 2 + m]) * mul + bn[out + m];
+      }
+    }
+  }
+
+  // 出力チャネルをGEMM_MR本ずつ, 内積方向に並べる
+  const int out_pad = PaddedChannels(out);
+  conv.weight_data.assign(out_pad * k, 0.0f);
+  for (int m = 0; m < out; m++) {
+    for (int i = 0; i < k; i++) {
+      conv.weight_data[((m / GEMM_MR) * k + i) * GEMM_MR + m % GEMM_MR] = weight[m * k + i];
+    }
+  }
+  // 交点ごとのバイアスは作業領域と同じ幅で持つ
+  if (conv.point_bias) {
+    const int ldc = PaddedBoard(board);
+    conv.bias_data.assign(out_pad * ldc, 0.0f);
+    for (int m = 0; m < out; m++) {
+      std::copy_n(&bias[m * points], points, &conv.bias_data[m * ldc]);
+    }
+  } else {
+    conv.bias_data.assign(out_pad, 0.0f);
+    std::copy(bias.begin(), bias.end(), conv.bias_data.begin());
+  }
+
+  conv.weight = conv.weight_data.data();
+  conv.weight_size = conv.weight_data.size();
+  conv.bias = conv.bias_data.data();
+  conv.bias_size = conv.bias_data.size();
+
+  return true;
+}
+
+
+//////////////////////////////////
+//  変換済みの重みファイル      //
+//////////////////////////////////
+
+// 変換済みの重みファイルをメモリに割り当てる
+// 重みとバイアスはファイル上のものをそのまま使う
+// ファイルがない, または形式が合わない場合はfalseを返し, テキストから読み込む
+bool
+cpu_evaluator_t::MapModel( const std::string &filename )
+{
+  const nn_binary_header_t *header;
+  const nn_binary_conv_t *table;
+  const unsigned char *data;
+  size_t size = 0, table_end;
+  std::vector<nn_layer_t> *tower[3] = { &trunk, &policy_head, &value_head };
+  bool ok = true;
+
+  data = MapParamFile(filename.c_str(), &size);
+  if (data == NULL) return false;
+
+  header = (const nn_binary_header_t *)data;
+  table = (const nn_binary_conv_t *)(data + sizeof(nn_binary_header_t));
+
+  if (size < sizeof(nn_binary_header_t)) {
+    cerr << "Ignore NN model (format mismatch) : " << filename << endl;
+    UnmapParamFile(data, size);
+    return false;
+  }
+
+  table_end = sizeof(nn_binary_header_t) + sizeof(nn_binary_conv_t) * (size_t)header->convs;
+
+  if (memcmp(header->magic, NN_CPU_BINARY_MAGIC, sizeof(NN_CPU_BINARY_MAGIC)) != 0 ||
+      header->version != NN_CPU_BINARY_VERSION ||
+      header->byte_order != NN_CPU_BINARY_BYTE_ORDER ||
+      header->gemm_mr != (unsigned int)GEMM_MR ||
+      header->gemm_nr != (unsigned int)GEMM_NR ||
+      header->file_size != (unsigned long long)size ||
+      (size - sizeof(nn_binary_header_t)) % sizeof(unsigned long long) != 0 ||
+      table_end > size) {
+    cerr << "Ignore NN model (format mismatch) : " << filename << endl;
+    UnmapParamFile(data, size);
+    return false;
+  }
+
+  // 畳み込み層の表は毎回, ファイル全体は確認するモードの時のみ確認する
+  if (UpdateParamChecksum(PARAM_CHECKSUM_SEED, (const unsigned char *)table, table_end - sizeof(nn_binary_header_t)) != header->table_checksum ||
+      (IsVerifyParamFiles() &&
+       UpdateParamChecksum(PARAM_CHECKSUM_SEED, data + sizeof(nn_binary_header_t), size - sizeof(nn_binary_header_t)) != header->checksum)) {
+    cerr << "Ignore NN model (checksum mismatch) : " << filename << endl;
+    UnmapParamFile(data, size);
+    return false;
+  }
+
+  board = header->board;
+  input_channels = header->input_channels;
+  value_scale = header->value_scale;
+  value_offset = header->value_offset;
+  for (int t = 0; t < 3; t++) {
+    tower[t]->clear();
+  }
+
+  // 畳み込み層の表から層の並びを組み立てる
+  for (unsigned int i = 0; ok && i < header->convs; i++) {
+    const nn_binary_conv_t &entry = table[i];
+    if (entry.tower < 0 || entry.tower >= 3 || entry.residual < 0 || entry.residual > 2 ||
+        entry.kernel <= 0 || entry.kernel % 2 == 0 || entry.in_channels <= 0 || entry.out_channels <= 0 ||
+        (entry.point_bias && board <= 0)) {
+      ok = false;
+      break;
+    }
+
+    std::vector<nn_layer_t> &layers = *tower[entry.tower];
+    if (entry.residual != 2) {
+      layers.emplace_back();
+      layers.back().residual = entry.residual == 1;
+    } else if (layers.empty() || !layers.back().residual || layers.back().conv[1].weight) {
+      ok = false;
+      break;
+    }
+
+    nn_conv_t &conv = layers.back().conv[entry.residual == 2 ? 1 : 0];
+    const size_t k = (size_t)entry.in_channels * entry.kernel * entry.kernel;
+    const size_t out_pad = PaddedChannels(entry.out_channels);
+    conv.kernel = entry.kernel;
+    conv.in_channels = entry.in_channels;
+    conv.out_channels = entry.out_channels;
+    conv.relu = entry.relu != 0;
+    conv.point_bias = entry.point_bias != 0;
+    conv.weight_size = out_pad * k;
+    conv.bias_size = conv.point_bias ? out_pad * PaddedBoard(board) : out_pad;
+    if (entry.weight_size != conv.weight_size || entry.bias_size != conv.bias_size ||
+        entry.weight_offset < table_end || entry.weight_offset % PARAM_SECTION_ALIGN != 0 ||
+        entry.bias_offset < table_end || entry.bias_offset % PARAM_SECTION_ALIGN != 0 ||
+        entry.weight_offset > size || entry.weight_size * sizeof(float) > size - entry.weight_offset ||
+        entry.bias_offset > size || entry.bias_size * sizeof(float) > size - entry.bias_offset) {
+      ok = false;
+      break;
+    }
+    conv.weight = (const float *)(data + entry.weight_offset);
+    conv.bias = (const float *)(data + entry.bias_offset);
+  }
+
+  for (int t = 0; ok && t < 3; t++) {
+    ok = (int)tower[t]->size() == header->layers[t];
+    for (const auto &layer : *tower[t]) {
+      ok = ok && (!layer.residual || layer.conv[1].weight);
+    }
+  }
+
+  if (!ok) {
+    cerr << "Ignore NN model (broken layer) : " << filename << endl;
+    for (int t = 0; t < 3; t++) {
+      tower[t]->clear();
+    }
+    UnmapParamFile(data, size);
+    return false;
+  }
+
+  mapped = data;
+  mapped_size = size;
+
+  cerr << "Map NN model : " << filename << endl;
+
+  return true;
+}
+
+
+// 変換済みの重みファイルの書き出し
+// ヘッダ, 畳み込み層の表, 各層の重みとバイアスの順に, それぞれPARAM_SECTION_ALIGNに揃えて並べる
+bool
+cpu_evaluator_t::WriteModel( const std::string &filename )
+{
+  const std::vector<nn_layer_t> *tower[3] = { &trunk, &policy_head, &value_head };
+  const std::string temp_path = filename + ".tmp";
+  std::vector<nn_binary_conv_t> table;
+  std::vector<unsigned char> image;
+  nn_binary_header_t header;
+  FILE *fp;
+
+  auto align = [](size_t size) {
+    return (size + PARAM_SECTION_ALIGN - 1) & ~(PARAM_SECTION_ALIGN - 1);
+  };
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, NN_CPU_BINARY_MAGIC, sizeof(NN_CPU_BINARY_MAGIC));
+  header.version = NN_CPU_BINARY_VERSION;
+  header.byte_order = NN_CPU_BINARY_BYTE_ORDER;
+  header.gemm_mr = GEMM_MR;
+  header.gemm_nr = GEMM_NR;
+  header.board = board;
+  header.input_channels = input_channels;
+  header.convs = (unsigned int)convs.size();
+  header.value_scale = value_scale;
+  header.value_offset = value_offset;
+
+  // 畳み込み層の表 (通し番号順に並べると層の並びを組み立て直せる)
+  size_t offset = align(sizeof(header) + sizeof(nn_binary_conv_t) * convs.size());
+  for (int t = 0; t < 3; t++) {
+    header.layers[t] = (int)tower[t]->size();
+    for (const auto &layer : *tower[t]) {
+      for (int i = 0; i < (layer.residual ? 2 : 1); i++) {
+        const nn_conv_t &conv = layer.conv[i];
+        nn_binary_conv_t entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.tower = t;
+        entry.residual = layer.residual ? i + 1 : 0;
+        entry.kernel = conv.kernel;
+        entry.in_channels = conv.in_channels;
+        entry.out_channels = conv.out_channels;
+        entry.relu = conv.relu;
+        entry.point_bias = conv.point_bias;
+        entry.weight_offset = offset;
+        entry.weight_size = conv.weight_size;
+        offset = align(offset + conv.weight_size * sizeof(float));
+        entry.bias_offset = offset;
+        entry.bias_size = conv.bias_size;
+        offset = align(offset + conv.bias_size * sizeof(float));
+        table.push_back(entry);
+      }
+    }
+  }
+  header.file_size = offset;
+
+  // ファイル全体を組み立ててからチェックサムを求める
+  image.assign(offset, 0);
+  memcpy(&image[sizeof(header)], table.data(), sizeof(nn_binary_conv_t) * table.size());
+  for (size_t i = 0; i < table.size(); i++) {
+    memcpy(&image[table[i].weight_offset], convs[i]->weight, convs[i]->weight_size * sizeof(float));
+    memcpy(&image[table[i].bias_offset], convs[i]->bias, convs[i]->bias_size * sizeof(float));
+  }
+  header.checksum = UpdateParamChecksum(PARAM_CHECKSUM_SEED, &image[sizeof(header)], image.size() - sizeof(header));
+  header.table_checksum = UpdateParamChecksum(PARAM_CHECKSUM_SEED, &image[sizeof(header)], sizeof(nn_binary_conv_t) * table.size());
+  memcpy(&image[0], &header, sizeof(header));
+
+#if defined (_WIN32)
+  if (fopen_s(&fp, temp_path.c_str(), "wb") != 0) fp = NULL;
+#else
+  fp = fopen(temp_path.c_str(), "wb");
+#endif
+  if (fp == NULL) {
+    cerr << "can not open -" << temp_path << "-" << endl;
+    return false;
+  }
+  fwrite(image.data(), 1, image.size(), fp);
+  if (ferror(fp) != 0) {
+    fclose(fp);
+    cerr << "Write Error : " << temp_path << endl;
+    return false;
+  }
+  fclose(fp);
+
+  // 起動中の他のプロセスが書きかけのファイルを開かないように置き換える
+#if defined (_WIN32)
+  remove(filename.c_str());
+#endif
+  if (rename(temp_path.c_str(), filename.c_str()) != 0) {
+    cerr << "can not rename -" << temp_path << "- to -" << filename << "-" << endl;
+    return false;
+  }
+
+  cerr << "Write NN model : " << filename << " (" << offset << " bytes, " << convs.size() << " convolutions)" << endl;
+
+  return true;
+}
+
+
+// テキストの重みファイルを読み込み, 変換済みの重みファイルに書き出す
+bool
+cpu_evaluator_t::Convert( const nn_config_t &config )
+{
+  const std::string filename = config.params_path + "/" + NN_CPU_MODEL_FILE;
+
+  if (!ReadModel(filename) || !CheckModel(filename)) {
+    return false;
+  }
+
+  return WriteModel(config.params_path + "/" + NN_CPU_BINARY_FILE);
+}
+
+
+/////////////////////////
+//  畳み込み1層の計算  //
+/////////////////////////
+void
+cpu_evaluator_t::Convolution( const nn_conv_t &conv, const float *in, float *out, const float *residual, int board_size, nn_scratch_t &scratch )
+{
+  if (int8 && conv.int8_input) {
+    ConvolutionInt8(conv, in, out, residual, board_size, scratch);
+    return;
+  }
+
+  const int ld = PaddedBoard(board_size);
+  const int kernel = conv.kernel;
+  const int pad = kernel / 2;
+  const int k = conv.in_channels * kernel * kernel;
+
+  // 較正中は入力の最大値を記録する
+  if (calibrating) {
+    float &input_max = scratch.input_max[conv.id];
+    for (int c = 0; c < conv.in_channels; c++) {
+      for (int n = 0; n < board_size * board_size; n++) {
+        input_max = max(input_max, in[c * ld + n]);
+      }
+    }
+  }
+
+  // 入力を (チャネル, カーネルの縦, カーネルの横) x 交点 の行列に展開する
+  // 行列積で続けて読めるように, 交点GEMM_NR個ごとのパネルに分けて並べる
+  float *col = scratch.col.data();
+  for (int c = 0; c < conv.in_channels; c++) {
+    for (int ky = 0; ky < kernel; ky++) {
+      for (int kx = 0; kx < kernel; kx++) {
+        float *row = col + ((c * kernel + ky) * kernel + kx) * GEMM_NR;
+        const int dx = kx - pad;
+        for (int y = 0; y < board_size; y++) {
+          const int sy = y + ky - pad;
+          const bool inside = sy >= 0 && sy < board_size;
+          const float *src = in + c * ld + sy * board_size + dx;
+          for (int x = 0, n = y * board_size; x < board_size; x++, n++) {
+            const int sx = x + dx;
+            row[(n / GEMM_NR) * k * GEMM_NR + n % GEMM_NR] =
+              (inside && sx >= 0 && sx < board_size) ? src[x] : 0.0f;
+          }
+        }
+      }
+    }
+  }
+
+  // 出力 = 重み x 展開した入力
+  gemm_epilogue_t ep;
+  ep.point_bias = conv.point_bias;
+  ep.relu = conv.relu;
+
+  const int mb_num = PaddedChannels(conv.out_channels) / GEMM_MR;
+  for (int k0 = 0; k0 < k; k0 += GEMM_KC) {
+    const int kc = min(GEMM_KC, k - k0);
+    const bool first = k0 == 0;
+    const bool last = k0 + kc >= k;
+    for (int n0 = 0; n0 < ld; n0 += GEMM_NR) {
+      for (int mb = 0; mb < mb_num; mb++) {
+        const int m0 = mb * GEMM_MR;
+        const float *a = conv.weight + (mb * k + k0) * GEMM_MR;
+        if (last) {
+          ep.bias = conv.point_bias ? conv.bias + m0 * ld + n0 : conv.bias + m0;
+          ep.residual = residual ? residual + m0 * ld + n0 : nullptr;
+        }
+        gemm_kernel(a, col + (n0 * k + k0 * GEMM_NR), out + m0 * ld + n0, kc, GEMM_NR, ld, first, last ? &ep : nullptr);
+      }
+    }
+  }
+}
+
+
+//////////////////////////////////
+//  畳み込み1層の計算 (INT8)    //
+//////////////////////////////////
+void
+cpu_evaluator_t::ConvolutionInt8( const nn_conv_t &conv, const float *in, float *out, const float *residual, int board_size, nn_scratch_t &scratch )
+{
+  const int ld = PaddedBoard(board_size);
+  const int points = board_size * board_size;
+  const int kernel = conv.kernel;
+  const int pad = kernel / 2;
+  const int k = conv.in_channels * kernel * kernel;
+  const int k_pad = PaddedDepth(k);
+  const int panel = k_pad * GEMM_NR;
+  const float inv_scale = 1.0f / conv.input_scale;
+
+  // 入力を量子化しながら展開する
+  // パネルの中は内積方向の4つを交点ごとにまとめて並べる
+  uint8_t *col = scratch.col_q.data();
+  auto index = [&](int r, int n) {
+    return (n / GEMM_NR) * panel + (r / 4) * GEMM_NR * 4 + (n % GEMM_NR) * 4 + r % 4;
+  };
+  for (int c = 0; c < conv.in_channels; c++) {
+    for (int ky = 0; ky < kernel; ky++) {
+      for (int kx = 0; kx < kernel; kx++) {
+        const int r = (c * kernel + ky) * kernel + kx;
+        const int dx = kx - pad;
+        for (int y = 0; y < board_size; y++) {
+          const int sy = y + ky - pad;
+          const bool inside = sy >= 0 && sy < board_size;
+          const float *src = in + c * ld + sy * board_size + dx;
+          for (int x = 0, n = y * board_size; x < board_size; x++, n++) {
+            const int sx = x + dx;
+            int q = 0;
+            if (inside && sx >= 0 && sx < board_size) {
+              q = min((int)(src[x] * inv_scale + 0.5f), INT8_INPUT_MAX);
+              q = max(q, 0);
+            }
+            col[index(r, n)] = (uint8_t)q;
+          }
+        }
+      }
+    }
+  }
+  // 4の倍数に切り上げた分は0にする
+  for (int r = k; r < k_pad; r++) {
+    for (int n = 0; n < points; n++) {
+      col[index(r, n)] = 0;
+    }
+  }
+
+  gemm_epilogue_t ep;
+  ep.point_bias = conv.point_bias;
+  ep.relu = conv.relu;
+
+  const int k4 = k_pad / 4;
+  const int mb_num = PaddedChannels(conv.out_channels) / GEMM_MR;
+  for (int n0 = 0; n0 < ld; n0 += GEMM_NR) {
+    for (int mb = 0; mb < mb_num; mb++) {
+      const int m0 = mb * GEMM_MR;
+      ep.bias = conv.point_bias ? conv.bias + m0 * ld + n0 : conv.bias + m0;
+      ep.residual = residual ? residual + m0 * ld + n0 : nullptr;
+      gemm_int8_kernel(conv.weight_q.data() + mb * k_pad * GEMM_MR, col + (n0 / GEMM_NR) * panel,
+                       out + m0 * ld + n0, k4, ld, conv.dequant.data() + m0, &ep);
+    }
+  }
+}
+
+
+//////////////////////
+//  層の並びの計算  //
+//////////////////////
+int
+cpu_evaluator_t::RunTower( const std::vector<nn_layer_t> &tower, int cur, int board_size, nn_scratch_t &scratch )
+{
+  for (const auto &layer : tower) {
+    const int t = (cur + 1) % 3, next = (cur + 2) % 3;
+    if (layer.residual) {
+      Convolution(layer.conv[0], scratch.act[cur].data(), scratch.act[t].data(), nullptr, board_size, scratch);
+      Convolution(layer.conv[1], scratch.act[t].data(), scratch.act[next].data(), scratch.act[cur].data(), board_size, scratch);
+      cur = next;
+    } else {
+      Convolution(layer.conv[0], scratch.act[cur].data(), scratch.act[t].data(), nullptr, board_size, scratch);
+      cur = t;
+    }
+  }
+  return cur;
+}
+
+
+int
+cpu_evaluator_t::RunTrunk( const float *input, int board_size, nn_scratch_t &scratch )
+{
+  const int ld = PaddedBoard(board_size);
+  const int points = board_size * board_size;
+
+  if ((int)scratch.col.size() < max_col * ld) {
+    scratch.col.assign(max_col * ld, 0.0f);
+    scratch.col_q.assign(max_col_q * ld, 0);
+    for (auto &act : scratch.act) {
+      act.assign(max_channels * ld, 0.0f);
+    }
+  }
+
+  for (int c = 0; c < input_channels; c++) {
+    std::copy_n(input + c * points, points, &scratch.act[0][c * ld]);
+  }
+
+  return RunTower(trunk, 0, board_size, scratch);
+}
+
+
+///////////////////////////////////////
+//  batch局面をスレッドに分けて計算  //
+///////////////////////////////////////
+void
+cpu_evaluator_t::RunBatch( int batch, const std::function<void(int, nn_scratch_t &)> &func )
+{
+  {
+    lock_guard<mutex> lock(mutex_job);
+    job = &func;
+    job_batch = batch;
+    job_next = 0;
+    job_running = (int)workers.size();
+    job_generation++;
+  }
+  job_ready.notify_all();
+
+  int i;
+  while ((i = job_next.fetch_add(1)) < batch) {
+    func(i, scratch[0]);
+  }
+
+  unique_lock<mutex> lock(mutex_job);
+  job_done.wait(lock, [this] { return job_running == 0; });
+  job = nullptr;
+}
+
+
+void
+cpu_evaluator_t::Worker( int id )
+{
+  int generation = 0;
+
+  while (true) {
+    unique_lock<mutex> lock(mutex_job);
+    job_ready.wait(lock, [&] { return quit || job_generation != generation; });
+    if (quit) return;
+    generation = job_generation;
+    const auto *func = job;
+    const int batch = job_batch;
+    lock.unlock();
+
+    int i;
+    while ((i = job_next.fetch_add(1)) < batch) {
+      (*func)(i, scratch[id]);
+    }
+
+    lock.lock();
+    if (--job_running == 0) {
+      job_done.notify_one();
+    }
+  }
+}
+
+
+////////////
+//  推論  //
+////////////
+bool
+cpu_evaluator_t::EvaluatePolicy( const float *input, int batch, int channels, int board_size, float *policy )
+{
+  if (policy_head.empty() || channels != input_channels) {
+    cerr << "Eval move error (input " << channels << " / " << input_channels << ")" << endl;
+    return false;
+  }
+
+  const int points = board_size * board_size;
+
+  RunBatch(batch, [&](int i, nn_scratch_t &s) {
+    int cur = RunTrunk(input + i * channels * points, board_size, s);
+    cur = RunTower(policy_head, cur, board_size, s);
+    std::copy_n(s.act[cur].data(), points, policy + i * points);
+  });
+
+  return true;
+}
+
+
+bool
+cpu_evaluator_t::EvaluateValue( const float *input, int batch, int channels, int board_size, float *value )
+{
+  if (value_head.empty() || channels != input_channels ||
+      (value_head.back().conv[0].point_bias && board_size != board)) {
+    cerr << "Eval win error (input " << channels << " / " << input_channels << ")" << endl;
+    return false;
+  }
+
+  const int points = board_size * board_size;
+
+  RunBatch(batch, [&](int i, nn_scratch_t &s) {
+    int cur = RunTrunk(input + i * channels * points, board_size, s);
+    cur = RunTower(value_head, cur, board_size, s);
+    const float *out = s.act[cur].data();
+    double sum = 0;
+    for (int p = 0; p < points; p++) {
+      sum += tanh(out[p]);
+    }
+    value[i] = (float)tanh(value_scale * sum + value_offset);
+  });
+
+  return true;
+}
+
+
+//////////////////
+//  INT8化      //
+//////////////////
+
+// 入力のスケールの読み込み
+// 書式は ray-nn-int8 <版> <畳み込み層の数> <各層の入力の刻み...>
+bool
+cpu_evaluator_t::ReadScales( const std::string &filename )
+{
+  ifstream in(filename);
+  std::string magic;
+  int version, count;
+
+  if (!(in >> magic >> version >> count) || magic != "ray-nn-int8" ||
+      version != NN_CPU_INT8_VERSION || count != (int)convs.size()) {
+    return false;
+  }
+  for (auto *conv : convs) {
+    if (!(in >> conv->input_scale) || !(conv->input_scale > 0.0f)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+bool
+cpu_evaluator_t::WriteScales( const std::string &filename )
+{
+  ofstream out(filename);
+
+  out << "ray-nn-int8 " << NN_CPU_INT8_VERSION << endl;
+  out << convs.size() << endl;
+  out.precision(9);
+  for (auto *conv : convs) {
+    out << conv->input_scale << endl;
+  }
+
+  return (bool)out;
+}
+
+
+// 重みを出力チャネルごとの刻みで量子化する
+// 内積方向を4つずつ組にして, GEMM_MRチャネル分を並べる
+void
+cpu_evaluator_t::QuantizeWeights( void )
+{
+  for (auto *conv : convs) {
+    const int k = conv->in_channels * conv->kernel * conv->kernel;
+    const int k_pad = PaddedDepth(k);
+    const int out_pad = PaddedChannels(conv->out_channels);
+    auto weight = [&](int m, int i) {
+      return conv->weight[((m / GEMM_MR) * k + i) * GEMM_MR + m % GEMM_MR];
+    };
+
+    conv->weight_q.assign(out_pad * k_pad, 0);
+    conv->dequant.assign(out_pad, 0.0f);
+    for (int m = 0; m < conv->out_channels; m++) {
+      float w_max = 0.0f;
+      for (int i = 0; i < k; i++) {
+        w_max = max(w_max, fabs(weight(m, i)));
+      }
+      const float w_scale = w_max > 0.0f ? w_max / INT8_WEIGHT_MAX : 1.0f;
+      for (int i = 0; i < k; i++) {
+        const int q = (int)lround(weight(m, i) / w_scale);
+        conv->weight_q[(((m / GEMM_MR) * (k_pad / 4) + i / 4) * GEMM_MR + m % GEMM_MR) * 4 + i % 4] =
+          (int8_t)max(-INT8_WEIGHT_MAX, min(q, INT8_WEIGHT_MAX));
+      }
+      conv->dequant[m] = w_scale * conv->input_scale;
+    }
+  }
+}
+
+
+// 局面の読み込み
+// GTP_features_planes_fileが書き出した行の|featuresの部分 (番号:値 の並び) を使う
+static int
+ReadCalibrationData( const char *data_file, int size, std::vector<float> &positions )
+{
+  ifstream in(data_file);
+  std::string line;
+  int count = 0;
+
+  positions.clear();
+  while (count < NN_CALIBRATION_POSITIONS && getline(in, line)) {
+    const size_t begin = line.find("|features ");
+    if (begin == std::string::npos) continue;
+    const size_t end = line.find('|', begin + 1);
+    const std::string features = line.substr(begin + 10, end == std::string::npos ? std::string::npos : end - begin - 10);
+
+    std::vector<float> data(size, 0.0f);
+    const char *p = features.c_str();
+    char *next;
+    bool ok = true;
+    while (true) {
+      const long index = strtol(p, &next, 10);
+      if (next == p) break;
+      if (*next != ':' || index < 0 || index >= size) {
+        ok = false;
+        break;
+      }
+      p = next + 1;
+      data[index] = strtof(p, &next);
+      p = next;
+    }
+    if (!ok) continue;
+
+    positions.insert(positions.end(), data.begin(), data.end());
+    count++;
+  }
+
+  return count;
+}
+
+
+// 各層の入力の最大値からINT8化の刻みを決め, FP32との一致度を確かめる
+bool
+cpu_evaluator_t::Calibrate( const nn_config_t &config, const char *data_file )
+{
+  const int points = board * board;
+  const int size = input_channels * points;
+  std::vector<float> positions;
+  std::vector<int> calibration, check;
+
+  if (board <= 0) {
+    cerr << "Model has no board size" << endl;
+    return false;
+  }
+
+  const int count = ReadCalibrationData(data_file, size, positions);
+  if (count == 0) {
+    cerr << "No positions in " << data_file << endl;
+    return false;
+  }
+  for (int i = 0; i < count; i++) {
+    if (count >= NN_CALIBRATION_CHECK_RATE && i % NN_CALIBRATION_CHECK_RATE == NN_CALIBRATION_CHECK_RATE - 1) {
+      check.push_back(i);
+    } else {
+      calibration.push_back(i);
+    }
+  }
+  if (check.empty()) check = calibration;
+
+  // FP32で推論して各層の入力の最大値を集める
+  int8 = false;
+  calibrating = true;
+  for (auto &s : scratch) {
+    s.input_max.assign(convs.size(), 0.0f);
+  }
+  RunBatch((int)calibration.size(), [&](int i, nn_scratch_t &s) {
+    const int trunk_out = RunTrunk(&positions[calibration[i] * size], board, s);
+    if (!policy_head.empty()) RunTower(policy_head, trunk_out, board, s);
+    if (!value_head.empty()) RunTower(value_head, trunk_out, board, s);
+  });
+  calibrating = false;
+
+  for (auto *conv : convs) {
+    float input_max = 0.0f;
+    for (auto &s : scratch) {
+      input_max = max(input_max, s.input_max[conv->id]);
+    }
+    conv->input_scale = input_max > 0.0f ? input_max / INT8_INPUT_MAX : 1.0f;
+  }
+
+  const std::string filename = config.params_path + "/" + NN_CPU_INT8_FILE;
+  if (!WriteScales(filename)) {
+    cerr << "can not write -" << filename << "-" << endl;
+    return false;
+  }
+  cerr << "Calibrated with " << calibration.size() << " positions : " << filename << endl;
+
+  // 確認用の局面でFP32とINT8の出力を比べる
+  const int n = (int)check.size();
+  std::vector<float> input(n * size);
+  for (int i = 0; i < n; i++) {
+    std::copy_n(&positions[check[i] * size], size, &input[i * size]);
+  }
+
+  std::vector<float> policy[2], value[2];
+  QuantizeWeights();
+  for (int q = 0; q < 2; q++) {
+    int8 = q == 1;
+    if (!policy_head.empty()) {
+      policy[q].resize(n * points);
+      EvaluatePolicy(input.data(), n, input_channels, board, policy[q].data());
+    }
+    if (!value_head.empty()) {
+      value[q].resize(n);
+      EvaluateValue(input.data(), n, input_channels, board, value[q].data());
+    }
+  }
+
+  if (!policy_head.empty()) {
+    int agree = 0;
+    for (int i = 0; i < n; i++) {
+      const float *p0 = &policy[0][i * points], *p1 = &policy[1][i * points];
+      if (max_element(p0, p0 + points) - p0 == max_element(p1, p1 + points) - p1) {
+        agree++;
+      }
+    }
+    cerr << "INT8 policy top-1 agreement : " << 100.0 * agree / n << "% (" << n << " positions)" << endl;
+  }
+  if (!value_head.empty()) {
+    double mse = 0;
+    for (int i = 0; i < n; i++) {
+      mse += (value[1][i] - value[0][i]) * (value[1][i] - value[0][i]);
+    }
+    cerr << "INT8 value MSE : " << mse / n << " (" << n << " positions)" << endl;
+  }
+
+  return true;
+}
+
+
+nn_evaluator_t *
+CreateCpuEvaluator( void )
+{
+  return new cpu_evaluator_t();
+}
+
+
+////////////////////////////
+//  INT8化の較正をする    //
+////////////////////////////
+bool
+CalibrateCpuEvaluator( const nn_config_t &config, const char *data_file )
+{
+  cpu_evaluator_t evaluator;
+  nn_config_t fp32_config = config;
+
+  fp32_config.int8 = false;
+  if (!evaluator.Load(fp32_config)) {
+    return false;
+  }
+
+  return evaluator.Calibrate(config, data_file);
+}
+
+
+////////////////////////////////////
+//  重みファイルを変換する        //
+////////////////////////////////////
+bool
+ConvertCpuModel( const nn_config_t &config )
+{
+  cpu_evaluator_t evaluator;
+
+  return evaluator.Convert(config);
+}
@@ -0,0 +1,416 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#if defined (_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ParamBundle.h"
+
+using namespace std;
+
+
+// 一括ファイルの識別子
+static const char PARAM_BUNDLE_MAGIC[8] = { 'R', 'A', 'Y', 'P', 'A', 'R', 'A', 'M' };
+
+// バイト順の確認用の値
+static const unsigned int PARAM_BUNDLE_BYTE_ORDER = 0x01020304;
+
+// 一括ファイルのパス
+char param_bundle_path[1024];
+
+// 一括ファイルを作成するモード
+static bool make_param_bundle = false;
+
+// ファイル全体のチェックサムを確認するモード
+static bool verify_param_files = false;
+
+// メモリに割り当てた一括ファイル
+static const unsigned char *bundle_data = NULL;
+
+// 一括ファイルの区画表
+static const param_section_t *bundle_section = NULL;
+
+// 一括ファイルの区画数
+static unsigned int bundle_sections = 0;
+
+// 書き出す区画
+struct pending_section_t {
+  string name;       // 区画名
+  const void *data;  // 区画のデータ
+  size_t size;       // 区画の大きさ
+};
+
+static vector<pending_section_t> pending_section;
+
+
+// 区画の境界への切り上げ
+static size_t AlignSection( size_t size );
+
+
+//////////////////////////////////////////
+//  一括ファイルを作成するモードの設定  //
+//////////////////////////////////////////
+void
+SetMakeParamBundle( bool flag )
+{
+  make_param_bundle = flag;
+}
+
+
+////////////////////////////////////////
+//  一括ファイルを作成するモードか    //
+////////////////////////////////////////
+bool
+IsMakeParamBundle( void )
+{
+  return make_param_bundle;
+}
+
+
+//////////////////////////////////////////////////
+//  ファイル全体のチェックサムを確認するモード  //
+//////////////////////////////////////////////////
+void
+SetVerifyParamFiles( bool flag )
+{
+  verify_param_files = flag;
+}
+
+
+bool
+IsVerifyParamFiles( void )
+{
+  return verify_param_files;
+}
+
+
+//////////////////////////////
+//  区画の境界への切り上げ  //
+//////////////////////////////
+static size_t
+AlignSection( size_t size )
+{
+  return (size + PARAM_SECTION_ALIGN - 1) & ~(PARAM_SECTION_ALIGN - 1);
+}
+
+
+//////////////////////////////
+//  チェックサムの更新      //
+//////////////////////////////
+// 8バイトごとのFNV-1a (sizeは8の倍数)
+unsigned long long
+UpdateParamChecksum( unsigned long long sum, const unsigned char *data, size_t size )
+{
+  unsigned long long word;
+  size_t i;
+
+  for (i = 0; i < size; i += sizeof(word)) {
+    memcpy(&word, data + i, sizeof(word));
+    sum ^= word;
+    sum *= 0x100000001B3ULL;
+  }
+
+  return sum;
+}
+
+
+//////////////////////////////////////////////////
+//  ファイルを読み込み専用でメモリに割り当てる  //
+//////////////////////////////////////////////////
+const unsigned char *
+MapParamFile( const char *filename, size_t *size )
+{
+#if defined (_WIN32)
+  HANDLE file, mapping;
+  LARGE_INTEGER file_size;
+  void *view;
+
+  file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return NULL;
+  }
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    CloseHandle(file);
+    return NULL;
+  }
+  mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (mapping == NULL) {
+    return NULL;
+  }
+  view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (view == NULL) {
+    return NULL;
+  }
+  *size = (size_t)file_size.QuadPart;
+  return (const unsigned char *)view;
+#else
+  struct stat st;
+  void *view;
+  int fd;
+
+  fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    return NULL;
+  }
+  *size = (size_t)st.st_size;
+  return (const unsigned char *)view;
+#endif
+}
+
+
+//////////////////////////////////
+//  メモリへの割り当ての解除    //
+//////////////////////////////////
+void
+UnmapParamFile( const unsigned char *data, size_t size )
+{
+#if defined (_WIN32)
+  (void)size;
+  UnmapViewOfFile(data);
+#else
+  munmap((void *)data, size);
+#endif
+}
+
+
+////////////////////////////
+//  一括ファイルを開く    //
+////////////////////////////
+bool
+OpenParamBundle( void )
+{
+  const param_bundle_header_t *header;
+  const param_section_t *section;
+  const unsigned char *data;
+  size_t size = 0, table_end;
+  unsigned long long sum;
+  unsigned int i;
+
+  // 作成する時はテキストから読み込む
+  if (make_param_bundle) return false;
+
+  data = MapParamFile(param_bundle_path, &size);
+  if (data == NULL) return false;
+
+  header = (const param_bundle_header_t *)data;
+  section = (const param_section_t *)(data + sizeof(param_bundle_header_t));
+
+  if (size < sizeof(param_bundle_header_t)) {
+    cerr << "Ignore parameter bundle (format mismatch) : " << param_bundle_path << endl;
+    UnmapParamFile(data, size);
+    return false;
+  }
+
+  table_end = sizeof(param_bundle_header_t) + sizeof(param_section_t) * (size_t)header->sections;
+
+  if (memcmp(header->magic, PARAM_BUNDLE_MAGIC, sizeof(PARAM_BUNDLE_MAGIC)) != 0 ||
+      header->version != PARAM_BUNDLE_VERSION ||
+      header->byte_order != PARAM_BUNDLE_BYTE_ORDER ||
+      header->file_size != (unsigned long long)size ||
+      (size - sizeof(param_bundle_header_t)) % sizeof(unsigned long long) != 0 ||
+      table_end > size) {
+    cerr << "Ignore parameter bundle (format mismatch) : " << param_bundle_path << endl;
+    UnmapParamFile(data, size);
+    return false;
+  }
+
+  // 区画表は毎回, ファイル全体は確認するモードの時のみ確認する
+  sum = UpdateParamChecksum(PARAM_CHECKSUM_SEED, (const unsigned char *)section, table_end - sizeof(param_bundle_header_t));
+  if (sum != header->table_checksum) {
+    cerr << "Ignore parameter bundle (checksum mismatch) : " << param_bundle_path << endl;
+    UnmapParamFile(data, size);
+    return false;
+  }
+
+  if (verify_param_files &&
+      UpdateParamChecksum(PARAM_CHECKSUM_SEED, data + sizeof(param_bundle_header_t), size - sizeof(param_bundle_header_t)) != header->checksum) {
+    cerr << "Ignore parameter bundle (checksum mismatch) : " << param_bundle_path << endl;
+    UnmapParamFile(data, size);
+    return false;
+  }
+
+  for (i = 0; i < header->sections; i++) {
+    if (section[i].offset < table_end ||
+        section[i].offset % PARAM_SECTION_ALIGN != 0 ||
+        section[i].offset > size ||
+        section[i].size > size - section[i].offset ||
+        memchr(section[i].name, '\0', PARAM_SECTION_NAME_MAX) == NULL) {
+      cerr << "Ignore parameter bundle (broken section) : " << param_bundle_path << endl;
+      UnmapParamFile(data, size);
+      return false;
+    }
+  }
+
+  bundle_data = data;
+  bundle_section = section;
+  bundle_sections = header->sections;
+
+  return true;
+}
+
+
+//////////////////////
+//  区画の取得      //
+//////////////////////
+const void *
+GetParamSection( const char *name, size_t *size )
+{
+  unsigned int i;
+
+  for (i = 0; i < bundle_sections; i++) {
+    if (strcmp(bundle_section[i].name, name) == 0) {
+      *size = (size_t)bundle_section[i].size;
+      return bundle_data + bundle_section[i].offset;
+    }
+  }
+
+  return NULL;
+}
+
+
+const void *
+GetFixedParamSection( const char *name, size_t size )
+{
+  size_t section_size = 0;
+  const void *data = GetParamSection(name, &section_size);
+
+  return (section_size == size) ? data : NULL;
+}
+
+
+//////////////////////
+//  区画の登録      //
+//////////////////////
+void
+AddParamSection( const char *name, const void *data, size_t size )
+{
+  pending_section_t section;
+
+  if (!make_param_bundle) return;
+
+  if (strlen(name) >= (size_t)PARAM_SECTION_NAME_MAX) {
+    cerr << "Too long section name : " << name << endl;
+    exit(1);
+  }
+
+  section.name = name;
+  section.data = data;
+  section.size = size;
+  pending_section.push_back(section);
+}
+
+
+////////////////////////////////
+//  一括ファイルの書き出し    //
+////////////////////////////////
+void
+WriteParamBundle( void )
+{
+  param_bundle_header_t header;
+  vector<param_section_t> table(pending_section.size());
+  unsigned char padding[PARAM_SECTION_ALIGN * 2];
+  string temp_path = string(param_bundle_path) + ".tmp";
+  size_t offset, full, tail;
+  unsigned long long sum;
+  FILE *fp;
+  size_t i;
+
+  // 区画表の作成
+  offset = AlignSection(sizeof(param_bundle_header_t) + sizeof(param_section_t) * table.size());
+  for (i = 0; i < pending_section.size(); i++) {
+    memset(&table[i], 0, sizeof(param_section_t));
+    strcpy(table[i].name, pending_section[i].name.c_str());
+    table[i].offset = offset;
+    table[i].size = pending_section[i].size;
+    offset = AlignSection(offset + pending_section[i].size);
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PARAM_BUNDLE_MAGIC, sizeof(PARAM_BUNDLE_MAGIC));
+  header.version = PARAM_BUNDLE_VERSION;
+  header.byte_order = PARAM_BUNDLE_BYTE_ORDER;
+  header.sections = (unsigned int)table.size();
+  header.file_size = offset;
+
+#if defined (_WIN32)
+  if (fopen_s(&fp, temp_path.c_str(), "wb") != 0) fp = NULL;
+#else
+  fp = fopen(temp_path.c_str(), "wb");
+#endif
+  if (fp == NULL) {
+    cerr << "can not open -" << temp_path << "-" << endl;
+    exit(1);
+  }
+
+  // ヘッダは最後に書き直す
+  fwrite(&header, sizeof(header), 1, fp);
+  sum = PARAM_CHECKSUM_SEED;
+
+  // 区画表
+  if (!table.empty()) {
+    fwrite(&table[0], sizeof(param_section_t), table.size(), fp);
+    sum = UpdateParamChecksum(sum, (const unsigned char *)&table[0], sizeof(param_section_t) * table.size());
+  }
+  header.table_checksum = sum;
+  memset(padding, 0, sizeof(padding));
+  tail = AlignSection(sizeof(header) + sizeof(param_section_t) * table.size()) - sizeof(header) - sizeof(param_section_t) * table.size();
+  fwrite(padding, 1, tail, fp);
+  sum = UpdateParamChecksum(sum, padding, tail);
+
+  // 区画のデータ (末尾は0で埋めて境界に揃える)
+  for (i = 0; i < pending_section.size(); i++) {
+    const unsigned char *data = (const unsigned char *)pending_section[i].data;
+    size_t size = pending_section[i].size;
+
+    full = size & ~(sizeof(unsigned long long) - 1);
+    tail = AlignSection(size) - full;
+    fwrite(data, 1, full, fp);
+    sum = UpdateParamChecksum(sum, data, full);
+    memset(padding, 0, sizeof(padding));
+    memcpy(padding, data + full, size - full);
+    fwrite(padding, 1, tail, fp);
+    sum = UpdateParamChecksum(sum, padding, tail);
+  }
+
+  header.checksum = sum;
+  fseek(fp, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, fp);
+
+  if (ferror(fp) != 0) {
+    fclose(fp);
+    cerr << "Write Error : " << temp_path << endl;
+    exit(1);
+  }
+  fclose(fp);
+
+  // 起動中の他のプロセスが読みかけのファイルを開かないように置き換える
+#if defined (_WIN32)
+  remove(param_bundle_path);
+#endif
+  if (rename(temp_path.c_str(), param_bundle_path) != 0) {
+    cerr << "can not rename -" << temp_path << "- to -" << param_bundle_path << "-" << endl;
+    exit(1);
+  }
+
+  cerr << "Write parameter bundle : " << param_bundle_path << " (" << offset << " bytes, " << table.size() << " sections)" << endl;
+}
@@ -0,0 +1,93 @@
+#ifndef _PARAM_BUNDLE_H_
+#define _PARAM_BUNDLE_H_
+
+#include <cstddef>
+
+////////////////
+//    定数    //
+////////////////
+
+// 一括ファイルの形式の版 (区画の内容や構造体の配置を変えたら上げる)
+const unsigned int PARAM_BUNDLE_VERSION = 2;
+
+// 区画名の最大長 (終端文字を含む)
+const int PARAM_SECTION_NAME_MAX = 32;
+
+// 区画の先頭の境界
+const size_t PARAM_SECTION_ALIGN = 64;
+
+// チェックサムの初期値
+const unsigned long long PARAM_CHECKSUM_SEED = 0xCBF29CE484222325ULL;
+
+// 一括ファイルのヘッダ
+struct param_bundle_header_t {
+  char magic[8];                // "RAYPARAM"
+  unsigned int version;         // 形式の版
+  unsigned int byte_order;      // バイト順の確認用の値
+  unsigned int sections;        // 区画の数
+  unsigned int reserved;        // 予約
+  unsigned long long file_size; // ファイル全体の大きさ
+  unsigned long long checksum;  // ヘッダ以降のチェックサム (--verify-params の時に確認する)
+  unsigned long long table_checksum; // 区画表のチェックサム (読み込む度に確認する)
+};
+
+// 一括ファイルの区画表の要素
+struct param_section_t {
+  char name[PARAM_SECTION_NAME_MAX];  // 区画名
+  unsigned long long offset;          // ファイル先頭からの位置
+  unsigned long long size;            // 区画の大きさ
+};
+
+
+////////////////
+//    変数    //
+////////////////
+
+// 一括ファイルのパス
+extern char param_bundle_path[1024];
+
+
+//////////////
+//   関数   //
+//////////////
+
+// 一括ファイルを作成するモードの設定
+void SetMakeParamBundle( bool flag );
+
+// 一括ファイルを作成するモードか
+bool IsMakeParamBundle( void );
+
+// ファイル全体のチェックサムを確認するモードの設定
+void SetVerifyParamFiles( bool flag );
+
+// ファイル全体のチェックサムを確認するモードか
+bool IsVerifyParamFiles( void );
+
+// 一括ファイルを読み込み専用でメモリに割り当てる
+// ファイルがない, または壊れている場合はfalseを返し, テキストから読み込む
+// 起動時はヘッダと区画表だけを確認し, ファイル全体は確認するモードの時のみ確認する
+bool OpenParamBundle( void );
+
+// 区画nameの先頭を返す (区画がない場合はNULL)
+const void *GetParamSection( const char *name, size_t *size );
+
+// 大きさがsizeの区画nameの先頭を返す (区画がない, 大きさが違う場合はNULL)
+const void *GetFixedParamSection( const char *name, size_t size );
+
+// 一括ファイルに書き出す区画の登録 (作成するモードの時のみ)
+void AddParamSection( const char *name, const void *data, size_t size );
+
+// 登録した区画を一括ファイルに書き出す
+void WriteParamBundle( void );
+
+// ファイルを読み込み専用でメモリに割り当てる (開けない場合はNULL)
+// NNの重みファイルなど, 一括ファイル以外の固定形式のファイルにも使う
+const unsigned char *MapParamFile( const char *filename, size_t *size );
+
+// メモリへの割り当ての解除
+void UnmapParamFile( const unsigned char *data, size_t size );
+
+// チェックサムの更新 (8バイトごとのFNV-1a, sizeは8の倍数)
+unsigned long long UpdateParamChecksum( unsigned long long sum, const unsigned char *data, size_t size );
+
+#endif
@@ -248,9 +248,12 @@ UpdatePat3Stone( pattern *pat, int color, int pos )
 }
 
 //  md2
+template <int SIZE>
 void
 UpdateMD2Empty( pattern *pat, int pos )
 {
+  const int board_size = FixedBoardSize<SIZE>();
+
   pat[pos + NW].list[MD_2] &= 0xFF3FFF;
   pat[pos + N].list[MD_2] &= 0xFFCFFF;
   pat[pos + NE].list[MD_2] &= 0xFFF3FF;
@@ -265,9 +268,12 @@ UpdateMD2Empty( pattern *pat, int pos )
   pat[pos + WW].list[MD_2] &= 0xF3FFFF;
 }
 
+template <int SIZE>
 void
 UpdateMD2Stone( pattern *pat, int color, int pos )
 {
+  const int board_size = FixedBoardSize<SIZE>();
+
   pat[pos + NW].list[MD_2] |= update_mask[0][color];
   pat[pos + N].list[MD_2] |= update_mask[1][color];
   pat[pos + NE].list[MD_2] |= update_mask[2][color];
@@ -282,6 +288,16 @@ UpdateMD2Stone( pattern *pat, int color, int pos )
   pat[pos + WW].list[MD_2] |= update_mask[11][color];
 }
 
+//  md2の盤の大きさごとの実体化
+template void UpdateMD2Empty<0>( pattern *pat, int pos );
+template void UpdateMD2Empty<9>( pattern *pat, int pos );
+template void UpdateMD2Empty<13>( pattern *pat, int pos );
+template void UpdateMD2Empty<19>( pattern *pat, int pos );
+template void UpdateMD2Stone<0>( pattern *pat, int color, int pos );
+template void UpdateMD2Stone<9>( pattern *pat, int color, int pos );
+template void UpdateMD2Stone<13>( pattern *pat, int color, int pos );
+template void UpdateMD2Stone<19>( pattern *pat, int color, int pos );
+
 //  全部
 void
 UpdatePatternEmpty( pattern *pat, int pos )
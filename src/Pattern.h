@@ -40,7 +40,9 @@ void ClearPattern( pattern *pat );
 //  更新
 void UpdatePat3Empty( pattern *pat, int pos );
 void UpdatePat3Stone( pattern *pat, int color, int pos );
+template <int SIZE = 0>
 void UpdateMD2Empty( pattern *pat, int pos );
+template <int SIZE = 0>
 void UpdateMD2Stone( pattern *pat, int color, int pos );
 void UpdatePatternEmpty( pattern *pat, int pos );
 void UpdatePatternStone( pattern *pat, int color, int pos );
@@ -190,7 +190,7 @@ MD5Hash( unsigned long long md5 )
 //  データを探索  //
 ////////////////////
 int
-SearchIndex( index_hash_t *index, unsigned long long hash )
+SearchIndex( const index_hash_t *index, unsigned long long hash )
 {
   int key = TRANS20(hash);
   int i;
@@ -34,6 +34,6 @@ unsigned long long MD4Hash( unsigned int md4 );
 unsigned long long MD5Hash( unsigned long long int md5 );
 
 //  インデックスを探索
-int SearchIndex( index_hash_t *index, unsigned long long hash );
+int SearchIndex( const index_hash_t *index, unsigned long long hash );
 
 #endif	// _PATTTERNHASH_H_ 
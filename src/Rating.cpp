@@ -8,9 +8,12 @@
 #include <algorithm>
 #include <functional>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "Message.h"
 #include "Nakade.h"
+#include "ParamBundle.h"
 #include "Point.h"
 #include "Rating.h"
 #include "Semeai.h"
@@ -27,10 +30,17 @@ using namespace std;
 float po_tactical_features[TACTICAL_FEATURE_MAX];
 // 3x3パターンのγ値
 float po_pat3[PAT3_MAX];
-// MD2のパターンのγ値
-float po_md2[MD2_MAX];
-// 3x3とMD2のパターンのγ値の積
-float po_pattern[MD2_MAX];
+// MD2パターンの記載がない時の3x3パターンのγ値
+static float po_pattern_default[PAT3_MAX];
+// 3x3とMD2のパターンのγ値の積のハッシュ表
+// (MD2.txtに記載されたパターンのみを保持する, 一括ファイルがあればその上を直接参照する)
+static const po_pattern_entry_t *po_pattern_table;
+// テキストから読み込んだ時のハッシュ表の実体
+static vector<po_pattern_entry_t> po_pattern_storage;
+// ハッシュ表の大きさ - 1
+static unsigned int po_pattern_mask;
+// ハッシュ表の添字を求めるためのシフト量
+static int po_pattern_shift;
 // 学習した着手距離の特徴 
 float po_neighbor_orig[PREVIOUS_DISTANCE_MAX];
 // 補正した着手距離の特徴
@@ -82,12 +92,6 @@ unsigned int po_tactical_features_mask[F_MASK_MAX] = {
 };
 
 
-// MD2パターンが届く範囲
-static int neighbor[UPDATE_NUM];
-
-// コスミの位置
-static int cross[4];
-
 // 着手距離2, 3のγ値の補正
 double neighbor_bias = NEIGHBOR_BIAS;
 // 着手距離4のγ値の補正
@@ -100,37 +104,37 @@ double po_bias = PO_BIAS;
 
 //  γ読み込み
 static void InputPOGamma( void );
-static void InputMD2( const char *filename, float *ap );
+static bool InputPOGammaBundle( void );
+static void InputMD2( const char *filename, vector<pair<unsigned int, float> > &md2 );
 
+//  MD2パターンのハッシュ表の作成
+static void MakePoPatternTable( const vector<pair<unsigned int, float> > &md2 );
+//  MD2パターンのハッシュ表の設定
+static void SetPoPatternTable( const po_pattern_entry_t *table, unsigned int size );
 
 
-
-/////////////////
-// 近傍の設定  //
-/////////////////
-void
-SetNeighbor( void )
+////////////////////////////////////////
+//  3x3とMD2のパターンのγ値の積の取得  //
+////////////////////////////////////////
+static inline float
+PoPattern( unsigned int md2 )
 {
-  neighbor[ 0] = -2 * board_size;
-  neighbor[ 1] = - board_size - 1;
-  neighbor[ 2] = - board_size;
-  neighbor[ 3] = - board_size + 1;
-  neighbor[ 4] = -2;
-  neighbor[ 5] = -1;
-  neighbor[ 6] = 0;
-  neighbor[ 7] = 1;
-  neighbor[ 8] = 2;
-  neighbor[ 9] = board_size - 1;
-  neighbor[10] = board_size;
-  neighbor[11] = board_size + 1;
-  neighbor[12] = 2 * board_size;
-
-  cross[0] = -board_size - 1;
-  cross[1] = -board_size + 1;
-  cross[2] = board_size - 1;
-  cross[3] = board_size + 1;
+  const po_pattern_entry_t *table = po_pattern_table;
+  const unsigned int mask = po_pattern_mask;
+  unsigned int index = (md2 * 2654435761U) >> po_pattern_shift;
+
+  // 空きに当たるまで線形探索し, 見つからなければ3x3パターンのみのγ値
+  while (table[index].md2 != PO_PATTERN_EMPTY) {
+    if (table[index].md2 == md2) return table[index].gamma;
+    index = (index + 1) & mask;
+  }
+
+  return po_pattern_default[md2 & 0xFFFF];
 }
 
+
+
+
 //////////////
 //  初期化  //
 //////////////
@@ -266,46 +270,33 @@ InitializePoTacticalFeaturesSet( void )
 //////////////////////
 //  着手( rating )  // 
 //////////////////////
+template <int SIZE>
 int
 RatingMove( game_info_t *game, int color, std::mt19937_64 *mt )
 {
-  long long *rate = game->rate[color - 1];
-  long long *sum_rate_row = game->sum_rate_row[color - 1];
-  long long *sum_rate = &game->sum_rate[color - 1];
-  int y, pos;
-  long long rand_num;
+  rate_table_t *rate = &game->rate[color - 1];
+  int pos;
+  long long sum_rate, rand_num;
 
   // レートの部分更新
-  PartialRating(game, color, sum_rate, sum_rate_row, rate);
+  PartialRating<SIZE>(game, color, rate);
 
   // 合法手を選択するまでループ
   while (true){
-    if (*sum_rate == 0) return PASS;
-
-    rand_num = ((*mt)() % (*sum_rate)) + 1;
+    sum_rate = rate->sum;
+    if (sum_rate == 0) return PASS;
 
-    // 縦方向の位置を求める
-    y = board_start;
-    while (rand_num > sum_rate_row[y]){
-      rand_num -= sum_rate_row[y++];
-    }
+    rand_num = ((*mt)() % sum_rate) + 1;
 
-    // 横方向の位置を求める
-    pos = POS(board_start, y);
-    do{
-      rand_num -= rate[pos];
-      if (rand_num <= 0) break;
-      pos++;
-    } while (true);
+    // レートの累積値がrand_numに達する位置を求める
+    pos = SampleRate<SIZE>(rate, rand_num);
 
     // 選ばれた手が合法手ならループを抜け出し
     // そうでなければその箇所のレートを0にし, 手を選びなおす
-    if (IsLegalNotEye(game, pos, color)) {
+    if (IsLegalNotEye<SIZE>(game, pos, color)) {
       break;
     } else {
-      *sum_rate -= rate[pos];
-      sum_rate_row[y] -= rate[pos];
-      rate[pos] = 0;
+      UpdateRate(rate, pos, 0);
     }
   }
 
@@ -316,34 +307,38 @@ RatingMove( game_info_t *game, int color, std::mt19937_64 *mt )
 ////////////////////////////
 //  12近傍の座標を求める  //
 ////////////////////////////
+template <int SIZE>
 void
 Neighbor12( int previous_move, int distance_2[], int distance_3[], int distance_4[] )
 {
+  const int board_size = FixedBoardSize<SIZE>();
+
   // 着手距離2の座標
-  distance_2[0] = previous_move + neighbor[ 2];
-  distance_2[1] = previous_move + neighbor[ 5];
-  distance_2[2] = previous_move + neighbor[ 7];
-  distance_2[3] = previous_move + neighbor[10];
+  distance_2[0] = NORTH(previous_move);
+  distance_2[1] =  WEST(previous_move);
+  distance_2[2] =  EAST(previous_move);
+  distance_2[3] = SOUTH(previous_move);
 
   // 着手距離3の座標
-  distance_3[0] = previous_move + neighbor[ 1];
-  distance_3[1] = previous_move + neighbor[ 3];
-  distance_3[2] = previous_move + neighbor[ 9];
-  distance_3[3] = previous_move + neighbor[11];
+  distance_3[0] = NORTH_WEST(previous_move);
+  distance_3[1] = NORTH_EAST(previous_move);
+  distance_3[2] = SOUTH_WEST(previous_move);
+  distance_3[3] = SOUTH_EAST(previous_move);
 
   // 着手距離4の座標
-  distance_4[0] = previous_move + neighbor[ 0];
-  distance_4[1] = previous_move + neighbor[ 4];
-  distance_4[2] = previous_move + neighbor[ 8];
-  distance_4[3] = previous_move + neighbor[12];
+  distance_4[0] = previous_move - 2 * board_size;
+  distance_4[1] = previous_move - 2;
+  distance_4[2] = previous_move + 2;
+  distance_4[3] = previous_move + 2 * board_size;
 }
 
 
 //////////////////////////////
 //  直前の着手の周辺の更新  //
 //////////////////////////////
+template <int SIZE>
 void
-NeighborUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_rate_row, long long *rate, int *update, bool *flag, int index )
+NeighborUpdate( game_info_t *game, int color, rate_table_t *rate, int *update, bool *flag, int index )
 {
   int i, pos;
   double gamma;
@@ -371,26 +366,19 @@ NeighborUpdate( game_info_t *game, int color, long long *sum_rate, long long *su
     pos = update[i];
     if (game->candidates[pos]){
       if (flag[pos] && bias[i] == 1.0) continue;
-      self_atari_flag = PoCheckSelfAtari(game, color, pos);
-
-      // 元あったレートを消去
-      *sum_rate -= rate[pos];
-      sum_rate_row[board_y[pos]] -= rate[pos];
+      self_atari_flag = PoCheckSelfAtari<SIZE>(game, color, pos);
 
       if (!self_atari_flag){
-	rate[pos] = 0;
+	UpdateRate(rate, pos, 0);
       } else {
-	PoCheckCaptureAndAtari(game, color, pos);
+	PoCheckCaptureAndAtari<SIZE>(game, color, pos);
 
-	gamma = po_pattern[MD2(game->pat, pos)] * po_previous_distance[index];
+	gamma = PoPattern(MD2(game->pat, pos)) * po_previous_distance[index];
 	gamma *= po_tactical_set1[game->tactical_features1[pos]];
 	gamma *= po_tactical_set2[game->tactical_features2[pos]];
 	gamma *= bias[i];
-	rate[pos] = (long long)(gamma)+1;
-
 	// 新たに計算したレートを代入
-	*sum_rate += rate[pos];
-	sum_rate_row[board_y[pos]] += rate[pos];
+	UpdateRate(rate, pos, (long long)(gamma) + 1);
       }
 
       game->tactical_features1[pos] = 0;
@@ -404,8 +392,9 @@ NeighborUpdate( game_info_t *game, int color, long long *sum_rate, long long *su
 //////////////////////////
 //  ナカデの急所の更新  //
 //////////////////////////
+template <int SIZE>
 void
-NakadeUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_rate_row, long long *rate, int *nakade_pos, int nakade_num, bool *flag, int pm1 )
+NakadeUpdate( game_info_t *game, int color, rate_table_t *rate, int *nakade_pos, int nakade_num, bool *flag, int pm1 )
 {
   int i, pos, dis;
   double gamma;
@@ -414,29 +403,23 @@ NakadeUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_
   for (i = 0; i < nakade_num; i++) {
     pos = nakade_pos[i];
     if (pos != NOT_NAKADE && game->candidates[pos]){
-      self_atari_flag = PoCheckSelfAtari(game, color, pos);
-
-      // 元あったレートを消去
-      *sum_rate -= rate[pos];
-      sum_rate_row[board_y[pos]] -= rate[pos];
+      self_atari_flag = PoCheckSelfAtari<SIZE>(game, color, pos);
 
       if (!self_atari_flag) {
-	rate[pos] = 0;
+	UpdateRate(rate, pos, 0);
       } else {
-	PoCheckCaptureAndAtari(game, color, pos);
+	PoCheckCaptureAndAtari<SIZE>(game, color, pos);
 	dis = DIS(pm1, pos);
 	if (dis < 5) {
 	  gamma = 10000.0 * po_previous_distance[dis - 2];
 	} else {
 	  gamma = 10000.0;
 	}
-	gamma *= po_pattern[MD2(game->pat, pos)];
+	gamma *= PoPattern(MD2(game->pat, pos));
 	gamma *= po_tactical_set1[game->tactical_features1[pos]];
 	gamma *= po_tactical_set2[game->tactical_features2[pos]];
-	rate[pos] = (long long)(gamma) + 1;
-	// 新たに計算したレートを代入      
-	*sum_rate += rate[pos];
-	sum_rate_row[board_y[pos]] += rate[pos];     
+	// 新たに計算したレートを代入
+	UpdateRate(rate, pos, (long long)(gamma) + 1);
       }
 
       game->tactical_features1[pos] = 0;
@@ -450,8 +433,9 @@ NakadeUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_
 ////////////////////
 //  レートの更新  //
 ////////////////////
+template <int SIZE>
 void
-OtherUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_rate_row, long long *rate, int update_num, int *update, bool *flag )
+OtherUpdate( game_info_t *game, int color, rate_table_t *rate, int update_num, int *update, bool *flag )
 {
   int i, pos;
   double gamma;
@@ -462,25 +446,18 @@ OtherUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_r
     if (flag[pos]) continue;
 
     if (game->candidates[pos]) {
-      self_atari_flag = PoCheckSelfAtari(game, color, pos);
-
-      // 元あったレートを消去
-      *sum_rate -= rate[pos];
-      sum_rate_row[board_y[pos]] -= rate[pos];
+      self_atari_flag = PoCheckSelfAtari<SIZE>(game, color, pos);
 
       // パターン、戦術的特徴、距離のγ値
       if (!self_atari_flag) {
-	rate[pos] = 0;
+	UpdateRate(rate, pos, 0);
       } else {
-	PoCheckCaptureAndAtari(game, color, pos);
-	gamma = po_pattern[MD2(game->pat, pos)];
+	PoCheckCaptureAndAtari<SIZE>(game, color, pos);
+	gamma = PoPattern(MD2(game->pat, pos));
 	gamma *= po_tactical_set1[game->tactical_features1[pos]];
 	gamma *= po_tactical_set2[game->tactical_features2[pos]];
-	rate[pos] = (long long)(gamma) + 1;
-
 	// 新たに計算したレートを代入
-	*sum_rate += rate[pos];
-	sum_rate_row[board_y[pos]] += rate[pos];
+	UpdateRate(rate, pos, (long long)(gamma) + 1);
       }
 
       game->tactical_features1[pos] = 0;
@@ -495,9 +472,17 @@ OtherUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_r
 /////////////////////////////////
 //  MD2パターンの範囲内の更新  //
 /////////////////////////////////
+template <int SIZE>
 void
-Neighbor12Update( game_info_t *game, int color, long long *sum_rate, long long *sum_rate_row, long long *rate, int update_num, int *update, bool *flag )
+Neighbor12Update( game_info_t *game, int color, rate_table_t *rate, int update_num, int *update, bool *flag )
 {
+  const int board_size = FixedBoardSize<SIZE>();
+  // MD2パターンが届く範囲(盤の大きさを固定した時は定数)
+  const int neighbor[UPDATE_NUM] = {
+    -2 * board_size, -board_size - 1, -board_size, -board_size + 1,
+    -2, -1, 0, 1, 2,
+    board_size - 1, board_size, board_size + 1, 2 * board_size,
+  };
   int i, j, pos;
   double gamma;
   bool self_atari_flag;
@@ -508,25 +493,18 @@ Neighbor12Update( game_info_t *game, int color, long long *sum_rate, long long *
       if (flag[pos]) continue;
 
       if (game->candidates[pos]) {
-	self_atari_flag = PoCheckSelfAtari(game, color, pos);
-
-	// 元あったレートを消去
-	*sum_rate -= rate[pos];
-	sum_rate_row[board_y[pos]] -= rate[pos];
+	self_atari_flag = PoCheckSelfAtari<SIZE>(game, color, pos);
 
 	// パターン、戦術的特徴、距離のγ値
 	if (!self_atari_flag){
-	  rate[pos] = 0;
+	  UpdateRate(rate, pos, 0);
 	} else {
-	  PoCheckCaptureAndAtari(game, color, pos);
-	  gamma = po_pattern[MD2(game->pat, pos)];
+	  PoCheckCaptureAndAtari<SIZE>(game, color, pos);
+	  gamma = PoPattern(MD2(game->pat, pos));
 	  gamma *= po_tactical_set1[game->tactical_features1[pos]];
 	  gamma *= po_tactical_set2[game->tactical_features2[pos]];
-	  rate[pos] = (long long)(gamma) + 1;
-
 	  // 新たに計算したレートを代入
-	  *sum_rate += rate[pos];
-	  sum_rate_row[board_y[pos]] += rate[pos];
+	  UpdateRate(rate, pos, (long long)(gamma) + 1);
 	}
 
 	game->tactical_features1[pos] = 0;
@@ -542,12 +520,13 @@ Neighbor12Update( game_info_t *game, int color, long long *sum_rate, long long *
 ////////////////
 //  部分更新  //
 ////////////////
+template <int SIZE>
 void
-PartialRating( game_info_t *game, int color, long long *sum_rate, long long *sum_rate_row, long long *rate )
+PartialRating( game_info_t *game, int color, rate_table_t *rate )
 {
   int pm1 = PASS, pm2 = PASS, pm3 = PASS;
   int distance_2[4], distance_3[4], distance_4[4];
-  bool flag[BOARD_MAX] = { false };  
+  bool flag[FIXED_BOARD_MAX(SIZE)] = { false };  
   int *update_pos = game->update_pos[color];
   int *update_num = &game->update_num[color];
   int other = FLIP_COLOR(color);
@@ -567,47 +546,47 @@ PartialRating( game_info_t *game, int color, long long *sum_rate, long long *sum
   if (game->moves > 3) pm3 = game->record[game->moves - 3].pos;
 
   if (game->ko_move == game->moves - 2){
-    PoCheckCaptureAfterKo(game, color, update_pos, update_num);
+    PoCheckCaptureAfterKo<SIZE>(game, color, update_pos, update_num);
   }
 
   if (pm1 != PASS) {
-    Neighbor12(pm1, distance_2, distance_3, distance_4);
-    PoCheckFeatures(game, color, pm1, update_pos, update_num);
-    PoCheckRemove2Stones(game, color, update_pos, update_num);
+    Neighbor12<SIZE>(pm1, distance_2, distance_3, distance_4);
+    PoCheckFeatures<SIZE>(game, color, pm1, update_pos, update_num);
+    PoCheckRemove2Stones<SIZE>(game, color, update_pos, update_num);
 
     SearchNakade(game, &nakade_num, nakade_pos);
-    NakadeUpdate(game, color, sum_rate, sum_rate_row, rate, nakade_pos, nakade_num, flag, pm1);
+    NakadeUpdate<SIZE>(game, color, rate, nakade_pos, nakade_num, flag, pm1);
     // 着手距離2の更新
-    NeighborUpdate(game, color, sum_rate, sum_rate_row, rate, distance_2, flag, 0);
+    NeighborUpdate<SIZE>(game, color, rate, distance_2, flag, 0);
     // 着手距離3の更新
-    NeighborUpdate(game, color, sum_rate, sum_rate_row, rate, distance_3, flag, 1);
+    NeighborUpdate<SIZE>(game, color, rate, distance_3, flag, 1);
     // 着手距離4の更新
-    NeighborUpdate(game, color, sum_rate, sum_rate_row, rate, distance_4, flag, 2);
+    NeighborUpdate<SIZE>(game, color, rate, distance_4, flag, 2);
 
   }
 
   // 2手前の着手の12近傍の更新
-  if (pm2 != PASS) Neighbor12Update(game, color, sum_rate, sum_rate_row, rate, 1, &pm2, flag);
+  if (pm2 != PASS) Neighbor12Update<SIZE>(game, color, rate, 1, &pm2, flag);
   // 3手前の着手の12近傍の更新
-  if (pm3 != PASS) Neighbor12Update(game, color, sum_rate, sum_rate_row, rate, 1, &pm3, flag);
+  if (pm3 != PASS) Neighbor12Update<SIZE>(game, color, rate, 1, &pm3, flag);
 
   // 3, 5, 7
   for (int i = 0; i < 3; i++) {
     int n = (i + 1) * 2 + 1;
     if (game->moves > n)
-      PoCheckFeatures(game, color, game->record[game->moves - n].pos, update_pos, update_num);
+      PoCheckFeatures<SIZE>(game, color, game->record[game->moves - n].pos, update_pos, update_num);
   }
 
   // 以前の着手で戦術的特徴が現れた箇所の更新
-  OtherUpdate(game, color, sum_rate, sum_rate_row, rate, prev_feature, prev_feature_pos, flag);
+  OtherUpdate<SIZE>(game, color, rate, prev_feature, prev_feature_pos, flag);
   // 最近の自分の着手の時に戦術的特徴が現れた箇所の更新
-  OtherUpdate(game, color, sum_rate, sum_rate_row, rate, game->update_num[color], game->update_pos[color], flag);
+  OtherUpdate<SIZE>(game, color, rate, game->update_num[color], game->update_pos[color], flag);
   // 最近の相手の着手の時に戦術的特徴が現れた箇所の更新
-  OtherUpdate(game, color, sum_rate, sum_rate_row, rate, game->update_num[other], game->update_pos[other], flag);
+  OtherUpdate<SIZE>(game, color, rate, game->update_num[other], game->update_pos[other], flag);
   // 自分の着手で石を打ち上げた箇所のとその周囲の更新
-  Neighbor12Update(game, color, sum_rate, sum_rate_row, rate, game->capture_num[color], game->capture_pos[color], flag);
+  Neighbor12Update<SIZE>(game, color, rate, game->capture_num[color], game->capture_pos[color], flag);
   // 相手の着手で石を打ち上げられた箇所とその周囲の更新
-  Neighbor12Update(game, color, sum_rate, sum_rate_row, rate, game->capture_num[other], game->capture_pos[other], flag);
+  Neighbor12Update<SIZE>(game, color, rate, game->capture_num[other], game->capture_pos[other], flag);
 
 }
 
@@ -615,8 +594,9 @@ PartialRating( game_info_t *game, int color, long long *sum_rate, long long *sum
 ////////////////////
 //  レーティング  //
 ////////////////////
+template <int SIZE>
 void
-Rating( game_info_t *game, int color, long long *sum_rate, long long *sum_rate_row, long long *rate )
+Rating( game_info_t *game, int color, rate_table_t *rate )
 {
   int i, pos;
   int pm1 = PASS;
@@ -628,21 +608,21 @@ Rating( game_info_t *game, int color, long long *sum_rate, long long *sum_rate_r
 
   pm1 = game->record[game->moves - 1].pos;
 
-  PoCheckFeatures(game, color, pm1, update_pos, &update_num);
+  PoCheckFeatures<SIZE>(game, color, pm1, update_pos, &update_num);
   if (game->ko_move == game->moves - 2) {
-    PoCheckCaptureAfterKo(game, color, update_pos, &update_num);
+    PoCheckCaptureAfterKo<SIZE>(game, color, update_pos, &update_num);
   }
 
-  for (i = 0; i < pure_board_max; i++) {
+  for (i = 0; i < FixedPureBoardMax<SIZE>(); i++) {
     pos = onboard_pos[i];
-    if (game->candidates[pos] && IsLegalNotEye(game, pos, color)) {
-      self_atari_flag = PoCheckSelfAtari(game, color, pos);
-      PoCheckCaptureAndAtari(game, color, pos);
+    if (game->candidates[pos] && IsLegalNotEye<SIZE>(game, pos, color)) {
+      self_atari_flag = PoCheckSelfAtari<SIZE>(game, color, pos);
+      PoCheckCaptureAndAtari<SIZE>(game, color, pos);
 
       if (!self_atari_flag) {
-	rate[pos] = 0;
+	rate->point[pos] = 0;
       } else {
-	gamma = po_pattern[MD2(game->pat, pos)];
+	gamma = PoPattern(MD2(game->pat, pos));
 	gamma *= po_tactical_set1[game->tactical_features1[pos]];
 	gamma *= po_tactical_set2[game->tactical_features2[pos]];
 	if (pm1 != PASS) {
@@ -651,16 +631,16 @@ Rating( game_info_t *game, int color, long long *sum_rate, long long *sum_rate_r
 	    gamma *= po_previous_distance[dis - 2];
 	  }
 	}
-	rate[pos] = (long long)(gamma)+1;
+	rate->point[pos] = (long long)(gamma)+1;
       }
 
-      *sum_rate += rate[pos];
-      sum_rate_row[board_y[pos]] += rate[pos];
-
       game->tactical_features1[pos] = 0;
       game->tactical_features2[pos] = 0;
     }
   }
+
+  // 全ての座標のレートから各行と全体の合計値を求める
+  BuildRate<SIZE>(rate);
 }
 
 
@@ -668,18 +648,20 @@ Rating( game_info_t *game, int color, long long *sum_rate, long long *sum_rate_r
 /////////////////////////////////////////
 //  呼吸点が1つの連に対する特徴の判定  //
 /////////////////////////////////////////
+template <int SIZE>
 void
 PoCheckFeaturesLib1( game_info_t *game, int color, int id, int *update, int *update_num )
 {
+  const int board_size = FixedBoardSize<SIZE>();
   char *board = game->board;
   string_t *string = game->string;
-  int neighbor = string[id].neighbor[0];
+  int neighbor = FirstNeighbor(&string[id]);
   int lib, liberty;
   int other = FLIP_COLOR(color);
   bool contact = false;
 
   // 呼吸点が1つになった連の呼吸点を取り出す
-  lib = string[id].lib[0];
+  lib = FirstLiberty(&string[id]);
   liberty = lib;
 
   // 呼吸点の上下左右が敵石に接触しているか確認
@@ -716,7 +698,7 @@ PoCheckFeaturesLib1( game_info_t *game, int color, int id, int *update, int *upd
   if (string[id].size == 1) {
     while (neighbor != NEIGHBOR_END) {
       if (string[neighbor].libs == 1) {
-	lib = string[neighbor].lib[0];
+	lib = FirstLiberty(&string[neighbor]);
 	if (string[neighbor].size == 1) {
 	  game->tactical_features1[lib] |= po_tactical_features_mask[F_SAVE_CAPTURE1_1];
 	} else if (string[neighbor].size == 2) {
@@ -726,12 +708,12 @@ PoCheckFeaturesLib1( game_info_t *game, int color, int id, int *update, int *upd
 	}
 	update[(*update_num)++] = lib;
       }
-      neighbor = string[id].neighbor[neighbor];
+      neighbor = NextNeighbor(&string[id], neighbor);
     }
   } else if (string[id].size == 2) {
     while (neighbor != NEIGHBOR_END) {
       if (string[neighbor].libs == 1) {
-	lib = string[neighbor].lib[0];
+	lib = FirstLiberty(&string[neighbor]);
 	if (string[neighbor].size == 1) {
 	  if (IsSelfAtariCaptureForSimulation(game, lib, color, liberty)) {
 	    game->tactical_features1[lib] |= po_tactical_features_mask[F_SAVE_CAPTURE_SELF_ATARI];
@@ -745,12 +727,12 @@ PoCheckFeaturesLib1( game_info_t *game, int color, int id, int *update, int *upd
 	}
 	update[(*update_num)++] = lib;
       }
-      neighbor = string[id].neighbor[neighbor];
+      neighbor = NextNeighbor(&string[id], neighbor);
     }
   } else if (string[id].size >= 3) {
     while (neighbor != NEIGHBOR_END) {
       if (string[neighbor].libs == 1) {
-	lib = string[neighbor].lib[0];
+	lib = FirstLiberty(&string[neighbor]);
 	if (string[neighbor].size == 1) {
 	  if (IsSelfAtariCaptureForSimulation(game, lib, color, liberty)) {
 	    game->tactical_features1[lib] |= po_tactical_features_mask[F_SAVE_CAPTURE_SELF_ATARI];
@@ -764,7 +746,7 @@ PoCheckFeaturesLib1( game_info_t *game, int color, int id, int *update, int *upd
 	}
 	update[(*update_num)++] = lib;
       }
-      neighbor = string[id].neighbor[neighbor];
+      neighbor = NextNeighbor(&string[id], neighbor);
     }
   }
 
@@ -774,19 +756,21 @@ PoCheckFeaturesLib1( game_info_t *game, int color, int id, int *update, int *upd
 /////////////////////////////////////////
 //  呼吸点が2つの連に対する特徴の判定  //
 /////////////////////////////////////////
+template <int SIZE>
 void
 PoCheckFeaturesLib2( game_info_t *game, int color, int id, int *update, int *update_num )
 {
+  const int board_size = FixedBoardSize<SIZE>();
   int *string_id = game->string_id;
   string_t *string = game->string;
   char *board = game->board;
-  int neighbor = string[id].neighbor[0];
+  int neighbor = FirstNeighbor(&string[id]);
   int lib1, lib2;
   bool capturable1, capturable2;
 
   // 呼吸点が2つになった連の呼吸点を取り出す
-  lib1 = string[id].lib[0];
-  lib2 = string[id].lib[lib1];
+  lib1 = FirstLiberty(&string[id]);
+  lib2 = NextLiberty(&string[id], lib1);
 
   // 呼吸点の周囲が空点3つ, または呼吸点が3つ以上の自分の連に接続できるかで特徴を判定
   if (nb4_empty[Pat3(game->pat, lib1)] == 3 ||
@@ -828,7 +812,7 @@ PoCheckFeaturesLib2( game_info_t *game, int color, int id, int *update, int *upd
   // それぞれに対して, 特徴を判定する
   while (neighbor != NEIGHBOR_END) {
     if (string[neighbor].libs == 1) {
-      lib1 = string[neighbor].lib[0];
+      lib1 = FirstLiberty(&string[neighbor]);
       update[(*update_num)++] = lib1;
       if (string[neighbor].size <= 2) {
 	game->tactical_features1[lib1] |= po_tactical_features_mask[F_2POINT_CAPTURE_SMALL];
@@ -836,8 +820,8 @@ PoCheckFeaturesLib2( game_info_t *game, int color, int id, int *update, int *upd
 	game->tactical_features1[lib1] |= po_tactical_features_mask[F_2POINT_CAPTURE_LARGE];
       }
     } else if (string[neighbor].libs == 2) {
-      lib1 = string[neighbor].lib[0];
-      lib2 = string[neighbor].lib[lib1];
+      lib1 = FirstLiberty(&string[neighbor]);
+      lib2 = NextLiberty(&string[neighbor], lib1);
       update[(*update_num)++] = lib1;
       update[(*update_num)++] = lib2; 
       capturable1 = IsCapturableAtariForSimulation(game, lib1, color, neighbor);
@@ -866,7 +850,7 @@ PoCheckFeaturesLib2( game_info_t *game, int color, int id, int *update, int *upd
 	}
       }
     }
-    neighbor = string[id].neighbor[neighbor];
+    neighbor = NextNeighbor(&string[id], neighbor);
   }
 }
 
@@ -874,20 +858,22 @@ PoCheckFeaturesLib2( game_info_t *game, int color, int id, int *update, int *upd
 /////////////////////////////////////////
 //  呼吸点が3つの連に対する特徴の判定  //
 /////////////////////////////////////////
+template <int SIZE>
 void
 PoCheckFeaturesLib3( game_info_t *game, int color, int id, int *update, int *update_num )
 {
+  const int board_size = FixedBoardSize<SIZE>();
   int *string_id = game->string_id;
   string_t *string = game->string;
-  int neighbor = string[id].neighbor[0];
+  int neighbor = FirstNeighbor(&string[id]);
   char *board = game->board;
   int lib1, lib2, lib3;
   bool capturable1, capturable2;
 
   // 呼吸点が3つになった連の呼吸点を取り出す
-  lib1 = string[id].lib[0];
-  lib2 = string[id].lib[lib1];
-  lib3 = string[id].lib[lib2];
+  lib1 = FirstLiberty(&string[id]);
+  lib2 = NextLiberty(&string[id], lib1);
+  lib3 = NextLiberty(&string[id], lib2);
 
   // 呼吸点の周囲が空点3つ, または呼吸点が3つ以上の自分の連に接続できるかで特徴を判定
   if (nb4_empty[Pat3(game->pat, lib1)] == 3 ||
@@ -946,7 +932,7 @@ PoCheckFeaturesLib3( game_info_t *game, int color, int id, int *update, int *upd
   // それぞれに対して, 特徴を判定する
   while (neighbor != NEIGHBOR_END) {
     if (string[neighbor].libs == 1) {
-      lib1 = string[neighbor].lib[0];
+      lib1 = FirstLiberty(&string[neighbor]);
       update[(*update_num)++] = lib1;
       if (string[neighbor].size <= 2) {
 	game->tactical_features1[lib1] |= po_tactical_features_mask[F_3POINT_CAPTURE_SMALL];
@@ -954,9 +940,9 @@ PoCheckFeaturesLib3( game_info_t *game, int color, int id, int *update, int *upd
 	game->tactical_features1[lib1] |= po_tactical_features_mask[F_3POINT_CAPTURE_LARGE];
       }
     } else if (string[neighbor].libs == 2) {
-      lib1 = string[neighbor].lib[0];
+      lib1 = FirstLiberty(&string[neighbor]);
       update[(*update_num)++] = lib1;
-      lib2 = string[neighbor].lib[lib1];
+      lib2 = NextLiberty(&string[neighbor], lib1);
       update[(*update_num)++] = lib2;
       capturable1 = IsCapturableAtariForSimulation(game, lib1, color, neighbor);
       capturable2 = IsCapturableAtariForSimulation(game, lib2, color, neighbor);
@@ -984,9 +970,9 @@ PoCheckFeaturesLib3( game_info_t *game, int color, int id, int *update, int *upd
 	}
       }
     } else if (string[neighbor].libs == 3) {
-      lib1 = string[neighbor].lib[0];
-      lib2 = string[neighbor].lib[lib1];
-      lib3 = string[neighbor].lib[lib2];
+      lib1 = FirstLiberty(&string[neighbor]);
+      lib2 = NextLiberty(&string[neighbor], lib1);
+      lib3 = NextLiberty(&string[neighbor], lib2);
       update[(*update_num)++] = lib1;
       update[(*update_num)++] = lib2;
       update[(*update_num)++] = lib3;
@@ -1000,7 +986,7 @@ PoCheckFeaturesLib3( game_info_t *game, int color, int id, int *update, int *upd
 	game->tactical_features2[lib3] |= po_tactical_features_mask[F_3POINT_DAME_LARGE];
       }
     }
-    neighbor = string[id].neighbor[neighbor];
+    neighbor = NextNeighbor(&string[id], neighbor);
   }
 }
 
@@ -1008,9 +994,11 @@ PoCheckFeaturesLib3( game_info_t *game, int color, int id, int *update, int *upd
 //////////////////
 //  特徴の判定  //
 //////////////////
+template <int SIZE>
 void
 PoCheckFeatures( game_info_t *game, int color, int previous_move, int *update, int *update_num )
 {
+  const int board_size = FixedBoardSize<SIZE>();
   string_t *string = game->string;
   char *board = game->board;
   int *string_id = game->string_id;
@@ -1024,11 +1012,11 @@ PoCheckFeatures( game_info_t *game, int color, int previous_move, int *update, i
   if (board[NORTH(previous_move)] == color) {
     id = string_id[NORTH(previous_move)];
     if (string[id].libs == 1) {
-      PoCheckFeaturesLib1(game, color, id, update, update_num);
+      PoCheckFeaturesLib1<SIZE>(game, color, id, update, update_num);
     } else if (string[id].libs == 2) {
-      PoCheckFeaturesLib2(game, color, id, update, update_num);
+      PoCheckFeaturesLib2<SIZE>(game, color, id, update, update_num);
     } else if (string[id].libs == 3) {
-      PoCheckFeaturesLib3(game, color, id, update, update_num);
+      PoCheckFeaturesLib3<SIZE>(game, color, id, update, update_num);
     }
     check[checked++] = id;
   }
@@ -1038,11 +1026,11 @@ PoCheckFeatures( game_info_t *game, int color, int previous_move, int *update, i
     id = string_id[WEST(previous_move)];
     if (id != check[0]) {
       if (string[id].libs == 1) {
-	PoCheckFeaturesLib1(game, color, id, update, update_num);
+	PoCheckFeaturesLib1<SIZE>(game, color, id, update, update_num);
       } else if (string[id].libs == 2) {
-	PoCheckFeaturesLib2(game, color, id, update, update_num);
+	PoCheckFeaturesLib2<SIZE>(game, color, id, update, update_num);
       } else if (string[id].libs == 3) {
-	PoCheckFeaturesLib3(game, color, id, update, update_num);
+	PoCheckFeaturesLib3<SIZE>(game, color, id, update, update_num);
       }
     }
     check[checked++] = id;
@@ -1053,11 +1041,11 @@ PoCheckFeatures( game_info_t *game, int color, int previous_move, int *update, i
     id = string_id[EAST(previous_move)];
     if (id != check[0] && id != check[1]) {
       if (string[id].libs == 1) {
-	PoCheckFeaturesLib1(game, color, id, update, update_num);
+	PoCheckFeaturesLib1<SIZE>(game, color, id, update, update_num);
       } else if (string[id].libs == 2) {
-	PoCheckFeaturesLib2(game, color, id, update, update_num);
+	PoCheckFeaturesLib2<SIZE>(game, color, id, update, update_num);
       } else if (string[id].libs == 3) {
-	PoCheckFeaturesLib3(game, color, id, update, update_num);
+	PoCheckFeaturesLib3<SIZE>(game, color, id, update, update_num);
       }
     }
     check[checked++] = id;
@@ -1068,11 +1056,11 @@ PoCheckFeatures( game_info_t *game, int color, int previous_move, int *update, i
     id = string_id[SOUTH(previous_move)];
     if (id != check[0] && id != check[1] && id != check[2]) {
       if (string[id].libs == 1) {
-	PoCheckFeaturesLib1(game, color, id, update, update_num);
+	PoCheckFeaturesLib1<SIZE>(game, color, id, update, update_num);
       } else if (string[id].libs == 2) {
-	PoCheckFeaturesLib2(game, color, id, update, update_num);
+	PoCheckFeaturesLib2<SIZE>(game, color, id, update, update_num);
       } else if (string[id].libs == 3) {
-	PoCheckFeaturesLib3(game, color, id, update, update_num);
+	PoCheckFeaturesLib3<SIZE>(game, color, id, update, update_num);
       }
     }
   }
@@ -1083,9 +1071,11 @@ PoCheckFeatures( game_info_t *game, int color, int previous_move, int *update, i
 ////////////////////////
 //  劫を解消するトリ  //
 ////////////////////////
+template <int SIZE>
 void
 PoCheckCaptureAfterKo( game_info_t *game, int color, int *update, int *update_num )
 {
+  const int board_size = FixedBoardSize<SIZE>();
   string_t *string = game->string;
   char *board = game->board;
   int *string_id = game->string_id;
@@ -1099,7 +1089,7 @@ PoCheckCaptureAfterKo( game_info_t *game, int color, int *update, int *update_nu
   if (board[NORTH(previous_move_2)] == other) {
     id = string_id[NORTH(previous_move_2)];
     if (string[id].libs == 1) {
-      lib = string[id].lib[0];
+      lib = FirstLiberty(&string[id]);
       update[(*update_num)++] = lib;
       game->tactical_features1[lib] |= po_tactical_features_mask[F_CAPTURE_AFTER_KO];
     }
@@ -1110,7 +1100,7 @@ PoCheckCaptureAfterKo( game_info_t *game, int color, int *update, int *update_nu
   if (board[EAST(previous_move_2)] == other) {
     id = string_id[EAST(previous_move_2)];
     if (string[id].libs == 1 && check[0] != id) {
-      lib = string[id].lib[0];
+      lib = FirstLiberty(&string[id]);
       update[(*update_num)++] = lib;
       game->tactical_features1[lib] |= po_tactical_features_mask[F_CAPTURE_AFTER_KO];
     }
@@ -1121,7 +1111,7 @@ PoCheckCaptureAfterKo( game_info_t *game, int color, int *update, int *update_nu
   if (board[SOUTH(previous_move_2)] == other) {
     id = string_id[SOUTH(previous_move_2)];
     if (string[id].libs == 1 && check[0] != id && check[1] != id) {
-      lib = string[id].lib[0];
+      lib = FirstLiberty(&string[id]);
       update[(*update_num)++] = lib;
       game->tactical_features1[lib] |= po_tactical_features_mask[F_CAPTURE_AFTER_KO];
     }
@@ -1132,7 +1122,7 @@ PoCheckCaptureAfterKo( game_info_t *game, int color, int *update, int *update_nu
   if (board[WEST(previous_move_2)] == other) {
     id = string_id[WEST(previous_move_2)];
     if (string[id].libs == 1 && check[0] != id && check[1] != id && check[2] != id) {
-      lib = string[id].lib[0];
+      lib = FirstLiberty(&string[id]);
       update[(*update_num)++] = lib;
       game->tactical_features1[lib] |= po_tactical_features_mask[F_CAPTURE_AFTER_KO];
     }
@@ -1152,8 +1142,8 @@ PoCheckSnapBack( game_info_t *game, int color, int pos, int pos0 )
 
   int id = string_id[pos0];
   if (string[id].libs == 2) {
-    int lib0 = string[id].lib[0];
-    int lib1 = string[id].lib[lib0];
+    int lib0 = FirstLiberty(&string[id]);
+    int lib1 = NextLiberty(&string[id], lib0);
     if (IsNeighbor(lib0, lib1)) {
       int lib = (lib0 == pos) ? lib1 : lib0;
       int neighbor4[4];
@@ -1199,9 +1189,11 @@ PoCheckSnapBack( game_info_t *game, int color, int pos, int pos0 )
 //////////////////
 //  自己アタリ  //
 //////////////////
+template <int SIZE>
 bool
 PoCheckSelfAtari( game_info_t *game, int color, int pos )
 {
+  const int board_size = FixedBoardSize<SIZE>();
   char *board = game->board;
   string_t *string = game->string;
   int *string_id = game->string_id;
@@ -1229,7 +1221,7 @@ PoCheckSelfAtari( game_info_t *game, int color, int pos )
   if (board[NORTH(pos)] == color) {
     id = string_id[NORTH(pos)];
     if (string[id].libs > 2) return true;
-    lib = string[id].lib[0];
+    lib = FirstLiberty(&string[id]);
     count = 0;
     while (lib != LIBERTY_END) {
       if (lib != pos) {
@@ -1245,7 +1237,7 @@ PoCheckSelfAtari( game_info_t *game, int color, int pos )
 	  count++;
 	}
       }
-      lib = string[id].lib[lib];
+      lib = NextLiberty(&string[id], lib);
     }
     libs += count;
     size += string[id].size;
@@ -1261,7 +1253,7 @@ PoCheckSelfAtari( game_info_t *game, int color, int pos )
     id = string_id[WEST(pos)];
     if (already[0] != id) {
       if (string[id].libs > 2) return true;
-      lib = string[id].lib[0];
+      lib = FirstLiberty(&string[id]);
       count = 0;
       while (lib != LIBERTY_END) {
 	if (lib != pos) {
@@ -1277,7 +1269,7 @@ PoCheckSelfAtari( game_info_t *game, int color, int pos )
 	    count++;
 	  }
 	}
-	lib = string[id].lib[lib];
+	lib = NextLiberty(&string[id], lib);
       }
       libs += count;
       size += string[id].size;
@@ -1294,7 +1286,7 @@ PoCheckSelfAtari( game_info_t *game, int color, int pos )
     id = string_id[EAST(pos)];
     if (already[0] != id && already[1] != id) {
       if (string[id].libs > 2) return true;
-      lib = string[id].lib[0];
+      lib = FirstLiberty(&string[id]);
       count = 0;
       while (lib != LIBERTY_END) {
 	if (lib != pos) {
@@ -1310,7 +1302,7 @@ PoCheckSelfAtari( game_info_t *game, int color, int pos )
 	    count++;
 	  }
 	}
-	lib = string[id].lib[lib];
+	lib = NextLiberty(&string[id], lib);
       }
       libs += count;
       size += string[id].size;
@@ -1328,7 +1320,7 @@ PoCheckSelfAtari( game_info_t *game, int color, int pos )
     id = string_id[SOUTH(pos)];
     if (already[0] != id && already[1] != id && already[2] != id) {
       if (string[id].libs > 2) return true;
-      lib = string[id].lib[0];
+      lib = FirstLiberty(&string[id]);
       count = 0;
       while (lib != LIBERTY_END) {
 	if (lib != pos) {
@@ -1344,7 +1336,7 @@ PoCheckSelfAtari( game_info_t *game, int color, int pos )
 	    count++;
 	  }
 	}
-	lib = string[id].lib[lib];
+	lib = NextLiberty(&string[id], lib);
       }
       libs += count;
       size += string[id].size;
@@ -1392,9 +1384,11 @@ PoCheckSelfAtari( game_info_t *game, int color, int pos )
 //////////////////
 //  トリの判定  //
 //////////////////
+template <int SIZE>
 void
 PoCheckCaptureAndAtari( game_info_t *game, int color, int pos )
 {
+  const int board_size = FixedBoardSize<SIZE>();
   char *board = game->board;
   string_t *string = game->string;
   int *string_id = game->string_id;
@@ -1454,9 +1448,15 @@ PoCheckCaptureAndAtari( game_info_t *game, int color, int pos )
 ///////////////////////////////////
 //  2目抜かれたときのホウリコミ  //
 ///////////////////////////////////
+template <int SIZE>
 void
 PoCheckRemove2Stones( game_info_t *game, int color, int *update, int *update_num )
 {
+  const int board_size = FixedBoardSize<SIZE>();
+  // コスミの位置
+  const int cross[4] = {
+    -board_size - 1, -board_size + 1, board_size - 1, board_size + 1,
+  };
   int i, rm1, rm2, check;
   int other = FLIP_COLOR(color);
 
@@ -1498,6 +1498,28 @@ PoCheckRemove2Stones( game_info_t *game, int color, int *update, int *update_num
 }
 
 
+//////////////////////////////////////////
+//  盤の大きさごとのテンプレートの実体化  //
+//////////////////////////////////////////
+#define INSTANTIATE_RATING(size) \
+  template int RatingMove<size>( game_info_t *game, int color, std::mt19937_64 *mt ); \
+  template void Rating<size>( game_info_t *game, int color, rate_table_t *rate ); \
+  template void PartialRating<size>( game_info_t *game, int color, rate_table_t *rate ); \
+  template void PoCheckFeaturesLib1<size>( game_info_t *game, int color, int id, int *update, int *update_num ); \
+  template void PoCheckFeaturesLib2<size>( game_info_t *game, int color, int id, int *update, int *update_num ); \
+  template void PoCheckFeaturesLib3<size>( game_info_t *game, int color, int id, int *update, int *update_num ); \
+  template void PoCheckFeatures<size>( game_info_t *game, int color, int previous_move, int *update, int *update_num ); \
+  template void PoCheckCaptureAfterKo<size>( game_info_t *game, int color, int *update, int *update_num ); \
+  template bool PoCheckSelfAtari<size>( game_info_t *game, int color, int pos ); \
+  template void PoCheckCaptureAndAtari<size>( game_info_t *game, int color, int pos ); \
+  template void PoCheckRemove2Stones<size>( game_info_t *game, int color, int *update, int *update_num );
+
+INSTANTIATE_RATING(0)
+INSTANTIATE_RATING(9)
+INSTANTIATE_RATING(13)
+INSTANTIATE_RATING(19)
+
+
 //////////////////
 //  γ読み込み  //
 //////////////////
@@ -1507,6 +1529,7 @@ InputPOGamma( void )
   int i;
   string po_parameters_path = po_params_path;
   string path;
+  vector<pair<unsigned int, float> > md2;
 
 #if defined (_WIN32)
   po_parameters_path += '\\';
@@ -1514,13 +1537,33 @@ InputPOGamma( void )
   po_parameters_path += '/';
 #endif
 
-  // 戦術的特徴の読み込み
-  path = po_parameters_path + "TacticalFeature.txt";
-  InputTxtFLT(path.c_str(), po_tactical_features, TACTICAL_FEATURE_MAX);
+  // 一括ファイルがなければテキストから読み込む
+  if (!InputPOGammaBundle()) {
+    // 戦術的特徴の読み込み
+    path = po_parameters_path + "TacticalFeature.txt";
+    InputTxtFLT(path.c_str(), po_tactical_features, TACTICAL_FEATURE_MAX);
+
+    // 直前の着手からの距離の読み込み
+    path = po_parameters_path + "PreviousDistance.txt";
+    InputTxtFLT(path.c_str(), po_neighbor_orig, PREVIOUS_DISTANCE_MAX);
+
+    // 3x3のパターンの読み込み
+    path = po_parameters_path + "Pat3.txt";
+    InputTxtFLT(path.c_str(), po_pat3, PAT3_MAX);
+
+    // マンハッタン距離2のパターンの読み込み
+    path = po_parameters_path + "MD2.txt";
+    InputMD2(path.c_str(), md2);
+
+    // 3x3とMD2のパターンをまとめる
+    MakePoPatternTable(md2);
+  }
 
-  // 直前の着手からの距離の読み込み
-  path = po_parameters_path + "PreviousDistance.txt";
-  InputTxtFLT(path.c_str(), po_neighbor_orig, PREVIOUS_DISTANCE_MAX);
+  // 一括ファイルを作成する時の書き出し対象
+  AddParamSection("po/TacticalFeature", po_tactical_features, sizeof(po_tactical_features));
+  AddParamSection("po/PreviousDistance", po_neighbor_orig, sizeof(po_neighbor_orig));
+  AddParamSection("po/Pat3", po_pat3, sizeof(po_pat3));
+  AddParamSection("po/PatternTable", po_pattern_table, sizeof(po_pattern_entry_t) * (po_pattern_mask + 1));
 
   // 直前の着手からの距離のγを補正して出力
   for (i = 0; i < PREVIOUS_DISTANCE_MAX - 1; i++) {
@@ -1528,18 +1571,47 @@ InputPOGamma( void )
   }
   po_previous_distance[2] = (float)(po_neighbor_orig[2] * jump_bias);
 
-  // 3x3のパターンの読み込み
-  path = po_parameters_path + "Pat3.txt";
-  InputTxtFLT(path.c_str(), po_pat3, PAT3_MAX);
+  // 記載のないMD2パターンのγ値は1.0として扱う
+  for (i = 0; i < PAT3_MAX; i++) {
+    po_pattern_default[i] = (float)(po_pat3[i] * 100.0);
+  }
+}
+
 
-  // マンハッタン距離2のパターンの読み込み
-  path = po_parameters_path + "MD2.txt";
-  InputMD2(path.c_str(), po_md2);
+////////////////////////////////
+//  γ読み込み (一括ファイル)  //
+////////////////////////////////
+static bool
+InputPOGammaBundle( void )
+{
+  const void *tactical_features, *neighbor, *pat3, *table;
+  size_t table_size = 0;
+  unsigned int size;
+
+  tactical_features = GetFixedParamSection("po/TacticalFeature", sizeof(po_tactical_features));
+  neighbor = GetFixedParamSection("po/PreviousDistance", sizeof(po_neighbor_orig));
+  pat3 = GetFixedParamSection("po/Pat3", sizeof(po_pat3));
+  table = GetParamSection("po/PatternTable", &table_size);
+
+  if (tactical_features == NULL || neighbor == NULL || pat3 == NULL || table == NULL) {
+    return false;
+  }
 
-  // 3x3とMD2のパターンをまとめる
-  for (i = 0; i < MD2_MAX; i++){
-    po_pattern[i] = (float)(po_md2[i] * po_pat3[i & 0xFFFF] * 100.0);
+  // ハッシュ表の大きさは2のべき乗
+  size = (unsigned int)(table_size / sizeof(po_pattern_entry_t));
+  if (size < 2 || (size & (size - 1)) != 0 ||
+      table_size != sizeof(po_pattern_entry_t) * size) {
+    return false;
   }
+
+  memcpy(po_tactical_features, tactical_features, sizeof(po_tactical_features));
+  memcpy(po_neighbor_orig, neighbor, sizeof(po_neighbor_orig));
+  memcpy(po_pat3, pat3, sizeof(po_pat3));
+
+  // ハッシュ表は一括ファイル上のものをそのまま使う
+  SetPoPatternTable((const po_pattern_entry_t *)table, size);
+
+  return true;
 }
 
 
@@ -1547,14 +1619,13 @@ InputPOGamma( void )
 //  γ読み込み MD2  //
 //////////////////////
 static void
-InputMD2( const char *filename, float *ap )
+InputMD2( const char *filename, vector<pair<unsigned int, float> > &md2 )
 {
   FILE *fp;
-  int i;
   int index;
   float rate;
 
-  for (i = 0; i < MD2_MAX; i++) ap[i] = 1.0;
+  md2.clear();
 
 #if defined (_WIN32)
   errno_t err;
@@ -1564,7 +1635,7 @@ InputMD2( const char *filename, float *ap )
     cerr << "can not open -" << filename << "-" << endl;
   }
   while (fscanf_s(fp, "%d%f", &index, &rate) != EOF) {
-    ap[index] = rate;
+    if (index >= 0 && index < MD2_MAX) md2.push_back(make_pair((unsigned int)index, rate));
   }
 #else
   fp = fopen(filename, "r");
@@ -1572,12 +1643,64 @@ InputMD2( const char *filename, float *ap )
     cerr << "can not open -" << filename << "-" << endl;
   }
   while (fscanf(fp, "%d%f", &index, &rate) != EOF) {
-    ap[index] = rate;
+    if (index >= 0 && index < MD2_MAX) md2.push_back(make_pair((unsigned int)index, rate));
   }
 #endif
 }
 
 
+//////////////////////////////////////
+//  MD2パターンのハッシュ表の作成  //
+//////////////////////////////////////
+static void
+MakePoPatternTable( const vector<pair<unsigned int, float> > &md2 )
+{
+  unsigned int size = 1024, mask, index;
+  po_pattern_entry_t empty;
+  size_t i;
+
+  // 負荷率が1/2以下になる大きさを確保
+  while (size < md2.size() * 2) {
+    size <<= 1;
+  }
+  mask = size - 1;
+
+  empty.md2 = PO_PATTERN_EMPTY;
+  empty.gamma = 0.0f;
+  po_pattern_storage.assign(size, empty);
+  SetPoPatternTable(&po_pattern_storage[0], size);
+
+  // 同じパターンが複数回現れた場合は後の値で上書きする
+  for (i = 0; i < md2.size(); i++) {
+    index = (md2[i].first * 2654435761U) >> po_pattern_shift;
+    while (po_pattern_storage[index].md2 != PO_PATTERN_EMPTY &&
+	   po_pattern_storage[index].md2 != md2[i].first) {
+      index = (index + 1) & mask;
+    }
+    po_pattern_storage[index].md2 = md2[i].first;
+    po_pattern_storage[index].gamma = (float)(md2[i].second * po_pat3[md2[i].first & 0xFFFF] * 100.0);
+  }
+}
+
+
+//////////////////////////////////////
+//  MD2パターンのハッシュ表の設定  //
+//////////////////////////////////////
+static void
+SetPoPatternTable( const po_pattern_entry_t *table, unsigned int size )
+{
+  int bits = 0;
+
+  while ((1U << bits) < size) {
+    bits++;
+  }
+
+  po_pattern_table = table;
+  po_pattern_mask = size - 1;
+  po_pattern_shift = 32 - bits;
+}
+
+
 void
 AnalyzePoRating( game_info_t *game, int color, double rate[] )
 {
@@ -1645,7 +1768,7 @@ AnalyzePoRating( game_info_t *game, int color, double rate[] )
     
     gamma *= po_tactical_set1[game->tactical_features1[pos]];
     gamma *= po_tactical_set2[game->tactical_features2[pos]];
-    gamma *= po_pattern[MD2(game->pat, pos)];
+    gamma *= PoPattern(MD2(game->pat, pos));
     
     rate[i] = (long long int)gamma + 1;
   }
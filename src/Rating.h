@@ -111,6 +111,15 @@ const int UPDATE_NUM = 13;
 
 const int F_MASK_MAX = 30;
 
+// MD2パターンのハッシュ表の空きを表す値
+const unsigned int PO_PATTERN_EMPTY = 0xFFFFFFFF;
+
+// MD2パターンのハッシュ表の要素
+struct po_pattern_entry_t {
+  unsigned int md2;  // MD2パターン
+  float gamma;       // 3x3とMD2のパターンのγ値の積
+};
+
 // Simulation Parameter
 const double NEIGHBOR_BIAS = 7.52598;
 const double JUMP_BIAS = 4.63207;
@@ -123,8 +132,6 @@ const double PO_BIAS = 1.66542;
 extern float po_tactical_features[TACTICAL_FEATURE_MAX];
 extern float po_neighbor8[PREVIOUS_DISTANCE_MAX];
 extern float po_pat3[PAT3_MAX];
-extern float po_md2[MD2_MAX];
-extern float po_pattern[MD2_MAX];
 extern float po_tactical_set1[PO_TACTICALS_MAX1];
 extern float po_tactical_set2[PO_TACTICALS_MAX2];
 
@@ -137,9 +144,6 @@ extern unsigned int po_tactical_features_mask[F_MASK_MAX];
 //  関数  //
 ////////////
 
-//  MD2に収まる座標の計算
-void SetNeighbor( void );
-
 //  初期化
 void InitializeRating( void );
 
@@ -147,36 +151,47 @@ void InitializeRating( void );
 void InitializePoTacticalFeaturesSet( void );
 
 //  着手(Elo Rating)
+template <int SIZE = 0>
 int RatingMove( game_info_t *game, int color, std::mt19937_64 *mt);
 
 //  レーティング 
-void Rating( game_info_t *game, int color, long long *sum_rate, long long *sum_rate_row, long long *rate );
+template <int SIZE = 0>
+void Rating( game_info_t *game, int color, rate_table_t *rate );
 
 //  レーティング 
-void PartialRating( game_info_t *game, int color, long long *sum_rate, long long *sum_rate_row, long long *rate );
+template <int SIZE = 0>
+void PartialRating( game_info_t *game, int color, rate_table_t *rate );
 
 //  呼吸点が1つの連に対する特徴の判定  
+template <int SIZE = 0>
 void PoCheckFeaturesLib1( game_info_t *game, int color, int id, int *update, int *update_num );
 
 //  呼吸点が2つの連に対する特徴の判定  
+template <int SIZE = 0>
 void PoCheckFeaturesLib2( game_info_t *game, int color, int id, int *update, int *update_num );
 
 //  呼吸点が3つの連に対する特徴の判定  
+template <int SIZE = 0>
 void PoCheckFeaturesLib3( game_info_t *game, int color, int id, int *update, int *update_num );
 
 //  特徴の判定
+template <int SIZE = 0>
 void PoCheckFeatures( game_info_t *game, int color, int previous_move, int *update, int *update_num );
 
 //  劫を解消するトリの判定
+template <int SIZE = 0>
 void PoCheckCaptureAfterKo( game_info_t *game, int color, int *update, int *update_num );
 
 //  自己アタリの判定
+template <int SIZE = 0>
 bool PoCheckSelfAtari( game_info_t *game, int color, int pos );
 
 //  トリとアタリの判定
+template <int SIZE = 0>
 void PoCheckCaptureAndAtari( game_info_t *game, int color, int pos );
 
 //  2目の抜き後に対するホウリコミ   
+template <int SIZE = 0>
 void PoCheckRemove2Stones( game_info_t *game, int color, int *update, int *update_num );
 
 //  現局面の評価値
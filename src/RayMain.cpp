@@ -7,6 +7,7 @@
 #include "Command.h"
 #include "GoBoard.h"
 #include "Gtp.h"
+#include "ParamBundle.h"
 #include "PatternHash.h"
 #include "Rating.h"
 #include "Semeai.h"
@@ -47,22 +48,48 @@ main( int argc, char **argv )
 #if defined (_WIN32)
   sprintf_s(uct_params_path, 1024, "%s\\uct_params", program_path);
   sprintf_s(po_params_path, 1024, "%s\\sim_params", program_path);
+  sprintf_s(param_bundle_path, 1024, "%s\\params.bin", program_path);
 #else
   sprintf(uct_params_path, "%s/uct_params", program_path);
   sprintf(po_params_path, "%s/sim_params", program_path);
+  sprintf(param_bundle_path, "%s/params.bin", program_path);
 #endif
   // コマンドライン引数の解析  
   AnalyzeCommand(argc, argv);
 
   // 各種初期化
   InitializeConst();
+
+  // NNの重みファイルを変換して終了
+  if (IsMakeNNModel()) {
+    return MakeNNModel() ? 0 : 1;
+  }
+
+  // NNの重みの読み込みはパターンなどの初期化と並行して行う
+  if (!IsMakeParamBundle() && !IsNNCalibration()) {
+    StartReadWeights();
+  }
+
+  OpenParamBundle();
   InitializeRating();
   InitializeUctRating();
+
+  // パラメータの一括ファイルを作成して終了
+  if (IsMakeParamBundle()) {
+    WriteParamBundle();
+    return 0;
+  }
+
+  // NNのINT8化の較正をして終了
+  if (IsNNCalibration()) {
+    return CalibrateNN() ? 0 : 1;
+  }
+
+  // ハッシュ表はUCT探索の初期設定で探索スレッドから配置するので先に確保する
+  InitializeHash();
   InitializeUctSearch();
   InitializeSearchSetting();
-  InitializeHash();
   InitializeUctHash();
-  SetNeighbor();
 
   // GTP
   GTP_main();
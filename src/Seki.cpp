@@ -9,11 +9,21 @@ using namespace std;
 
 
 
+// セキの箇所をビット集合に加える
+static inline void
+AddSeki( unsigned long long seki[], int pos )
+{
+  int index = onboard_index[pos];
+
+  seki[index >> 6] |= 1ULL << (index & 63);
+}
+
+
 //////////////////
 //  セキの判定  //
 //////////////////
 void
-CheckSeki( game_info_t *game, bool seki[] )
+CheckSeki( game_info_t *game, unsigned long long seki[] )
 {
   int i, j, k, pos, id;
   char *board = game->board;
@@ -44,8 +54,8 @@ CheckSeki( game_info_t *game, bool seki[] )
     // 自己アタリを打たないので次を調べる
     if (string[i].size >= 6) continue;
 
-    lib1 = string[i].lib[0];
-    lib2 = string[i].lib[lib1];
+    lib1 = FirstLiberty(&string[i]);
+    lib2 = NextLiberty(&string[i], lib1);
     // 連の持つ呼吸点がともにセキの候補
     if (seki_candidate[lib1] &&
 	seki_candidate[lib2]) {
@@ -93,20 +103,21 @@ CheckSeki( game_info_t *game, bool seki[] )
       }
 
       if (lib1_ids == 1 && lib2_ids == 1) {
-	neighbor1_lib = string[lib1_id[0]].lib[0];
+	neighbor1_lib = FirstLiberty(&string[lib1_id[0]]);
 	if (neighbor1_lib == lib1 ||
 	    neighbor1_lib == lib2) {
-	  neighbor1_lib = string[lib1_id[0]].lib[neighbor1_lib];
+	  neighbor1_lib = NextLiberty(&string[lib1_id[0]], neighbor1_lib);
 	}
-	neighbor2_lib = string[lib2_id[0]].lib[0];
+	neighbor2_lib = FirstLiberty(&string[lib2_id[0]]);
 	if (neighbor2_lib == lib1 ||
 	    neighbor2_lib == lib2) {
-	  neighbor2_lib = string[lib2_id[0]].lib[neighbor2_lib];
+	  neighbor2_lib = NextLiberty(&string[lib2_id[0]], neighbor2_lib);
 	}
 	if (neighbor1_lib == neighbor2_lib) {
 	  if (eye_condition[Pat3(game->pat, neighbor1_lib)] != E_NOT_EYE) {
-	    seki[lib1] = seki[lib2] = true;
-	    seki[neighbor1_lib] = true;
+	    AddSeki(seki, lib1);
+	    AddSeki(seki, lib2);
+	    AddSeki(seki, neighbor1_lib);
 	  }
 	} else if (eye_condition[Pat3(game->pat, neighbor1_lib)] == E_COMPLETE_HALF_EYE &&
 		   eye_condition[Pat3(game->pat, neighbor2_lib)] == E_COMPLETE_HALF_EYE) {
@@ -136,8 +147,10 @@ CheckSeki( game_info_t *game, bool seki[] )
 	    }
 	  }
 	  if (tmp_id1 == tmp_id2) {
-	    seki[lib1] = seki[lib2] = true;
-	    seki[neighbor1_lib] = seki[neighbor2_lib] = true;	    
+	    AddSeki(seki, lib1);
+	    AddSeki(seki, lib2);
+	    AddSeki(seki, neighbor1_lib);
+	    AddSeki(seki, neighbor2_lib);
 	  }
 	}
       }
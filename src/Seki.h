@@ -4,7 +4,8 @@
 #include "GoBoard.h"
 
 // セキの判定
-void CheckSeki( game_info_t *game, bool seki[] );
+// セキの箇所を盤上の位置のインデックス(onboard_index)のビット集合sekiに加える
+void CheckSeki( game_info_t *game, unsigned long long seki[] );
 
 void PrintSeki( game_info_t *game );
 
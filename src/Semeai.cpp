@@ -40,19 +40,19 @@ IsCapturableAtari( const game_info_t *game, int pos, int color, int opponent_pos
   id = string_id[opponent_pos];
 
   // 周囲に取り返せる石があれば安全
-  neighbor = string[id].neighbor[0];
+  neighbor = FirstNeighbor(&string[id]);
   while (neighbor != NEIGHBOR_END) {
     if (string[neighbor].libs == 1) {
       return false;
     }
-    neighbor = string[id].neighbor[neighbor];
+    neighbor = NextNeighbor(&string[id], neighbor);
   }
 
-  if (!IsLegal(&capturable_game, string[string_id[opponent_pos]].lib[0], other)) {
+  if (!IsLegal(&capturable_game, FirstLiberty(&string[string_id[opponent_pos]]), other)) {
     return true;
   }
   // 逃げるつもりでダメに打つ
-  PutStone(&capturable_game, string[string_id[opponent_pos]].lib[0], other);
+  PutStone(&capturable_game, FirstLiberty(&string[string_id[opponent_pos]]), other);
 
   libs = string[string_id[opponent_pos]].libs;
 
@@ -88,18 +88,18 @@ CheckOiotoshi( const game_info_t *game, int pos, int color, int opponent_pos )
   string_id = oiotoshi_game.string_id;
   id = string_id[opponent_pos];
 
-  neighbor = string[id].neighbor[0];
+  neighbor = FirstNeighbor(&string[id]);
   while (neighbor != NEIGHBOR_END) {
     if (string[neighbor].libs == 1) {
       return -1;
     }
-    neighbor = string[id].neighbor[neighbor];
+    neighbor = NextNeighbor(&string[id], neighbor);
   }
 
-  if (!IsLegal(&oiotoshi_game, string[string_id[opponent_pos]].lib[0], other)) {
+  if (!IsLegal(&oiotoshi_game, FirstLiberty(&string[string_id[opponent_pos]]), other)) {
     return -1;
   }
-  PutStone(&oiotoshi_game, string[string_id[opponent_pos]].lib[0], other);
+  PutStone(&oiotoshi_game, FirstLiberty(&string[string_id[opponent_pos]]), other);
 
   if (string[string_id[opponent_pos]].libs == 1) {
     num = string[string_id[opponent_pos]].size;
@@ -116,7 +116,7 @@ int
 CapturableCandidate( const game_info_t *game, int id )
 {
   const string_t *string = game->string;
-  int neighbor = string[id].neighbor[0];
+  int neighbor = FirstNeighbor(&string[id]);
   bool flag = false;
   int capturable_pos = -1;
 
@@ -129,11 +129,11 @@ CapturableCandidate( const game_info_t *game, int id )
 	if (flag) {
 	  return -1;
 	}
-	capturable_pos = string[neighbor].lib[0];
+	capturable_pos = FirstLiberty(&string[neighbor]);
 	flag = true;
       }
     }
-    neighbor = string[id].neighbor[neighbor];
+    neighbor = NextNeighbor(&string[id], neighbor);
   }
 
   return capturable_pos;
@@ -146,9 +146,9 @@ CapturableCandidate( const game_info_t *game, int id )
 bool
 IsDeadlyExtension( const game_info_t *game, int color, int id )
 {
-  game_info_t search_game;
+  game_info_t *search_game;
   int other = FLIP_COLOR(color);
-  int pos = game->string[id].lib[0];
+  int pos = FirstLiberty(&game->string[id]);
   bool flag = false;
 
   if (nb4_empty[Pat3(game->pat, pos)] == 0 &&
@@ -156,13 +156,16 @@ IsDeadlyExtension( const game_info_t *game, int color, int id )
     return true;
   }
 
-  CopyGame(&search_game, game);
-  PutStone(&search_game, pos, other);
+  // CopyGameはコピー先の連の数と着手の記録を参照するので, 初期化した領域を使う
+  search_game = AllocateGame();
+  CopyGame(search_game, game);
+  PutStone(search_game, pos, other);
 
-  if (search_game.string[search_game.string_id[pos]].libs == 1) {
+  if (search_game->string[search_game->string_id[pos]].libs == 1) {
     flag = true;
   }
 
+  FreeGame(search_game);
 
   return flag;
 }
@@ -175,13 +178,13 @@ bool
 IsCapturableNeighborNone( const game_info_t *game, int id )
 {
   const string_t *string = game->string;
-  int neighbor = string[id].neighbor[0];
+  int neighbor = FirstNeighbor(&string[id]);
 
   while (neighbor != NEIGHBOR_END) {
     if (string[neighbor].libs == 1) {
       return false;
     }
-    neighbor = string[id].neighbor[neighbor];
+    neighbor = NextNeighbor(&string[id], neighbor);
   }
 
   return true;
@@ -267,10 +270,10 @@ IsCapturableAtariForSimulation( const game_info_t *game, int pos, int color, int
   int connect_libs = 0;
   int tmp_id;
 
-  lib = string[id].lib[0];
+  lib = FirstLiberty(&string[id]);
 
   if (lib == pos) {
-    lib = string[id].lib[lib];
+    lib = NextLiberty(&string[id], lib);
   }
 
   index_distance = lib - pos;
@@ -452,7 +455,7 @@ IsSelfAtari( const game_info_t *game, int color, int pos )
   if (board[NORTH(pos)] == color) {
     id = string_id[NORTH(pos)];
     if (string[id].libs > 2) return false;
-    lib = string[id].lib[0];
+    lib = FirstLiberty(&string[id]);
     count = 0;
     while (lib != LIBERTY_END) {
       if (lib != pos) {
@@ -468,7 +471,7 @@ IsSelfAtari( const game_info_t *game, int color, int pos )
 	  count++;
 	}
       }
-      lib = string[id].lib[lib];
+      lib = NextLiberty(&string[id], lib);
     }
     libs += count;
     already[already_num++] = id;
@@ -483,7 +486,7 @@ IsSelfAtari( const game_info_t *game, int color, int pos )
     id = string_id[WEST(pos)];
     if (already[0] != id) {
       if (string[id].libs > 2) return false;
-      lib = string[id].lib[0];
+      lib = FirstLiberty(&string[id]);
       count = 0;
       while (lib != LIBERTY_END) {
 	if (lib != pos) {
@@ -499,7 +502,7 @@ IsSelfAtari( const game_info_t *game, int color, int pos )
 	    count++;
 	  }
 	}
-	lib = string[id].lib[lib];
+	lib = NextLiberty(&string[id], lib);
       }
       libs += count;
       already[already_num++] = id;
@@ -515,7 +518,7 @@ IsSelfAtari( const game_info_t *game, int color, int pos )
     id = string_id[EAST(pos)];
     if (already[0] != id && already[1] != id) {
       if (string[id].libs > 2) return false;
-      lib = string[id].lib[0];
+      lib = FirstLiberty(&string[id]);
       count = 0;
       while (lib != LIBERTY_END) {
 	if (lib != pos) {
@@ -531,7 +534,7 @@ IsSelfAtari( const game_info_t *game, int color, int pos )
 	    count++;
 	  }
 	}
-	lib = string[id].lib[lib];
+	lib = NextLiberty(&string[id], lib);
       }
       libs += count;
       already[already_num++] = id;
@@ -548,7 +551,7 @@ IsSelfAtari( const game_info_t *game, int color, int pos )
     id = string_id[SOUTH(pos)];
     if (already[0] != id && already[1] != id && already[2] != id) {
       if (string[id].libs > 2) return false;
-      lib = string[id].lib[0];
+      lib = FirstLiberty(&string[id]);
       count = 0;
       while (lib != LIBERTY_END) {
 	if (lib != pos) {
@@ -564,7 +567,7 @@ IsSelfAtari( const game_info_t *game, int color, int pos )
 	    count++;
 	  }
 	}
-	lib = string[id].lib[lib];
+	lib = NextLiberty(&string[id], lib);
       }
       libs += count;
       already[already_num++] = id;
@@ -592,8 +595,8 @@ IsAlreadyCaptured( const game_info_t *game, int color, int id, int player_id[],
   if (string[id].libs == 1) {
     return true;
   } else if (string[id].libs == 2) {
-    lib1 = string[id].lib[0];
-    lib2 = string[id].lib[lib1];
+    lib1 = FirstLiberty(&string[id]);
+    lib2 = NextLiberty(&string[id], lib1);
 
     GetNeighbor4(neighbor4, lib1);
     checked = false;
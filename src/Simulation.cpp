@@ -10,12 +10,55 @@
 using namespace std;
 
 
+// 盤の大きさに特殊化したシミュレーション(SetBoardSizeで切り替える)
+template <int SIZE>
+static void FixedSizeSimulation( game_info_t *game, int starting_color, std::mt19937_64 *mt );
+
+static void (*simulation_function)( game_info_t *game, int starting_color, std::mt19937_64 *mt ) = FixedSizeSimulation<PURE_BOARD_SIZE>;
+
+
+//////////////////////////////////////////////
+//  シミュレーションに使う盤の大きさの設定  //
+//////////////////////////////////////////////
+void
+SetSimulationBoardSize( int size )
+{
+  switch (size) {
+    case 9:
+      simulation_function = FixedSizeSimulation<9>;
+      break;
+    case 13:
+      simulation_function = FixedSizeSimulation<13>;
+      break;
+    case 19:
+      simulation_function = FixedSizeSimulation<19>;
+      break;
+    default:
+      // 特殊化していない盤の大きさは実行時の値を使う
+      simulation_function = FixedSizeSimulation<0>;
+      break;
+  }
+}
+
+
 ////////////////////////////////
 //  終局までシミュレーション  //
 ////////////////////////////////
 void
 Simulation( game_info_t *game, int starting_color, std::mt19937_64 *mt )
 {
+  simulation_function(game, starting_color, mt);
+}
+
+
+//////////////////////////////////////////
+//  盤の大きさを固定したシミュレーション  //
+//////////////////////////////////////////
+template <int SIZE>
+static void
+FixedSizeSimulation( game_info_t *game, int starting_color, std::mt19937_64 *mt )
+{
+  const int board_max = FixedBoardMax<SIZE>();
   int color = starting_color;
   int pos = -1;
   int length;
@@ -27,24 +70,24 @@ Simulation( game_info_t *game, int starting_color, std::mt19937_64 *mt )
     return;
   }
 
-  // レートの初期化  
-  game->sum_rate[0] = game->sum_rate[1] = 0;
-  memset(game->sum_rate_row, 0, sizeof(long long) * 2 * BOARD_SIZE);  
-  memset(game->rate, 0, sizeof(long long) * 2 * BOARD_MAX);           
+  // レートの初期化(実際の盤の範囲のみ)
+  // 各行と全体の合計値はRatingで求める
+  memset(game->rate[0].point, 0, sizeof(long long) * board_max);           
+  memset(game->rate[1].point, 0, sizeof(long long) * board_max);           
 
   pass_count = (game->record[game->moves - 1].pos == PASS && game->moves > 1);
 
   // 黒番のレートの計算
-  Rating(game, S_BLACK, &game->sum_rate[0], game->sum_rate_row[0], game->rate[0]);
+  Rating<SIZE>(game, S_BLACK, &game->rate[0]);
   // 白番のレートの計算
-  Rating(game, S_WHITE, &game->sum_rate[1], game->sum_rate_row[1], game->rate[1]);
+  Rating<SIZE>(game, S_WHITE, &game->rate[1]);
 
   // 終局まで対局をシミュレート
   while (length-- && pass_count < 2) {
     // 着手を生成する
-    pos = RatingMove(game, color, mt);
+    pos = RatingMove<SIZE>(game, color, mt);
     // 石を置く
-    PoPutStone(game, pos, color);
+    PoPutStone<SIZE>(game, pos, color);
     // パスの確認
     pass_count = (pos == PASS) ? (pass_count + 1) : 0;
     // 手番の入れ替え
@@ -71,16 +114,14 @@ SimulationGenmove(game_info_t *game, int color)
   }
 
   // レートの初期化
-  game->sum_rate[0] = game->sum_rate[1] = 0;
-  memset(game->sum_rate_row, 0, sizeof(long long) * 2 * BOARD_SIZE);
-  memset(game->rate, 0, sizeof(long long) * 2 * BOARD_MAX);
+  memset(game->rate, 0, sizeof(game->rate));
 
   pass_count = (game->record[game->moves - 1].pos == PASS && game->moves > 1);
 
   // 黒番のレートの計算
-  Rating(game, S_BLACK, &game->sum_rate[0], game->sum_rate_row[0], game->rate[0]);
+  Rating(game, S_BLACK, &game->rate[0]);
   // 白番のレートの計算
-  Rating(game, S_WHITE, &game->sum_rate[1], game->sum_rate_row[1], game->rate[1]);
+  Rating(game, S_WHITE, &game->rate[1]);
 
   // 確率分布を表示
   PrintRate(game);
@@ -6,6 +6,10 @@
 #include "GoBoard.h"
 #include "UctSearch.h"
 
+// シミュレーションに使う盤の大きさの設定
+// 9路, 13路, 19路では盤の大きさを固定した実装を使う
+void SetSimulationBoardSize( int size );
+
 // 対局のシミュレーション(知識あり)
 void Simulation( game_info_t *game, int color, std::mt19937_64 *mt );
 
@@ -8,6 +8,7 @@
 #include "Ladder.h"
 #include "Message.h"
 #include "Nakade.h"
+#include "ParamBundle.h"
 #include "PatternHash.h"
 #include "Point.h"
 #include "Semeai.h"
@@ -32,29 +33,54 @@ static latent_factor_t uct_pass[UCT_PASS_MAX];
 static latent_factor_t uct_move_distance_1[MOVE_DISTANCE_MAX];
 // 2手前の着手からの距離のレート
 static latent_factor_t uct_move_distance_2[MOVE_DISTANCE_MAX];
+// パターンのレートとインデックスの実体
+// (テキストから読み込んだ時のみ使い, 一括ファイルがある時は一括ファイル上を直接参照する)
+static latent_factor_t uct_pat3_data[PAT3_LIMIT];
+static latent_factor_t uct_md2_data[MD2_LIMIT];
+static latent_factor_t uct_md3_data[LARGE_PAT_MAX];
+static latent_factor_t uct_md4_data[LARGE_PAT_MAX];
+static latent_factor_t uct_md5_data[LARGE_PAT_MAX];
+static index_hash_t md3_index_data[HASH_MAX];
+static index_hash_t md4_index_data[HASH_MAX];
+static index_hash_t md5_index_data[HASH_MAX];
+static int pat3_index_data[PAT3_MAX];
+static int md2_index_data[MD2_MAX];
+
 // 3x3パターンのレート
-static latent_factor_t uct_pat3[PAT3_LIMIT];
+static const latent_factor_t *uct_pat3 = uct_pat3_data;
 // マンハッタン距離2のパターンのレート
-static latent_factor_t uct_md2[MD2_LIMIT];
+static const latent_factor_t *uct_md2 = uct_md2_data;
 // マンハッタン距離3のパターンのレート
-static latent_factor_t uct_md3[LARGE_PAT_MAX];
+static const latent_factor_t *uct_md3 = uct_md3_data;
 // マンハッタン距離4のパターンのレート
-static latent_factor_t uct_md4[LARGE_PAT_MAX];
+static const latent_factor_t *uct_md4 = uct_md4_data;
 // マンハッタン距離5のパターンのレート
-static latent_factor_t uct_md5[LARGE_PAT_MAX];
+static const latent_factor_t *uct_md5 = uct_md5_data;
 // オーナーのレート
 double uct_owner[OWNER_MAX];
 // クリティカリティのレート
 double uct_criticality[CRITICALITY_MAX];
 
-index_hash_t md3_index[HASH_MAX];
-index_hash_t md4_index[HASH_MAX];
-index_hash_t md5_index[HASH_MAX];
+const index_hash_t *md3_index = md3_index_data;
+const index_hash_t *md4_index = md4_index_data;
+const index_hash_t *md5_index = md5_index_data;
+
+static const int *pat3_index = pat3_index_data;
+static const int *md2_index = md2_index_data;
+
+// ウッテガエシの確認用の盤面
+// ノードの展開は複数のスレッドで並列に行うので, スレッドごとに持つ
+struct snapback_work_t {
+  game_info_t *game;
 
-static int pat3_index[PAT3_MAX];
-static int md2_index[MD2_MAX];
+  snapback_work_t( void ) : game(NULL) {}
+
+  ~snapback_work_t( void ) {
+    if (game != NULL) FreeGame(game);
+  }
+};
 
-static game_info_t snapback_game;
+static thread_local snapback_work_t snapback_work;
 
 
 // 戦術的特徴のビットマスク
@@ -88,6 +114,8 @@ unsigned long long atari_mask, capture_mask;
 
 //  γ読み込み
 static void InputUCTParameter( void );
+//  γ読み込み (一括ファイル)
+static bool InputUCTParameterBundle( void );
 //  読み込み 
 static void InputLatentFactor( const char *filename, latent_factor_t *lf, int n );
 //  読み込み Pat3
@@ -130,7 +158,7 @@ UctCheckFeaturesLib1( const game_info_t *game, int color, int id, bool ladder, u
   unsigned long long *tactical_features1 = uct_features->tactical_features1;
 
   // 呼吸点が1つになった連の呼吸点を取り出す
-  lib = string[id].lib[0];
+  lib = FirstLiberty(&string[id]);
 
   // シチョウを逃げる手かどうかで特徴を判定
   if (ladder) {
@@ -147,10 +175,10 @@ UctCheckFeaturesLib1( const game_info_t *game, int color, int id, bool ladder, u
 
   // 敵連を取ることによって連を助ける手の特徴の判定
   // 自分の連の大きさと敵の連の大きさで特徴を判定
-  neighbor = string[id].neighbor[0];
+  neighbor = FirstNeighbor(&string[id]);
   while (neighbor != NEIGHBOR_END) {
     if (string[neighbor].libs == 1) {
-      lib = string[neighbor].lib[0];
+      lib = FirstLiberty(&string[neighbor]);
       if (string[id].size == 1) {
 	if (string[neighbor].size == 1) {
 	  tactical_features1[lib] |= uct_mask[UCT_SAVE_CAPTURE_1_1];
@@ -185,7 +213,7 @@ UctCheckFeaturesLib1( const game_info_t *game, int color, int id, bool ladder, u
 	}
       }
     }
-    neighbor = string[id].neighbor[neighbor];
+    neighbor = NextNeighbor(&string[id], neighbor);
   }
 }
 
@@ -202,8 +230,8 @@ UctCheckFeaturesLib2( const game_info_t *game, int color, int id, uct_features_t
   int lib1_state, lib2_state;
 
   // 呼吸点が2つになった連の呼吸点を取り出す
-  lib1 = string[id].lib[0];
-  lib2 = string[id].lib[lib1];
+  lib1 = FirstLiberty(&string[id]);
+  lib2 = NextLiberty(&string[id], lib1);
 
   // 呼吸点に打つ特徴
   lib1_state = CheckLibertyState(game, lib1, color, id);
@@ -240,19 +268,19 @@ UctCheckFeaturesLib2( const game_info_t *game, int color, int id, uct_features_t
   // 2. 呼吸点が2つの敵連
   // それぞれに対して, 特徴を判定する
   // さらに2.に関しては1手で取れるかどうかも考慮する
-  neighbor = string[id].neighbor[0];
+  neighbor = FirstNeighbor(&string[id]);
   if (string[id].size <= 2) {
     while (neighbor != NEIGHBOR_END) {
       if (string[neighbor].libs == 1) {
-	lib1 = string[neighbor].lib[0];
+	lib1 = FirstLiberty(&string[neighbor]);
 	if (string[neighbor].size <= 2) {
 	  tactical_features1[lib1] |= uct_mask[UCT_2POINT_CAPTURE_S_S];
 	} else {
 	  tactical_features1[lib1] |= uct_mask[UCT_2POINT_CAPTURE_S_L];
 	}
       } else if (string[neighbor].libs == 2) {
-	lib1 = string[neighbor].lib[0];
-	lib2 = string[neighbor].lib[lib1];
+	lib1 = FirstLiberty(&string[neighbor]);
+	lib2 = NextLiberty(&string[neighbor], lib1);
 	if (string[neighbor].size <= 2) {
 	  if (IsCapturableAtari(game, lib1, color, string[neighbor].origin)) {
 	    tactical_features1[lib1] |= uct_mask[UCT_2POINT_C_ATARI_S_S];
@@ -277,20 +305,20 @@ UctCheckFeaturesLib2( const game_info_t *game, int color, int id, uct_features_t
 	  }
 	}
       }
-      neighbor = string[id].neighbor[neighbor];
+      neighbor = NextNeighbor(&string[id], neighbor);
     }
   } else {
     while (neighbor != NEIGHBOR_END) {
       if (string[neighbor].libs == 1) {
-	lib1 = string[neighbor].lib[0];
+	lib1 = FirstLiberty(&string[neighbor]);
 	if (string[neighbor].size <= 2) {
 	  tactical_features1[lib1] |= uct_mask[UCT_2POINT_CAPTURE_L_S];
 	} else {
 	  tactical_features1[lib1] |= uct_mask[UCT_2POINT_CAPTURE_L_L];
 	}
       } else if (string[neighbor].libs == 2) {
-	lib1 = string[neighbor].lib[0];
-	lib2 = string[neighbor].lib[lib1];
+	lib1 = FirstLiberty(&string[neighbor]);
+	lib2 = NextLiberty(&string[neighbor], lib1);
 	if (string[neighbor].size <= 2) {
 	  if (IsCapturableAtari(game, lib1, color, string[neighbor].origin)) {
 	    tactical_features1[lib1] |= uct_mask[UCT_2POINT_C_ATARI_L_S];
@@ -315,7 +343,7 @@ UctCheckFeaturesLib2( const game_info_t *game, int color, int id, uct_features_t
 	  }
 	}
       }
-      neighbor = string[id].neighbor[neighbor];
+      neighbor = NextNeighbor(&string[id], neighbor);
     }
   }
 }
@@ -333,9 +361,9 @@ UctCheckFeaturesLib3( const game_info_t *game, int color, int id, uct_features_t
   int lib1_state, lib2_state, lib3_state;
 
   // 呼吸点が3つになった連の呼吸点を取り出す
-  lib1 = string[id].lib[0];
-  lib2 = string[id].lib[lib1];
-  lib3 = string[id].lib[lib2];
+  lib1 = FirstLiberty(&string[id]);
+  lib2 = NextLiberty(&string[id], lib1);
+  lib3 = NextLiberty(&string[id], lib2);
 
   // 呼吸点に打つ特徴
   lib1_state = CheckLibertyState(game, lib1, color, id);
@@ -389,19 +417,19 @@ UctCheckFeaturesLib3( const game_info_t *game, int color, int id, uct_features_t
   // それぞれに対して, 特徴を判定する
   // さらに2に関しては1手で取れるかを考慮する
 
-  neighbor = string[id].neighbor[0];
+  neighbor = FirstNeighbor(&string[id]);
   if (string[id].size <= 2) {
     while (neighbor != NEIGHBOR_END) {
       if (string[neighbor].libs == 1) {
-	lib1 = string[neighbor].lib[0];
+	lib1 = FirstLiberty(&string[neighbor]);
 	if (string[neighbor].size <= 2) {
 	  tactical_features1[lib1] |= uct_mask[UCT_3POINT_CAPTURE_S_S];
 	} else {
 	  tactical_features1[lib1] |= uct_mask[UCT_3POINT_CAPTURE_S_L];
 	}
       } else if (string[neighbor].libs == 2) {
-	lib1 = string[neighbor].lib[0];
-	lib2 = string[neighbor].lib[lib1];
+	lib1 = FirstLiberty(&string[neighbor]);
+	lib2 = NextLiberty(&string[neighbor], lib1);
 	if (string[neighbor].size <= 2) {
 	  if (IsCapturableAtari(game, lib1, color, string[neighbor].origin)) {
 	    tactical_features1[lib1] |= uct_mask[UCT_3POINT_C_ATARI_S_S];
@@ -426,9 +454,9 @@ UctCheckFeaturesLib3( const game_info_t *game, int color, int id, uct_features_t
 	  }
 	}
       } else if (string[neighbor].libs == 3) {
-	lib1 = string[neighbor].lib[0];
-	lib2 = string[neighbor].lib[lib1];
-	lib3 = string[neighbor].lib[lib2];
+	lib1 = FirstLiberty(&string[neighbor]);
+	lib2 = NextLiberty(&string[neighbor], lib1);
+	lib3 = NextLiberty(&string[neighbor], lib2);
 	if (string[neighbor].size <= 2) {
 	  tactical_features1[lib1] |= uct_mask[UCT_3POINT_DAME_S_S];
 	  tactical_features1[lib2] |= uct_mask[UCT_3POINT_DAME_S_S];
@@ -439,20 +467,20 @@ UctCheckFeaturesLib3( const game_info_t *game, int color, int id, uct_features_t
 	  tactical_features1[lib3] |= uct_mask[UCT_3POINT_DAME_S_L];
 	}
       }
-      neighbor = string[id].neighbor[neighbor];
+      neighbor = NextNeighbor(&string[id], neighbor);
     }
   } else {
     while (neighbor != NEIGHBOR_END) {
       if (string[neighbor].libs == 1) {
-	lib1 = string[neighbor].lib[0];
+	lib1 = FirstLiberty(&string[neighbor]);
 	if (string[neighbor].size <= 2) {
 	  tactical_features1[lib1] |= uct_mask[UCT_3POINT_CAPTURE_L_S];
 	} else {
 	  tactical_features1[lib1] |= uct_mask[UCT_3POINT_CAPTURE_L_L];
 	}
       } else if (string[neighbor].libs == 2) {
-	lib1 = string[neighbor].lib[0];
-	lib2 = string[neighbor].lib[lib1];
+	lib1 = FirstLiberty(&string[neighbor]);
+	lib2 = NextLiberty(&string[neighbor], lib1);
 	if (string[neighbor].size <= 2) {
 	  if (IsCapturableAtari(game, lib1, color, string[neighbor].origin)) {
 	    tactical_features1[lib1] |= uct_mask[UCT_3POINT_C_ATARI_L_S];
@@ -477,9 +505,9 @@ UctCheckFeaturesLib3( const game_info_t *game, int color, int id, uct_features_t
 	  }
 	}
       } else if (string[neighbor].libs == 3) {
-	lib1 = string[neighbor].lib[0];
-	lib2 = string[neighbor].lib[lib1];
-	lib3 = string[neighbor].lib[lib2];
+	lib1 = FirstLiberty(&string[neighbor]);
+	lib2 = NextLiberty(&string[neighbor], lib1);
+	lib3 = NextLiberty(&string[neighbor], lib2);
 	if (string[neighbor].size <= 2) {
 	  tactical_features1[lib1] |= uct_mask[UCT_3POINT_DAME_L_S];
 	  tactical_features1[lib2] |= uct_mask[UCT_3POINT_DAME_L_S];
@@ -490,7 +518,7 @@ UctCheckFeaturesLib3( const game_info_t *game, int color, int id, uct_features_t
 	  tactical_features1[lib3] |= uct_mask[UCT_3POINT_DAME_L_L];
 	}
       }
-      neighbor = string[id].neighbor[neighbor];
+      neighbor = NextNeighbor(&string[id], neighbor);
     }
   }
 }
@@ -567,7 +595,7 @@ UctCheckCaptureAfterKo( const game_info_t *game, int color, uct_features_t *uct_
     if (board[neighbor4[i]] == other) {
       id = string_id[neighbor4[i]];
       if (string[id].libs == 1) {
-	lib = string[id].lib[0];
+	lib = FirstLiberty(&string[id]);
 	tactical_features1[lib] |= uct_mask[UCT_CAPTURE_AFTER_KO];
       }
     }
@@ -622,7 +650,7 @@ UctCheckSelfAtari( const game_info_t *game, int color, int pos, uct_features_t *
       if (already_checked) continue;
 
       if (string[id].libs > 2) return true;
-      lib = string[id].lib[0];
+      lib = FirstLiberty(&string[id]);
       count = 0;
       while (lib != LIBERTY_END) {
 	if (lib != pos) {
@@ -638,7 +666,7 @@ UctCheckSelfAtari( const game_info_t *game, int color, int pos, uct_features_t *
 	    count++;
 	  }
 	}
-	lib = string[id].lib[lib];
+	lib = NextLiberty(&string[id], lib);
       }
       libs += count;
       size += string[id].size;
@@ -697,13 +725,13 @@ UctCheckCapture( const game_info_t *game, int color, int pos, uct_features_t *uc
       if (string[string_id[neighbor4[i]]].libs == 1) {
 	check = false;
 	id = string_id[neighbor4[i]];
-	neighbor = string[id].neighbor[0];
+	neighbor = FirstNeighbor(&string[id]);
 	while (neighbor != NEIGHBOR_END) {
 	  if (string[neighbor].libs == 1) {
 	    check = true;
 	    break;
 	  }
-	  neighbor = string[id].neighbor[neighbor];
+	  neighbor = NextNeighbor(&string[id], neighbor);
 	}
 	if (check) {
 	  tactical_features1[pos] |= uct_mask[UCT_SEMEAI_CAPTURE];
@@ -1059,14 +1087,17 @@ UctCheckSnapBack( const game_info_t *game, int color, int pos, uct_features_t *u
       if (string[id].libs == 1) {
         check_game = game;
       } else if (string[id].libs == 2) {
-        CopyGame(&snapback_game, game);
-        PutStone(&snapback_game, pos, color);
-        check_game = &snapback_game;
+        if (snapback_work.game == NULL) {
+          snapback_work.game = AllocateGame();
+        }
+        CopyGame(snapback_work.game, game);
+        PutStone(snapback_work.game, pos, color);
+        check_game = snapback_work.game;
       } else {
         continue;
       }
       int id2 = check_game->string_id[neighbor4[i]];
-      int lib = check_game->string[id2].lib[0];
+      int lib = FirstLiberty(&check_game->string[id2]);
       int capturable_pos = CapturableCandidate(check_game, id2);
       if (lib == capturable_pos) {
         tactical_features1[pos] |= uct_mask[UCT_SNAPBACK];
@@ -1088,7 +1119,7 @@ CalculateLFRScore( const game_info_t *game, int pos, int index[3], uct_features_
   double tmp_score;
   unsigned long long *tactical_features1 = uct_features->tactical_features1;
   unsigned int pat3, md2;
-  latent_factor_t *all_feature[UCT_TACTICAL_FEATURE_MAX + 6];
+  const latent_factor_t *all_feature[UCT_TACTICAL_FEATURE_MAX + 6];
   int feature_num = 0;
 
   if (moves > 1) pm1 = game->record[moves - 1].pos;
@@ -1235,50 +1266,71 @@ InputUCTParameter(void)
   uct_parameters_path += '/';
 #endif
 
-  path = uct_parameters_path + "WeightZero.txt";
-
-  //  W_0
-  InputTxtDBL(path.c_str(), &weight_zero, 1);
-
-  //  戦術的特徴
-  path = uct_parameters_path + "TacticalFeature.txt";
-  InputLatentFactor(path.c_str(), uct_tactical_features, UCT_TACTICAL_FEATURE_MAX);
-
-  // 盤上の位置
-  path = uct_parameters_path + "PosID.txt";
-  InputLatentFactor(path.c_str(), uct_pos_id, POS_ID_MAX);
-
-  // パス
-  path = uct_parameters_path + "Pass.txt";
-  InputLatentFactor(path.c_str(), uct_pass, UCT_PASS_MAX);
-
-  //  直前の手との距離
-  path = uct_parameters_path + "MoveDistance1.txt";
-  InputLatentFactor(path.c_str(), uct_move_distance_1, MOVE_DISTANCE_MAX);
-
-  //  2手前の手との距離
-  path = uct_parameters_path + "MoveDistance2.txt";
-  InputLatentFactor(path.c_str(), uct_move_distance_2, MOVE_DISTANCE_MAX);
-
-  //  3x3パターン
-  path = uct_parameters_path + "Pat3.txt";
-  InputPat3(path.c_str(), uct_pat3);
-
-  //  マンハッタン距離2のパターン
-  path = uct_parameters_path + "MD2.txt";
-  InputMD2(path.c_str(), uct_md2);
-
-  //  マンハッタン距離3のパターン
-  path = uct_parameters_path + "MD3.txt";
-  InputLargePattern(path.c_str(), uct_md3, md3_index);
-
-  //  マンハッタン距離4のパターン
-  path = uct_parameters_path + "MD4.txt";
-  InputLargePattern(path.c_str(), uct_md4, md4_index);
-
-  //  マンハッタン距離5のパターン
-  path = uct_parameters_path + "MD5.txt";
-  InputLargePattern(path.c_str(), uct_md5, md5_index);
+  // 一括ファイルがなければテキストから読み込む
+  if (!InputUCTParameterBundle()) {
+    path = uct_parameters_path + "WeightZero.txt";
+
+    //  W_0
+    InputTxtDBL(path.c_str(), &weight_zero, 1);
+
+    //  戦術的特徴
+    path = uct_parameters_path + "TacticalFeature.txt";
+    InputLatentFactor(path.c_str(), uct_tactical_features, UCT_TACTICAL_FEATURE_MAX);
+
+    // 盤上の位置
+    path = uct_parameters_path + "PosID.txt";
+    InputLatentFactor(path.c_str(), uct_pos_id, POS_ID_MAX);
+
+    // パス
+    path = uct_parameters_path + "Pass.txt";
+    InputLatentFactor(path.c_str(), uct_pass, UCT_PASS_MAX);
+
+    //  直前の手との距離
+    path = uct_parameters_path + "MoveDistance1.txt";
+    InputLatentFactor(path.c_str(), uct_move_distance_1, MOVE_DISTANCE_MAX);
+
+    //  2手前の手との距離
+    path = uct_parameters_path + "MoveDistance2.txt";
+    InputLatentFactor(path.c_str(), uct_move_distance_2, MOVE_DISTANCE_MAX);
+
+    //  3x3パターン
+    path = uct_parameters_path + "Pat3.txt";
+    InputPat3(path.c_str(), uct_pat3_data);
+
+    //  マンハッタン距離2のパターン
+    path = uct_parameters_path + "MD2.txt";
+    InputMD2(path.c_str(), uct_md2_data);
+
+    //  マンハッタン距離3のパターン
+    path = uct_parameters_path + "MD3.txt";
+    InputLargePattern(path.c_str(), uct_md3_data, md3_index_data);
+
+    //  マンハッタン距離4のパターン
+    path = uct_parameters_path + "MD4.txt";
+    InputLargePattern(path.c_str(), uct_md4_data, md4_index_data);
+
+    //  マンハッタン距離5のパターン
+    path = uct_parameters_path + "MD5.txt";
+    InputLargePattern(path.c_str(), uct_md5_data, md5_index_data);
+  }
+
+  // 一括ファイルを作成する時の書き出し対象
+  AddParamSection("uct/WeightZero", &weight_zero, sizeof(weight_zero));
+  AddParamSection("uct/TacticalFeature", uct_tactical_features, sizeof(uct_tactical_features));
+  AddParamSection("uct/PosID", uct_pos_id, sizeof(uct_pos_id));
+  AddParamSection("uct/Pass", uct_pass, sizeof(uct_pass));
+  AddParamSection("uct/MoveDistance1", uct_move_distance_1, sizeof(uct_move_distance_1));
+  AddParamSection("uct/MoveDistance2", uct_move_distance_2, sizeof(uct_move_distance_2));
+  AddParamSection("uct/Pat3", uct_pat3, sizeof(uct_pat3_data));
+  AddParamSection("uct/Pat3Index", pat3_index, sizeof(pat3_index_data));
+  AddParamSection("uct/MD2", uct_md2, sizeof(uct_md2_data));
+  AddParamSection("uct/MD2Index", md2_index, sizeof(md2_index_data));
+  AddParamSection("uct/MD3", uct_md3, sizeof(uct_md3_data));
+  AddParamSection("uct/MD3Index", md3_index, sizeof(md3_index_data));
+  AddParamSection("uct/MD4", uct_md4, sizeof(uct_md4_data));
+  AddParamSection("uct/MD4Index", md4_index, sizeof(md4_index_data));
+  AddParamSection("uct/MD5", uct_md5, sizeof(uct_md5_data));
+  AddParamSection("uct/MD5Index", md5_index, sizeof(md5_index_data));
 
   //  Owner
   for (int i = 0; i < OWNER_MAX; i++) {
@@ -1291,6 +1343,63 @@ InputUCTParameter(void)
   }
 }
 
+////////////////////////////////
+//  γ読み込み (一括ファイル)  //
+////////////////////////////////
+static bool
+InputUCTParameterBundle( void )
+{
+  const void *weight, *tactical_features, *pos_id, *pass, *move_distance_1, *move_distance_2;
+  const void *pat3, *pat3_idx, *md2, *md2_idx, *md3, *md3_idx, *md4, *md4_idx, *md5, *md5_idx;
+
+  weight = GetFixedParamSection("uct/WeightZero", sizeof(weight_zero));
+  tactical_features = GetFixedParamSection("uct/TacticalFeature", sizeof(uct_tactical_features));
+  pos_id = GetFixedParamSection("uct/PosID", sizeof(uct_pos_id));
+  pass = GetFixedParamSection("uct/Pass", sizeof(uct_pass));
+  move_distance_1 = GetFixedParamSection("uct/MoveDistance1", sizeof(uct_move_distance_1));
+  move_distance_2 = GetFixedParamSection("uct/MoveDistance2", sizeof(uct_move_distance_2));
+  pat3 = GetFixedParamSection("uct/Pat3", sizeof(uct_pat3_data));
+  pat3_idx = GetFixedParamSection("uct/Pat3Index", sizeof(pat3_index_data));
+  md2 = GetFixedParamSection("uct/MD2", sizeof(uct_md2_data));
+  md2_idx = GetFixedParamSection("uct/MD2Index", sizeof(md2_index_data));
+  md3 = GetFixedParamSection("uct/MD3", sizeof(uct_md3_data));
+  md3_idx = GetFixedParamSection("uct/MD3Index", sizeof(md3_index_data));
+  md4 = GetFixedParamSection("uct/MD4", sizeof(uct_md4_data));
+  md4_idx = GetFixedParamSection("uct/MD4Index", sizeof(md4_index_data));
+  md5 = GetFixedParamSection("uct/MD5", sizeof(uct_md5_data));
+  md5_idx = GetFixedParamSection("uct/MD5Index", sizeof(md5_index_data));
+
+  if (weight == NULL || tactical_features == NULL || pos_id == NULL || pass == NULL ||
+      move_distance_1 == NULL || move_distance_2 == NULL ||
+      pat3 == NULL || pat3_idx == NULL || md2 == NULL || md2_idx == NULL ||
+      md3 == NULL || md3_idx == NULL || md4 == NULL || md4_idx == NULL ||
+      md5 == NULL || md5_idx == NULL) {
+    return false;
+  }
+
+  // 小さな表は複製する
+  memcpy(&weight_zero, weight, sizeof(weight_zero));
+  memcpy(uct_tactical_features, tactical_features, sizeof(uct_tactical_features));
+  memcpy(uct_pos_id, pos_id, sizeof(uct_pos_id));
+  memcpy(uct_pass, pass, sizeof(uct_pass));
+  memcpy(uct_move_distance_1, move_distance_1, sizeof(uct_move_distance_1));
+  memcpy(uct_move_distance_2, move_distance_2, sizeof(uct_move_distance_2));
+
+  // パターンの表は一括ファイル上のものをそのまま使う
+  uct_pat3 = (const latent_factor_t *)pat3;
+  pat3_index = (const int *)pat3_idx;
+  uct_md2 = (const latent_factor_t *)md2;
+  md2_index = (const int *)md2_idx;
+  uct_md3 = (const latent_factor_t *)md3;
+  md3_index = (const index_hash_t *)md3_idx;
+  uct_md4 = (const latent_factor_t *)md4;
+  md4_index = (const index_hash_t *)md4_idx;
+  uct_md5 = (const latent_factor_t *)md5;
+  md5_index = (const index_hash_t *)md5_idx;
+
+  return true;
+}
+
 ///////////////////////////
 //  γ読み込み 着手距離  //
 ///////////////////////////
@@ -1352,14 +1461,14 @@ InputPat3( const char *filename, latent_factor_t *lf )
   unsigned int pat3, pat3_transp16[16];
 
   for (pat3 = 0; pat3 < (unsigned int)PAT3_MAX; pat3++) {
-    pat3_index[pat3] = -1;
+    pat3_index_data[pat3] = -1;
   }
 
   for (pat3 = 0; pat3 < (unsigned int)PAT3_MAX; pat3++) {
-    if (pat3_index[pat3] == -1) {
+    if (pat3_index_data[pat3] == -1) {
       Pat3Transpose16(pat3, pat3_transp16);
       for (i = 0; i < 16; i++) {
-	pat3_index[pat3_transp16[i]] = idx;
+	pat3_index_data[pat3_transp16[i]] = idx;
       }
       idx++;
     }
@@ -1378,7 +1487,7 @@ InputPat3( const char *filename, latent_factor_t *lf )
       cerr << "Read Error : " << filename << endl;
       exit(1);
     }
-    idx = pat3_index[pat3];
+    idx = pat3_index_data[pat3];
     lf[idx].w = weight;   
     for (i = 0; i < LFR_DIMENSION; i++) {
       if (fscanf_s(fp, "%lf", &lf[idx].v[i]) == EOF) {
@@ -1398,7 +1507,7 @@ InputPat3( const char *filename, latent_factor_t *lf )
       cerr << "Read Error : " << filename << endl;
       exit(1);
     }
-    idx = pat3_index[pat3];
+    idx = pat3_index_data[pat3];
     lf[idx].w = weight;
     for (i = 0; i < LFR_DIMENSION; i++) {
       if (fscanf(fp, "%lf", &lf[idx].v[i]) == EOF) {
@@ -1423,14 +1532,14 @@ InputMD2( const char *filename, latent_factor_t *lf )
   unsigned int md2, md2_transp16[16];
 
   for (md2 = 0; md2 < (unsigned int)MD2_MAX; md2++) {
-    md2_index[md2] = -1;
+    md2_index_data[md2] = -1;
   }
 
   for (md2 = 0; md2 < (unsigned int)MD2_MAX; md2++) {
-    if (md2_index[md2] == -1) {
+    if (md2_index_data[md2] == -1) {
       MD2Transpose16(md2, md2_transp16);
       for (i = 0; i < 16; i++) {
-	md2_index[md2_transp16[i]] = idx;
+	md2_index_data[md2_transp16[i]] = idx;
       }
       idx++;
     }
@@ -1444,7 +1553,7 @@ InputMD2( const char *filename, latent_factor_t *lf )
     cerr << "can not open -" << filename << "-" << endl;
   }
   while (fscanf_s(fp, "%d%lf", &index, &weight) != EOF) {
-    idx = md2_index[index];
+    idx = md2_index_data[index];
     lf[idx].w = weight;
     for (i = 0; i < LFR_DIMENSION; i++) {
       if (fscanf_s(fp, "%lf", &lf[idx].v[i]) == EOF) {
@@ -1459,7 +1568,7 @@ InputMD2( const char *filename, latent_factor_t *lf )
     cerr << "can not open -" << filename << "-" << endl;
   }
   while (fscanf(fp, "%d%lf", &index, &weight) != EOF) {
-    idx = md2_index[index];
+    idx = md2_index_data[index];
     lf[idx].w = weight;
     for (i = 0; i < LFR_DIMENSION; i++) {
       if (fscanf(fp, "%lf", &lf[idx].v[i]) == EOF) {
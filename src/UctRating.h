@@ -206,9 +206,9 @@ struct latent_factor_t {
 extern double uct_owner[OWNER_MAX];
 extern double uct_criticality[CRITICALITY_MAX];
 
-extern index_hash_t md3_index[HASH_MAX];
-extern index_hash_t md4_index[HASH_MAX];
-extern index_hash_t md5_index[HASH_MAX];
+extern const index_hash_t *md3_index;
+extern const index_hash_t *md4_index;
+extern const index_hash_t *md5_index;
 
 extern char uct_params_path[1024];
 
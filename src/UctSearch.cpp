@@ -7,6 +7,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <condition_variable>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
@@ -20,6 +21,7 @@
 #include "GoBoard.h"
 #include "Ladder.h"
 #include "Message.h"
+#include "NNCache.h"
 #include "PatternHash.h"
 #include "Point.h"
 #include "Rating.h"
@@ -39,22 +41,24 @@
 #include <sys/time.h>
 #endif
 
-#include "Eval.h"
+#if defined (__linux__)
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
 
 using namespace std;
 
-#define LOCK_NODE(var) mutex_nodes[(var)].lock()
-#define UNLOCK_NODE(var) mutex_nodes[(var)].unlock()
-#define LOCK_EXPAND mutex_expand.lock();
-#define UNLOCK_EXPAND mutex_expand.unlock();
-
-typedef std::pair<std::wstring, std::vector<float>*> MapEntry;
-typedef std::map<std::wstring, std::vector<float>*> Layer;
+#define LOCK_NODE(var) LockNode(&uct_node[(var)].lock)
+#define UNLOCK_NODE(var) UnlockNode(&uct_node[(var)].lock)
+#define LOCK_QUEUE mutex_queue.lock();
+#define UNLOCK_QUEUE mutex_queue.unlock();
 
 struct value_eval_req {
-  child_node_t *uct_child;
+  int index;        // 親ノードのインデックス
+  int child_index;  // 評価する子ノードの番号
   int color;
   int trans;
+  unsigned long long key;  // 評価結果のキャッシュのキー
   std::vector<int> path;
   std::vector<float> data;
 };
@@ -64,11 +68,110 @@ struct policy_eval_req {
   int depth;
   int color;
   int trans;
+  unsigned long long key;  // 評価結果のキャッシュのキー
   std::vector<float> data;
 };
 
+// 評価待ちの要求のキュー
+// 複数の探索スレッドが積み, 評価スレッドが取り出す
+// 各要素の通し番号で書き込みと読み出しの完了を判定するので, ロックを取らない
+template <typename T>
+class eval_queue_t {
+public:
+  // 要素数は2のべき乗に切り上げる
+  // 探索スレッドと評価スレッドが止まっているときに呼び出す
+  void Initialize(size_t size) {
+    size_t capacity = 1;
+    while (capacity < size) capacity <<= 1;
+    cells.reset(new cell_t[capacity]);
+    for (size_t i = 0; i < capacity; i++) {
+      cells[i].sequence = i;
+    }
+    mask = capacity - 1;
+    head = 0;
+    tail = 0;
+  }
+
+  // 満杯ならfalseを返す
+  bool Push(const std::shared_ptr<T>& req) {
+    size_t pos = tail.load(memory_order_relaxed);
+    cell_t *cell;
+
+    while (true) {
+      cell = &cells[pos & mask];
+      size_t sequence = cell->sequence.load(memory_order_acquire);
+      intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+      if (diff == 0) {
+	if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+      } else if (diff < 0) {
+	return false;
+      } else {
+	pos = tail.load(memory_order_relaxed);
+      }
+    }
+
+    cell->data = req;
+    cell->sequence.store(pos + 1, memory_order_release);
+    return true;
+  }
+
+  // 空ならfalseを返す
+  bool Pop(std::shared_ptr<T>& req) {
+    size_t pos = head.load(memory_order_relaxed);
+    cell_t *cell;
+
+    while (true) {
+      cell = &cells[pos & mask];
+      size_t sequence = cell->sequence.load(memory_order_acquire);
+      intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+      if (diff == 0) {
+	if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+      } else if (diff < 0) {
+	return false;
+      } else {
+	pos = head.load(memory_order_relaxed);
+      }
+    }
+
+    req = std::move(cell->data);
+    cell->sequence.store(pos + mask + 1, memory_order_release);
+    return true;
+  }
+
+  // 並行して積まれている間は目安の値
+  size_t Size(void) const {
+    size_t t = tail.load(memory_order_relaxed);
+    size_t h = head.load(memory_order_relaxed);
+    return t > h ? t - h : 0;
+  }
+
+  bool Empty(void) const { return Size() == 0; }
+
+  void Clear(void) {
+    std::shared_ptr<T> req;
+    while (Pop(req)) ;
+  }
+
+private:
+  struct cell_t {
+    std::atomic<size_t> sequence;
+    std::shared_ptr<T> data;
+  };
+  std::unique_ptr<cell_t[]> cells;
+  size_t mask = 0;
+  alignas(64) std::atomic<size_t> head;  // 次に取り出す位置
+  alignas(64) std::atomic<size_t> tail;  // 次に積む位置
+};
+
 void ReadWeights();
 void EvalNode();
+static void FlushStatistic(void);
+static void SetPolicyRate(int index, int depth, const float *policy);
+static void UpdateValue(int index, int child_index, const std::vector<int>& path, float win);
+static void PlaceTreeMemory(void);
+static unsigned long ReadNumaNodeMask(void);
+static bool InterleaveTreeMemory(void *addr, size_t size);
+static void CopySeki(game_info_t *po_game, const unsigned long long *seki);
 //void EvalUctNode(std::vector<int>& indices, std::vector<int>& color, std::vector<int>& trans, std::vector<float>& data, std::vector<int>& path);
 
 ////////////////
@@ -97,8 +200,44 @@ static bool no_expand = false;
 static bool extend_time = false;
 
 int current_root; // 現在のルートのインデックス
-mutex mutex_nodes[MAX_NODES];
-mutex mutex_expand;       // ノード展開を排他処理するためのmutex
+mutex mutex_queue;        // 評価スレッドの待機と木の整理を排他処理するためのmutex
+static condition_variable eval_ready;   // 評価スレッドに要求が溜まったことを知らせる
+static condition_variable eval_space;   // 探索スレッドにキューが空いたことを知らせる
+static std::atomic<bool> eval_waiting;  // 評価スレッドが要求を待って眠っているならtrue
+
+// ノードのロックの競合の統計
+static node_lock_stat_t node_lock_stat;
+
+// 木の整理(ハッシュ表が埋まったら探索回数の少ないノードを追い出す)
+static mutex mutex_gc;                   // 整理を行うスレッドを1つに限る
+static std::atomic<bool> gc_request;     // 整理の要求
+static std::atomic<int> gc_paused;       // 整理のために止まっている探索スレッド数
+static std::atomic<int> search_running;  // 探索中のスレッド数
+static std::atomic<bool> eval_busy;      // 評価スレッドが取り出した要求を処理中ならtrue
+
+// 子ノードの領域
+// CHILD_BLOCK_SIZE個ずつのブロックに分け, 初めて切り出すときにブロックを確保する
+// 切り出す位置はブロックを先頭から並べた通し番号で表す
+static vector<child_node_t *> child_block;    // 領域のブロック(確保するまではNULL)
+static mutex mutex_child_block;               // ブロックの確保を排他処理するためのmutex
+static size_t child_arena_size;               // 領域の要素数の上限
+static std::atomic<size_t> child_arena_used;  // 切り出し済みの要素数
+static std::atomic<int> child_arena_epoch;    // 領域を詰め直すたびに進める
+static std::atomic<bool> child_arena_full;    // 領域が足りなくなったらtrue
+
+// スレッドごとの子ノードの割り当て元
+struct child_chunk_t {
+  child_node_t *next;  // 次に割り当てる位置
+  child_node_t *end;   // 切り出した範囲の終端
+  int epoch;           // 切り出したときの領域の世代
+};
+static thread_local child_chunk_t child_chunk;
+
+// 統計情報の領域(1ノードあたりboard_max個)
+static statistic_t *statistic_pool;             // 統計情報を並べる領域
+static size_t statistic_pool_size;              // 領域の要素数
+static std::atomic<size_t> statistic_pool_used; // 割り当て済みの要素数
+static std::atomic<bool> statistic_pool_full;   // 領域が足りなくなったらtrue
 
 // 探索の設定
 enum SEARCH_MODE mode = CONST_TIME_MODE;
@@ -111,11 +250,19 @@ int playout = CONST_PLAYOUT;
 // デフォルトの持ち時間
 double default_remaining_time = ALL_THINKING_TIME;
 
-// 各スレッドに渡す引数
-thread_arg_t t_arg[THREAD_MAX];
-
 // プレイアウトの統計情報
 statistic_t statistic[BOARD_MAX];  
+// 統計情報に反映したプレイアウト数
+static std::atomic<int> statistic_count;
+
+// スレッドごとのプレイアウトの統計情報
+// 共有の統計情報への加算はSTATISTIC_FLUSH_INTERVAL回ごとにまとめて行う
+struct statistic_buffer_t {
+  char owner[PURE_BOARD_MAX];      // 最後のプレイアウトの終局図で各点を占めた色
+  int colors[PURE_BOARD_MAX][3];   // 共有の統計情報に反映していない回数
+  int count;                       // 反映していないプレイアウト数
+};
+static thread_local statistic_buffer_t statistic_buffer;
 // 盤上の各点のCriticality
 double criticality[BOARD_MAX];  
 // 盤上の各点のOwner(0-100%)
@@ -139,16 +286,30 @@ bool pondered = false;
 
 double time_limit;
 
-std::thread *handle[THREAD_MAX];    // スレッドのハンドル
+// 探索スレッドのプール
+// スレッドは探索ごとに作り直さず, 探索の合間は条件変数で待たせる
+struct pool_worker_t {
+  std::thread *handle;             // スレッドのハンドル
+  void (*job)(thread_arg_t *arg);  // 割り当てられた処理
+  bool assigned;                   // 処理を割り当てられてから終えるまでtrue
+  thread_arg_t arg;                // 処理に渡す引数
+};
+static vector<pool_worker_t *> pool_worker;  // 探索スレッド(スレッド数に合わせて増やす)
+static pool_worker_t eval_worker;            // 評価スレッド
+static bool thread_affinity = false;         // trueなら探索スレッドをCPUに固定する
+static unsigned long numa_node_mask = 0;     // 使えるNUMAノードの集合 (分からなければ0)
+static bool tree_interleaved = false;        // trueなら木の領域をNUMAノードに交互に置いた
+static mutex mutex_pool;                     // 割り当ての排他処理
+static condition_variable pool_start;        // 処理の割り当てを知らせる
+static condition_variable pool_done;         // 処理の終了を知らせる
+static bool pool_shutdown = false;           // trueならスレッドを終了する
+static std::atomic<bool> searching;          // 探索スレッドが探索中ならtrue
 
 // UCB Bonusの等価パラメータ
 double bonus_equivalence = BONUS_EQUIVALENCE;
 // UCB Bonusの重み
 double bonus_weight = BONUS_WEIGHT;
 
-// 乱数生成器
-std::mt19937_64 *mt[THREAD_MAX];
-
 // Criticalityの上限値
 int criticality_max = CRITICALITY_MAX;
 
@@ -168,12 +329,18 @@ static bool early_pass = true;
 
 static bool use_nn = true;
 static bool use_gpu = true;
-static std::queue<std::shared_ptr<policy_eval_req>> eval_policy_queue;
-static std::queue<std::shared_ptr<value_eval_req>> eval_value_queue;
+static eval_queue_t<policy_eval_req> eval_policy_queue;
+static eval_queue_t<value_eval_req> eval_value_queue;
 static int eval_count_policy, eval_count_value;
 static double owner_nn[BOARD_MAX];
 
-static Microsoft::MSR::CNTK::IEvaluateModel<float>* nn_model = nullptr;
+static NN_BACKEND nn_backend = NN_BACKEND_DEFAULT;
+static int nn_threads = 0;
+static bool nn_int8 = false;
+static std::string nn_calibration_file;
+static bool make_nn_model = false;
+static nn_evaluator_t *nn_evaluator = nullptr;
+static thread nn_loader;
 
 //template<double>
 double atomic_fetch_add(std::atomic<double> *obj, double arg) {
@@ -186,10 +353,335 @@ double atomic_fetch_add(std::atomic<double> *obj, double arg) {
 static void
 ClearEvalQueue()
 {
-  queue<shared_ptr<value_eval_req>> empty_value;
-  eval_value_queue.swap(empty_value);
-  queue<shared_ptr<policy_eval_req>> empty_policy;
-  eval_policy_queue.swap(empty_policy);
+  eval_value_queue.Clear();
+  eval_policy_queue.Clear();
+}
+
+
+//////////////////////////////
+//  評価待ちのキューの確保  //
+//////////////////////////////
+// 探索スレッドは溜まりすぎたら止まるが, 止まるまでに
+// 1プレイアウトで方策と価値の要求を1つずつ積むので, その分を余分に取る
+static void
+InitializeEvalQueue(void)
+{
+  eval_policy_queue.Initialize(policy_batch_size * EVAL_QUEUE_BATCHES + threads * 2 + 1);
+  eval_value_queue.Initialize(value_batch_size * EVAL_QUEUE_BATCHES + threads * 2 + 1);
+}
+
+
+//////////////////////////////////
+//  評価待ちの要求が多すぎるか  //
+//////////////////////////////////
+static bool
+IsEvalQueueFull(void)
+{
+  return eval_value_queue.Size() > (size_t)(value_batch_size * EVAL_QUEUE_BATCHES) ||
+    eval_policy_queue.Size() > (size_t)(policy_batch_size * EVAL_QUEUE_BATCHES);
+}
+
+
+//////////////////////////////////
+//  評価待ちの要求がバッチ分あるか  //
+//////////////////////////////////
+static bool
+IsEvalBatchReady(void)
+{
+  return eval_value_queue.Size() >= (size_t)value_batch_size ||
+    eval_policy_queue.Size() >= (size_t)policy_batch_size;
+}
+
+
+////////////////////////////////
+//  評価スレッドに知らせる    //
+////////////////////////////////
+// 要求を積んだ後に呼び出す
+// 評価スレッドが眠っているか, バッチが埋まったときだけ起こす
+static void
+NotifyEvalThread(size_t size, int batch_size)
+{
+  if (eval_waiting) {
+    lock_guard<mutex> lock(mutex_queue);
+    eval_ready.notify_one();
+  } else if (size == (size_t)batch_size) {
+    eval_ready.notify_one();
+  }
+}
+
+
+////////////////////////////////////////////
+//  評価待ちの要求が減るまで探索を止める  //
+////////////////////////////////////////////
+// 木の整理中は評価スレッドが止まるので待たない
+static void
+WaitEvalQueue(void)
+{
+  static std::atomic<int> queue_full;
+
+  if (!use_nn || !IsEvalQueueFull()) return;
+
+  if (++queue_full % 1000 == 0) {
+    cerr << "EVAL QUEUE FULL" << endl;
+  }
+
+  unique_lock<mutex> lock(mutex_queue);
+  eval_space.wait(lock, [] { return gc_request || !IsEvalQueueFull(); });
+}
+
+////////////////////////////
+//  子ノードの領域の確保  //
+////////////////////////////
+// 上限を決めてブロックの表だけを作り, ブロックは切り出すときに確保する
+static void
+AllocateChildArena(void)
+{
+  size_t blocks;
+
+  for (child_node_t *block : child_block) {
+    free(block);
+  }
+
+  blocks = (size_t)(uct_hash_size * (pure_board_max + 1) * CHILD_ARENA_RATE) / CHILD_BLOCK_SIZE + 1;
+  child_block.assign(blocks, NULL);
+  child_arena_size = blocks * CHILD_BLOCK_SIZE;
+
+  child_arena_used = 0;
+  child_arena_full = false;
+  child_arena_epoch++;
+}
+
+
+//////////////////////////////////////
+//  通し番号に対応する位置を返す    //
+//////////////////////////////////////
+// ブロックがなければ確保し, 確保できなければNULLを返す
+static child_node_t *
+ChildArenaAt(size_t offset)
+{
+  lock_guard<mutex> lock(mutex_child_block);
+  child_node_t **block = &child_block[offset / CHILD_BLOCK_SIZE];
+
+  if (*block == NULL) {
+    *block = (child_node_t *)malloc(sizeof(child_node_t) * CHILD_BLOCK_SIZE);
+    if (*block == NULL) return NULL;
+    InterleaveTreeMemory(*block, sizeof(child_node_t) * CHILD_BLOCK_SIZE);
+  }
+
+  return *block + offset % CHILD_BLOCK_SIZE;
+}
+
+
+////////////////////////////////////
+//  子ノードの割り当て先の予約    //
+////////////////////////////////////
+// num個分の連続した領域を返すが, CommitChildrenを呼ぶまでは確定しない
+// 領域が足りなければNULLを返す
+static child_node_t *
+ReserveChildren(int num)
+{
+  child_chunk_t *chunk = &child_chunk;
+  size_t start;
+
+  assert(num <= CHILD_CHUNK_SIZE);
+
+  // 切り出す単位はブロックの大きさを割り切るので, 切り出した範囲はブロックをまたがない
+  if (chunk->epoch != child_arena_epoch || chunk->end - chunk->next < num) {
+    start = child_arena_used.fetch_add(CHILD_CHUNK_SIZE);
+    chunk->next = (start + CHILD_CHUNK_SIZE > child_arena_size) ? NULL : ChildArenaAt(start);
+    if (chunk->next == NULL) {
+      child_arena_full = true;
+      chunk->end = NULL;
+      return NULL;
+    }
+    chunk->end = chunk->next + CHILD_CHUNK_SIZE;
+    chunk->epoch = child_arena_epoch;
+  }
+
+  return chunk->next;
+}
+
+
+////////////////////////////////////
+//  子ノードの割り当ての確定      //
+////////////////////////////////////
+static void
+CommitChildren(int num)
+{
+  child_chunk.next += num;
+}
+
+
+////////////////////////////////
+//  子ノードの領域の詰め直し  //
+////////////////////////////////
+// 残すノードの子ノードを領域の先頭から並べ直す
+// ブロックの末尾に収まらないノードは次のブロックの先頭に置く
+// 探索スレッドが子ノードを参照していないときに呼び出す
+static void
+CompactChildArena(vector<int>& kept)
+{
+  vector<pair<size_t, int>> order;  // (通し番号, インデックス)
+  size_t used = 0, block;
+  child_node_t *dest;
+  int child_num;
+
+  for (int index : kept) {
+    for (block = 0; block < child_block.size(); block++) {
+      if (child_block[block] != NULL &&
+	  uct_node[index].child >= child_block[block] &&
+	  uct_node[index].child < child_block[block] + CHILD_BLOCK_SIZE) {
+	order.push_back(make_pair(block * CHILD_BLOCK_SIZE + (uct_node[index].child - child_block[block]), index));
+	break;
+      }
+    }
+  }
+
+  // 通し番号の前にあるものから順に詰めれば, 移動先が移動元を追い越さない
+  sort(order.begin(), order.end());
+
+  for (auto& node : order) {
+    child_num = uct_node[node.second].child_num;
+    // 確保できなかったブロックは飛ばす (移動元のブロックは確保済み)
+    while (used % CHILD_BLOCK_SIZE + child_num > CHILD_BLOCK_SIZE ||
+	   child_block[used / CHILD_BLOCK_SIZE] == NULL) {
+      used += CHILD_BLOCK_SIZE - used % CHILD_BLOCK_SIZE;
+    }
+    dest = child_block[used / CHILD_BLOCK_SIZE] + used % CHILD_BLOCK_SIZE;
+    if (uct_node[node.second].child != dest) {
+      memmove((void *)dest, (const void *)uct_node[node.second].child, sizeof(child_node_t) * child_num);
+      uct_node[node.second].child = dest;
+    }
+    used += child_num;
+  }
+
+  // 次に切り出す範囲がブロックをまたがないように, 切り出す単位に揃える
+  child_arena_used = (used + CHILD_CHUNK_SIZE - 1) / CHILD_CHUNK_SIZE * CHILD_CHUNK_SIZE;
+  child_arena_full = false;
+  child_arena_epoch++;
+}
+
+
+//////////////////////////////
+//  統計情報の領域の確保    //
+//////////////////////////////
+static void
+AllocateStatisticPool(void)
+{
+  if (statistic_pool != NULL) {
+    free(statistic_pool);
+  }
+
+  statistic_pool_size = (size_t)(uct_hash_size * STATISTIC_POOL_RATE) * board_max;
+  statistic_pool = (statistic_t *)malloc(sizeof(statistic_t) * statistic_pool_size);
+
+  if (statistic_pool == NULL) {
+    cerr << "Cannot allocate memory !!" << endl;
+    cerr << "You must reduce tree size !!" << endl;
+    exit(1);
+  }
+
+  InterleaveTreeMemory(statistic_pool, sizeof(statistic_t) * statistic_pool_size);
+
+  statistic_pool_used = 0;
+  statistic_pool_full = false;
+}
+
+
+////////////////////////////////
+//  統計情報の領域の詰め直し  //
+////////////////////////////////
+// 残すノードの統計情報を領域の先頭から隙間なく並べ直す
+// 探索スレッドが統計情報を参照していないときに呼び出す
+static void
+CompactStatisticPool(vector<int>& kept)
+{
+  size_t used = 0;
+  statistic_t *src, *dest;
+
+  // 領域の前にあるものから順に詰めれば, 移動先が移動元を追い越さない
+  sort(kept.begin(), kept.end(), [](int a, int b) {
+    return uct_node[a].statistic.load() < uct_node[b].statistic.load();
+  });
+
+  for (int index : kept) {
+    src = uct_node[index].statistic;
+    if (src == NULL) continue;
+    dest = statistic_pool + used;
+    if (src != dest) {
+      memmove((void *)dest, (const void *)src, sizeof(statistic_t) * board_max);
+      uct_node[index].statistic = dest;
+    }
+    used += board_max;
+  }
+
+  statistic_pool_used = used;
+  statistic_pool_full = false;
+}
+
+
+//////////////////////////
+//  木に余裕があるか確認  //
+//////////////////////////
+static bool
+CheckRemainingTreeSize(void)
+{
+  return CheckRemainingHashSize() && !child_arena_full && !statistic_pool_full;
+}
+
+
+//////////////////////
+//  UCT木のクリア  //
+//////////////////////
+static void
+ClearUctTree(void)
+{
+  vector<int> kept;
+
+  ClearUctHash();
+  SweepUctHash();
+  CompactChildArena(kept);
+  CompactStatisticPool(kept);
+}
+
+
+//////////////////////////////////////////
+//  新しいルート以下にないノードの削除  //
+//////////////////////////////////////////
+// 世代を進めて表を論理的にクリアし, 新しいルートから辿れるノードだけを
+// 現在の世代に引き継ぐ
+static void
+DeleteOldNodes(const game_info_t *game, int color)
+{
+  unsigned int root = FindSameHashIndex(game->current_hash, color, game->moves);
+  vector<int> stack, kept;
+  int i, index;
+
+  ClearUctHash();
+
+  if (root != uct_hash_size) {
+    stack.push_back(root);
+  }
+
+  while (!stack.empty()) {
+    index = stack.back();
+    stack.pop_back();
+    // 合流により既に引き継いだノードは辿らない
+    if (!KeepHashIndex(index)) continue;
+    kept.push_back(index);
+    for (i = 0; i < uct_node[index].child_num; i++) {
+      if (uct_node[index].child[i].index != NOT_EXPANDED) {
+	stack.push_back(uct_node[index].child[i].index);
+      }
+    }
+  }
+
+  // 引き継がなかった要素を片付け, 探索列を短く保つ
+  SweepUctHash();
+
+  // 引き継いだノードの子ノードと統計情報を詰め直す
+  CompactChildArena(kept);
+  CompactStatisticPool(kept);
 }
 
 ///////////////////
@@ -236,7 +728,17 @@ SetConstTime(double time)
 void
 SetThread(int new_thread)
 {
-  threads = new_thread;
+  threads = (new_thread > 0) ? new_thread : 1;
+}
+
+
+//////////////////////////////////////////
+//  探索スレッドをCPUに固定するかの指定  //
+//////////////////////////////////////////
+void
+SetThreadAffinity(bool flag)
+{
+  thread_affinity = flag;
 }
 
 
@@ -282,6 +784,12 @@ SetParameter(void)
   } else {
     expand_threshold = EXPAND_THRESHOLD_19;
   }
+
+  // 探索の初期設定の後に盤の大きさが変わったら, 子ノードと統計情報の領域を確保し直す
+  if (!child_block.empty()) {
+    AllocateChildArena();
+    AllocateStatisticPool();
+  }
 }
 
 ////////////////////
@@ -299,12 +807,177 @@ SetUseGPU(bool flag)
   use_gpu = flag;
 }
 
+void
+SetNNBackend(NN_BACKEND backend)
+{
+  nn_backend = backend;
+}
+
+void
+SetNNThreads(int threads)
+{
+  nn_threads = threads;
+}
+
+void
+SetNNInt8(bool flag)
+{
+  nn_int8 = flag;
+}
+
+void
+SetNNCalibration(const char *data_file)
+{
+  nn_calibration_file = data_file;
+}
+
+bool
+IsNNCalibration(void)
+{
+  return !nn_calibration_file.empty();
+}
+
+void
+SetMakeNNModel(bool flag)
+{
+  make_nn_model = flag;
+}
+
+bool
+IsMakeNNModel(void)
+{
+  return make_nn_model;
+}
+
 void
 SetNoExpand(bool flag)
 {
   no_expand = flag;
 }
 
+//////////////////////////
+//  スピン待ちの1回分   //
+//////////////////////////
+static inline void
+CpuRelax( void )
+{
+#if defined (_MSC_VER)
+  YieldProcessor();
+#elif defined (__x86_64__) || defined (__i386__)
+  __builtin_ia32_pause();
+#elif defined (__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+
+//////////////////////////////////
+//  ノードのロック(競合時)      //
+//////////////////////////////////
+static void
+LockNodeContended( node_lock_t *lock )
+{
+  int backoff = NODE_LOCK_BACKOFF_MIN;
+  long long spin = 0, yield = 0;
+  int i;
+
+  do {
+    // 解放されるまでは読み込みだけで待ち, キャッシュラインを奪い合わない
+    while (lock->locked.load(memory_order_relaxed)) {
+      if (backoff > NODE_LOCK_BACKOFF_MAX) {
+        this_thread::yield();
+        yield++;
+      } else {
+        for (i = 0; i < backoff; i++) {
+          CpuRelax();
+        }
+        spin += backoff;
+        backoff <<= 1;
+      }
+    }
+  } while (lock->locked.exchange(true, memory_order_acquire));
+
+  node_lock_stat.contended.fetch_add(1, memory_order_relaxed);
+  node_lock_stat.spin.fetch_add(spin, memory_order_relaxed);
+  node_lock_stat.yield.fetch_add(yield, memory_order_relaxed);
+}
+
+
+//////////////////////
+//  ノードのロック  //
+//////////////////////
+static inline void
+LockNode( node_lock_t *lock )
+{
+  // 競合がなければ1回の交換で獲得する
+  if (lock->locked.exchange(true, memory_order_acquire)) {
+    LockNodeContended(lock);
+  }
+}
+
+
+////////////////////////////
+//  ノードのロックの解除  //
+////////////////////////////
+static inline void
+UnlockNode( node_lock_t *lock )
+{
+  lock->locked.store(false, memory_order_release);
+}
+
+
+//////////////////////////////////
+//  ノードの統計情報の割り当て  //
+//////////////////////////////////
+// 領域が足りなければNULLを返す
+static statistic_t *
+AllocateNodeStatistic(int index)
+{
+  statistic_t *node_statistic;
+  size_t start;
+
+  LOCK_NODE(index);
+  node_statistic = uct_node[index].statistic;
+  if (node_statistic == NULL) {
+    start = statistic_pool_used.fetch_add(board_max);
+    if (start + board_max > statistic_pool_size) {
+      statistic_pool_full = true;
+    } else {
+      node_statistic = statistic_pool + start;
+      memset(node_statistic, 0, sizeof(statistic_t) * board_max);
+      uct_node[index].statistic_base = uct_node[index].move_count;
+      uct_node[index].statistic = node_statistic;
+    }
+  }
+  UNLOCK_NODE(index);
+
+  return node_statistic;
+}
+
+
+////////////////////////////////////
+//  ノードの展開の完了を待つ      //
+////////////////////////////////////
+static void
+WaitNodeReady( int index )
+{
+  int backoff = NODE_LOCK_BACKOFF_MIN;
+  int i;
+
+  // 他のスレッドが確保したノードの子ノードが揃うまで待つ
+  while (!IsHashReady(index)) {
+    if (backoff > NODE_LOCK_BACKOFF_MAX) {
+      this_thread::yield();
+    } else {
+      for (i = 0; i < backoff; i++) {
+        CpuRelax();
+      }
+      backoff <<= 1;
+    }
+  }
+}
+
+
 /////////////////////////
 //  UCT探索の初期設定  //
 /////////////////////////
@@ -324,6 +997,7 @@ InitializeUctSearch(void)
   }
 
   // UCTのノードのメモリを確保
+  numa_node_mask = ReadNumaNodeMask();
   uct_node = (uct_node_t *)malloc(sizeof(uct_node_t) * uct_hash_size);
   
   if (uct_node == NULL) {
@@ -332,8 +1006,333 @@ InitializeUctSearch(void)
     exit(1);
   }
 
-  if (use_nn && !nn_model)
+  // ノードとハッシュ表のページをNUMAノードに交互に置き,
+  // できなければ探索スレッドから確保させる
+  tree_interleaved = InterleaveTreeMemory(uct_node, sizeof(uct_node_t) * uct_hash_size) &&
+                     InterleaveTreeMemory(node_hash, sizeof(node_hash_t) * uct_hash_size);
+  PlaceTreeMemory();
+
+  // ノードのロックの初期化
+  for (i = 0; i < (int)uct_hash_size; i++) {
+    uct_node[i].lock.locked = false;
+  }
+
+  // 子ノードと統計情報の領域を確保
+  AllocateChildArena();
+  AllocateStatisticPool();
+
+  // 評価待ちのキューを確保
+  InitializeEvalQueue();
+
+  // 重みの読み込みを先に始めていればその完了を待つ
+  if (nn_loader.joinable())
+    nn_loader.join();
+  if (use_nn && !nn_evaluator)
     ReadWeights();
+
+  // 評価結果のキャッシュを確保
+  if (use_nn)
+    InitializeNNCache();
+}
+
+
+//////////////////////////////////////////
+//  NUMAノードの集合の取得              //
+//////////////////////////////////////////
+// "0-3,5"の形式で書かれた使えるNUMAノードを読み, ビットの集合にする
+// 64ノードを超える分は無視する
+static unsigned long
+ReadNumaNodeMask(void)
+{
+  unsigned long mask = 0;
+#if defined (__linux__)
+  FILE *fp = fopen("/sys/devices/system/node/online", "r");
+  int first, last;
+  char sep = '\n';
+
+  if (fp == NULL) return 0;
+
+  while (fscanf(fp, "%d", &first) == 1) {
+    last = first;
+    if (fscanf(fp, "%c", &sep) == 1 && sep == '-') {
+      if (fscanf(fp, "%d", &last) != 1) break;
+      if (fscanf(fp, "%c", &sep) != 1) sep = '\n';
+    }
+    for (; first <= last && first < (int)(sizeof(mask) * 8); first++) {
+      mask |= 1UL << first;
+    }
+    if (sep != ',') break;
+  }
+
+  fclose(fp);
+#endif
+  return mask;
+}
+
+
+//////////////////////////////////////////
+//  領域のNUMAノードへの交互の配置      //
+//////////////////////////////////////////
+// NUMAノードが複数あれば, 領域のページをページごとにNUMAノードに交互に置く
+// 既に書き込まれたページも移す
+// 置けたらtrue, NUMAノードが1つ以下かmbindが使えなければfalseを返す
+static bool
+InterleaveTreeMemory(void *addr, size_t size)
+{
+#if defined (__linux__) && defined (SYS_mbind)
+  const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  const uintptr_t begin = ((uintptr_t)addr + page - 1) & ~(page - 1);
+  const uintptr_t end = ((uintptr_t)addr + size) & ~(page - 1);
+
+  if ((numa_node_mask & (numa_node_mask - 1)) == 0) return false;
+  if (end <= begin) return true;
+
+  return syscall(SYS_mbind, begin, end - begin, MPOL_INTERLEAVE,
+                 &numa_node_mask, sizeof(numa_node_mask) * 8 + 1, MPOL_MF_MOVE) == 0;
+#else
+  return false;
+#endif
+}
+
+
+////////////////////////////////
+//  スレッドをCPUに固定する   //
+////////////////////////////////
+static void
+BindThread(int id)
+{
+  int cpus = (int)thread::hardware_concurrency();
+
+  if (cpus <= 0) return;
+
+#if defined (_WIN32)
+  SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (id % cpus % 64));
+#elif defined (__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(id % cpus, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+#endif
+}
+
+
+//////////////////////////////////
+//  プールのスレッドの処理      //
+//////////////////////////////////
+// 処理を割り当てられるまで待ち, 終えたらまた待つ
+static void
+PoolWorker(pool_worker_t *worker, int id)
+{
+  // 評価スレッドは固定しない
+  if (thread_affinity && worker != &eval_worker) {
+    BindThread(id);
+  }
+
+  unique_lock<mutex> lock(mutex_pool);
+
+  while (true) {
+    pool_start.wait(lock, [worker] { return worker->assigned || pool_shutdown; });
+    if (pool_shutdown) break;
+    lock.unlock();
+    worker->job(&worker->arg);
+    lock.lock();
+    worker->assigned = false;
+    pool_done.notify_all();
+  }
+}
+
+
+////////////////////////////////////
+//  評価スレッドとして動かす処理  //
+////////////////////////////////////
+static void
+EvalNodeJob(thread_arg_t *arg)
+{
+  EvalNode();
+}
+
+
+//////////////////////////////////
+//  プールのスレッドへの割り当て  //
+//////////////////////////////////
+static void
+AssignPoolWorker(pool_worker_t *worker, int id, void (*job)(thread_arg_t *arg))
+{
+  worker->job = job;
+  worker->assigned = true;
+  if (worker->handle == nullptr) {
+    worker->handle = new thread(PoolWorker, worker, id);
+  }
+}
+
+
+//////////////////////////////////////
+//  探索スレッドへの処理の割り当て  //
+//////////////////////////////////////
+// mutex_poolを獲得してから呼び出す
+static void
+AssignSearchThreads(void (*job)(thread_arg_t *arg), game_info_t *game, int color)
+{
+  pool_worker_t *worker;
+  int i;
+
+  // スレッド数が増えていたら足りない分を作る
+  for (i = (int)pool_worker.size(); i < threads; i++) {
+    worker = new pool_worker_t();
+    worker->arg.mt.seed((unsigned int)(time(NULL) + i));
+    pool_worker.push_back(worker);
+  }
+
+  for (i = 0; i < threads; i++) {
+    worker = pool_worker[i];
+    worker->arg.thread_id = i;
+    worker->arg.game = game;
+    worker->arg.color = color;
+    AssignPoolWorker(worker, i, job);
+  }
+}
+
+
+////////////////////////////
+//  探索スレッドの開始    //
+////////////////////////////
+// threads個の探索スレッドでjobを, NNを使うなら評価スレッドでEvalNodeを動かす
+// 終了を待たずに戻るので, WaitSearchThreadsで待つ
+static void
+StartSearchThreads(void (*job)(thread_arg_t *arg), game_info_t *game, int color)
+{
+  lock_guard<mutex> lock(mutex_pool);
+
+  searching = true;
+
+  AssignSearchThreads(job, game, color);
+
+  if (use_nn) {
+    AssignPoolWorker(&eval_worker, 0, EvalNodeJob);
+  }
+
+  pool_start.notify_all();
+}
+
+
+////////////////////////////////
+//  探索スレッドの終了を待つ  //
+////////////////////////////////
+// 探索スレッドが止まってから, 評価スレッドが残りの要求を処理し終えるのを待つ
+static void
+WaitSearchThreads(void)
+{
+  unique_lock<mutex> lock(mutex_pool);
+
+  pool_done.wait(lock, [] {
+    for (pool_worker_t *worker : pool_worker) {
+      if (worker->assigned) return false;
+    }
+    return true;
+  });
+
+  searching = false;
+
+  // 要求を待っている評価スレッドを起こし, 残りを処理させる
+  {
+    lock_guard<mutex> queue_lock(mutex_queue);
+    eval_ready.notify_one();
+  }
+
+  pool_done.wait(lock, [] { return !eval_worker.assigned; });
+}
+
+
+//////////////////////////////////////////
+//  木の領域への最初の書き込み          //
+//////////////////////////////////////////
+// 探索スレッドがTREE_TOUCH_CHUNKごとに交互に書き込み, ページの確保を分担する
+// 領域をNUMAノードに交互に置けなかった時は, 書き込む間だけスレッドをCPUに固定し,
+// 書き込んだページがそのスレッドのNUMAノードに確保されるようにする
+// (固定しないと書き込みの途中で別のNUMAノードのCPUに移ることがある)
+static void
+TouchTreeMemory(thread_arg_t *arg)
+{
+  char *area[2] = { (char *)uct_node, (char *)node_hash };
+  size_t size[2] = { sizeof(uct_node_t) * uct_hash_size, sizeof(node_hash_t) * uct_hash_size };
+  size_t offset, length;
+  const bool pin = !tree_interleaved && !thread_affinity;
+  int i;
+
+#if defined (_WIN32)
+  DWORD_PTR saved = 0, system_mask;
+  if (pin) {
+    GetProcessAffinityMask(GetCurrentProcess(), &saved, &system_mask);
+    BindThread(arg->thread_id);
+  }
+#elif defined (__linux__)
+  cpu_set_t saved;
+  if (pin) {
+    pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &saved);
+    BindThread(arg->thread_id);
+  }
+#endif
+
+  for (i = 0; i < 2; i++) {
+    for (offset = TREE_TOUCH_CHUNK * arg->thread_id; offset < size[i]; offset += TREE_TOUCH_CHUNK * threads) {
+      length = min(TREE_TOUCH_CHUNK, size[i] - offset);
+      memset(area[i] + offset, 0, length);
+    }
+  }
+
+  // 固定を元に戻す
+#if defined (_WIN32)
+  if (pin && saved != 0) {
+    SetThreadAffinityMask(GetCurrentThread(), saved);
+  }
+#elif defined (__linux__)
+  if (pin) {
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &saved);
+  }
+#endif
+}
+
+
+////////////////////////////////////
+//  木の領域のNUMAノードへの配置  //
+////////////////////////////////////
+static void
+PlaceTreeMemory(void)
+{
+  {
+    lock_guard<mutex> lock(mutex_pool);
+    AssignSearchThreads(TouchTreeMemory, NULL, S_EMPTY);
+    pool_start.notify_all();
+  }
+
+  WaitSearchThreads();
+}
+
+
+////////////////////////////////
+//  探索スレッドのプールの破棄  //
+////////////////////////////////
+static void
+FinalizeSearchThreads(void)
+{
+  {
+    lock_guard<mutex> lock(mutex_pool);
+    pool_shutdown = true;
+    pool_start.notify_all();
+  }
+
+  for (pool_worker_t *worker : pool_worker) {
+    worker->handle->join();
+    delete worker->handle;
+    delete worker;
+  }
+  pool_worker.clear();
+
+  if (eval_worker.handle != nullptr) {
+    eval_worker.handle->join();
+    delete eval_worker.handle;
+    eval_worker.handle = nullptr;
+  }
 }
 
 
@@ -353,11 +1352,8 @@ InitializeSearchSetting(void)
   }
 
   // 乱数の初期化
-  for (i = 0; i < THREAD_MAX; i++) {
-    if (mt[i]) {
-      delete mt[i];
-    }
-    mt[i] = new mt19937_64((unsigned int)(time(NULL) + i));
+  for (i = 0; i < (int)pool_worker.size(); i++) {
+    pool_worker[i]->arg.mt.seed((unsigned int)(time(NULL) + i));
   }
 
   // 持ち時間の初期化
@@ -402,7 +1398,8 @@ InitializeSearchSetting(void)
 void
 FinalizeUctSearch(void)
 {
-
+  StopPondering();
+  FinalizeSearchThreads();
 }
 
 
@@ -415,24 +1412,13 @@ IsPondered()
 void
 StopPondering()
 {
-  int i;
-
   if (!pondering_mode) {
     return;
   }
 
   if (ponder) {
     pondering_stop = true;
-    for (i = 0; i < threads; i++) {
-      handle[i]->join();
-      delete handle[i];
-      handle[i] = nullptr;
-    }
-    if (use_nn) {
-      handle[threads]->join();
-      delete handle[threads];
-      handle[threads] = nullptr;
-    }
+    WaitSearchThreads();
 
     ponder = false;
     pondered = true;
@@ -460,6 +1446,7 @@ UctSearchGenmove(game_info_t *game, int color)
   // 探索情報をクリア
   if (!pondered) {
     memset(statistic, 0, sizeof(statistic_t) * board_max); 
+    statistic_count = 0;
     memset(criticality_index, 0, sizeof(int) * board_max); 
     memset(criticality, 0, sizeof(double) * board_max);    
   }
@@ -475,15 +1462,20 @@ UctSearchGenmove(game_info_t *game, int color)
   }
 
   if (reuse_subtree) {
-    DeleteOldHash(game);
+    DeleteOldNodes(game, color);
   } else {
-    ClearUctHash();
+    ClearUctTree();
   }
 
   ClearEvalQueue();
 
   eval_count_policy = 0;
   eval_count_value = 0;
+  ClearNNCacheStatistic();
+
+  node_lock_stat.contended = 0;
+  node_lock_stat.spin = 0;
+  node_lock_stat.yield = 0;
 
   // 探索開始時刻の記録
   begin_time = ray_clock::now();
@@ -511,26 +1503,8 @@ UctSearchGenmove(game_info_t *game, int color)
   // 探索時間とプレイアウト回数の予定値を出力
   PrintPlayoutLimits(time_limit, po_info.halt);
 
-  for (i = 0; i < threads; i++) {
-    t_arg[i].thread_id = i;
-    t_arg[i].game = game;
-    t_arg[i].color = color;
-    handle[i] = new thread(ParallelUctSearch, &t_arg[i]);
-  }
-
-  if (use_nn)
-    handle[threads] = new thread(EvalNode);
-
-  for (i = 0; i < threads; i++) {
-    handle[i]->join();
-    delete handle[i];
-    handle[i] = nullptr;
-  }
-  if (use_nn) {
-    handle[threads]->join();
-    delete handle[threads];
-    handle[threads] = nullptr;
-  }
+  StartSearchThreads(ParallelUctSearch, game, color);
+  WaitSearchThreads();
 
   // 着手が41手以降で, 
   // 時間延長を行う設定になっていて,
@@ -541,22 +1515,8 @@ UctSearchGenmove(game_info_t *game, int color)
       ExtendTime()) {
     po_info.halt = (int)(1.5 * po_info.halt);
     time_limit *= 1.5;
-    for (i = 0; i < threads; i++) {
-      handle[i] = new thread(ParallelUctSearch, &t_arg[i]);
-    }
-    if (use_nn)
-      handle[threads] = new thread(EvalNode);
-
-    for (i = 0; i < threads; i++) {
-      handle[i]->join();
-      delete handle[i];
-      handle[i] = nullptr;
-    }
-    if (use_nn) {
-      handle[threads]->join();
-      delete handle[threads];
-      handle[threads] = nullptr;
-    }
+    StartSearchThreads(ParallelUctSearch, game, color);
+    WaitSearchThreads();
   }
 
   uct_child = uct_node[current_root].child;
@@ -631,15 +1591,18 @@ UctSearchGenmove(game_info_t *game, int color)
   PrintBestSequence(game, uct_node, current_root, color);
   // 探索の情報を出力(探索回数, 勝敗, 思考時間, 勝率, 探索速度)
   PrintPlayoutInformation(&uct_node[current_root], &po_info, finish_time, pre_simulated);
+  // ノードのロックの競合の統計を出力
+  if (threads > 1) PrintNodeLockStatistic(&node_lock_stat);
   // 次の探索でのプレイアウト回数の算出
   CalculateNextPlayouts(game, color, best_wp, finish_time);
 
   ClearEvalQueue();
  
   if (use_nn) {
-    cerr << "Eval NN Policy     :  " << setw(7) << (eval_count_policy + eval_policy_queue.size()) << endl;
-    cerr << "Eval NN Value      :  " << setw(7) << (eval_count_value + eval_value_queue.size()) << endl;
+    cerr << "Eval NN Policy     :  " << setw(7) << (eval_count_policy + eval_policy_queue.Size()) << endl;
+    cerr << "Eval NN Value      :  " << setw(7) << (eval_count_value + eval_value_queue.Size()) << endl;
     cerr << "Eval NN            :  " << setw(7) << eval_count_policy << "/" << eval_count_value << endl;
+    PrintNNCacheStatistic(&nn_cache_stat);
     cerr << "Count Captured     :  " << setw(7) << count << endl;
     cerr << "Score              :  " << setw(7) << score << endl;
     //PrintOwnerNN(S_BLACK, owner_nn);
@@ -663,6 +1626,7 @@ UctSearchPondering(game_info_t *game, int color)
 
   // 探索情報をクリア
   memset(statistic, 0, sizeof(statistic_t) * board_max);  
+  statistic_count = 0;
   memset(criticality_index, 0, sizeof(int) * board_max);  
   memset(criticality, 0, sizeof(double) * board_max);     
   po_info.count = 0;
@@ -674,7 +1638,7 @@ UctSearchPondering(game_info_t *game, int color)
     candidates[pos] = true;
   }
 
-  DeleteOldHash(game);
+  DeleteOldNodes(game, color);
 
   // UCTの初期化
   current_root = ExpandRoot(game, color);
@@ -694,15 +1658,7 @@ UctSearchPondering(game_info_t *game, int color)
   // Dynamic Komiの算出(置碁のときのみ)
   DynamicKomi(game, &uct_node[current_root], color);
 
-  for (i = 0; i < threads; i++) {
-    t_arg[i].thread_id = i;
-    t_arg[i].game = game;
-    t_arg[i].color = color;
-    handle[i] = new thread(ParallelUctSearchPondering, &t_arg[i]);
-  }
-
-  if (use_nn)
-    handle[threads] = new thread(EvalNode);
+  StartSearchThreads(ParallelUctSearchPondering, game, color);
 
   return ;
 }
@@ -725,6 +1681,7 @@ UctSearchStat(game_info_t *game, int color, int num)
 
   // 探索情報をクリア
   memset(statistic, 0, sizeof(statistic_t) * board_max); 
+  statistic_count = 0;
   memset(criticality_index, 0, sizeof(int) * board_max); 
   memset(criticality, 0, sizeof(double) * board_max);    
   po_info.count = 0;
@@ -737,9 +1694,9 @@ UctSearchStat(game_info_t *game, int color, int num)
   }
 
   if (reuse_subtree) {
-    DeleteOldHash(game);
+    DeleteOldNodes(game, color);
   } else {
-    ClearUctHash();
+    ClearUctTree();
   }
 
   double org_use_nn = use_nn;
@@ -768,18 +1725,8 @@ UctSearchStat(game_info_t *game, int color, int num)
   // Dynamic Komiの算出(置碁のときのみ)
   DynamicKomi(game, &uct_node[current_root], color);
 
-  for (i = 0; i < threads; i++) {
-    t_arg[i].thread_id = i;
-    t_arg[i].game = game;
-    t_arg[i].color = color;
-    handle[i] = new thread(ParallelUctSearch, &t_arg[i]);
-  }
-
-  for (i = 0; i < threads; i++) {
-    handle[i]->join();
-    delete handle[i];
-    handle[i] = nullptr;
-  }
+  StartSearchThreads(ParallelUctSearch, game, color);
+  WaitSearchThreads();
 
   use_nn = org_use_nn;
 
@@ -889,6 +1836,11 @@ ExpandRoot(game_info_t *game, int color)
 
     path.push_back(index);
 
+    // ルートのOwnerを求めるため, 統計情報は必ず割り当てる
+    if (uct_node[index].statistic == NULL) {
+      AllocateNodeStatistic(index);
+    }
+
     // 展開されたノード数を1に初期化
     uct_node[index].width = 1;
 
@@ -899,12 +1851,24 @@ ExpandRoot(game_info_t *game, int color)
 
     return index;
   } else {
-    // 空のインデックスを探す
-    index = SearchEmptyIndex(game->current_hash, color, game->moves);
+    // 子ノードの割り当て先を予約し, 空のインデックスを探す
+    // どちらかが足りなければ, 探索を始める前なので木をクリアして確保し直す
+    uct_child = ReserveChildren(pure_board_max + 1);
+    index = (uct_child == NULL) ? uct_hash_size : SearchEmptyIndex(game->current_hash, color, game->moves);
+    if (index == uct_hash_size) {
+      ClearUctTree();
+      uct_child = ReserveChildren(pure_board_max + 1);
+      index = (uct_child == NULL) ? uct_hash_size : SearchEmptyIndex(game->current_hash, color, game->moves);
+    }
 
-    assert(index != uct_hash_size);    
+    if (index == uct_hash_size) {
+      cerr << "Cannot allocate memory !!" << endl;
+      cerr << "You must reduce tree size !!" << endl;
+      exit(1);
+    }
     
     // ルートノードの初期化
+    uct_node[index].child = uct_child;
     uct_node[index].previous_move1 = pm1;
     uct_node[index].previous_move2 = pm2;
     uct_node[index].move_count = 0;
@@ -914,8 +1878,9 @@ ExpandRoot(game_info_t *game, int color)
     uct_node[index].evaled = false;
     uct_node[index].value_move_count = 0;
     uct_node[index].value_win = 0;
-    memset(uct_node[index].statistic, 0, sizeof(statistic_t) * BOARD_MAX); 
-    memset(uct_node[index].seki, false, sizeof(bool) * BOARD_MAX);
+    uct_node[index].statistic = NULL;
+    memset(uct_node[index].seki, 0, sizeof(uct_node[index].seki));
+    AllocateNodeStatistic(index);
     
     uct_child = uct_node[index].child;
     
@@ -948,6 +1913,7 @@ ExpandRoot(game_info_t *game, int color)
     
     // 子ノード個数の設定
     uct_node[index].child_num = child_num;
+    CommitChildren(child_num);
     
     // 候補手のレーティング
     RatingNode(game, color, index, path.size());
@@ -956,6 +1922,9 @@ ExpandRoot(game_info_t *game, int color)
     CheckSeki(game, uct_node[index].seki);
     
     uct_node[index].width++;
+
+    // 展開の完了
+    SetHashReady(index);
   }
 
   return index;
@@ -969,7 +1938,7 @@ ExpandRoot(game_info_t *game, int color)
 int
 ExpandNode(game_info_t *game, int color, int current, const std::vector<int>& path)
 {
-  unsigned int index = FindSameHashIndex(game->current_hash, color, game->moves);
+  unsigned int index;
   child_node_t *uct_child, *uct_sibling;
   int i, pos, child_num = 0;
   bool ladder[BOARD_MAX] = { false };  
@@ -977,16 +1946,31 @@ ExpandNode(game_info_t *game, int color, int current, const std::vector<int>& pa
   int max_pos = PASS, sibling_num;
   int pm1 = PASS, pm2 = PASS;
   int moves = game->moves;
+  bool inserted;
+  child_node_t *reserved;
 
-  // 合流先が検知できれば, それを返す
-  if (index != uct_hash_size) {
-    return index;
+  // 子ノードの割り当て先を予約する(合流した場合は確定しない)
+  reserved = ReserveChildren(pure_board_max + 1);
+
+  // 子ノードの領域が足りなければ展開しない
+  if (reserved == NULL) {
+    return NOT_EXPANDED;
   }
 
-  // 空のインデックスを探す
-  index = SearchEmptyIndex(game->current_hash, color, game->moves);
+  // 合流先を探し, なければ空のインデックスを確保する
+  // 確保した要素は展開が終わるまで合流したスレッドを待たせる
+  index = FindOrInsertHashIndex(game->current_hash, color, game->moves, &inserted);
+
+  // 空きが見つからなければ展開しない
+  if (index == uct_hash_size) {
+    return NOT_EXPANDED;
+  }
 
-  assert(index != uct_hash_size);    
+  // 合流先が検知できれば, 展開の完了を待ってそれを返す
+  if (!inserted) {
+    WaitNodeReady(index);
+    return index;
+  }
 
   // 直前の着手の座標を取り出す
   pm1 = game->record[moves - 1].pos;
@@ -1008,8 +1992,9 @@ ExpandNode(game_info_t *game, int color, int current, const std::vector<int>& pa
   uct_node[index].evaled = false;
   uct_node[index].value_move_count = 0;
   uct_node[index].value_win = 0;
-  memset(uct_node[index].statistic, 0, sizeof(statistic_t) * BOARD_MAX);
-  memset(uct_node[index].seki, false, sizeof(bool) * BOARD_MAX);
+  uct_node[index].statistic = NULL;
+  memset(uct_node[index].seki, 0, sizeof(uct_node[index].seki));
+  uct_node[index].child = reserved;
   
   uct_child = uct_node[index].child;
 
@@ -1029,6 +2014,7 @@ ExpandNode(game_info_t *game, int color, int current, const std::vector<int>& pa
 
   // 子ノードの個数を設定
   uct_node[index].child_num = child_num;
+  CommitChildren(child_num);
 
   // 候補手のレーティング
   RatingNode(game, color, index, path.size() + 1);
@@ -1061,6 +2047,9 @@ ExpandNode(game_info_t *game, int color, int current, const std::vector<int>& pa
     }
   }
 
+  // 展開の完了
+  SetHashReady(index);
+
   return index;
 }
 
@@ -1106,7 +2095,13 @@ RatingNode(game_info_t *game, int color, int index, int depth)
   max_index = 0;
   max_score = uct_child[0].rate;
 
-  if (use_nn) {
+  float policy[PURE_BOARD_MAX];
+  const unsigned long long nn_key = use_nn ? GetNNCacheKey(game, color) : 0;
+
+  // 評価済みの局面ならキャッシュの方策をそのまま使い, 評価を待たない
+  if (use_nn && LookupNNPolicy(nn_key, policy)) {
+    SetPolicyRate(index, depth, policy);
+  } else if (use_nn) {
     //int color = game->record[game->moves - 1].color;
     int move = PASS;
 
@@ -1122,11 +2117,15 @@ RatingNode(game_info_t *game, int color, int index, int depth)
     req->depth = depth;
     req->index = index;
     req->trans = rand() / (RAND_MAX / 8 + 1);
+    req->key = nn_key;
     //req.path.swap(path);
     int moveT;
     WritePlanes(req->data, nullptr, game, root, move, &moveT, color, req->trans);
 #if 1
-    eval_policy_queue.push(req);
+    // キューが満杯なら評価せず, レーティングだけで探索する
+    if (eval_policy_queue.Push(req)) {
+      NotifyEvalThread(eval_policy_queue.Size(), policy_batch_size);
+    }
     //push_back(u);
 #else
     std::vector<int> indices;
@@ -1284,6 +2283,185 @@ ExtendTime(void)
 
 
 
+//////////////////////////////////////////
+//  木の整理の間, 探索スレッドを止める  //
+//////////////////////////////////////////
+// プレイアウトの合間に呼び出すので, 止まっている間は木を参照していない
+static void
+WaitTreeCollection(void)
+{
+  if (!gc_request) return;
+
+  gc_paused++;
+  while (gc_request) {
+    this_thread::sleep_for(chrono::milliseconds(1));
+  }
+  gc_paused--;
+}
+
+
+////////////////////////////////////////
+//  探索回数の多いノードを引き継ぐ    //
+////////////////////////////////////////
+// ルートから親の探索回数が多い順に最良優先で辿るので,
+// 引き継いだノードは必ずルートとつながっている
+// ノード数が node_limit, 子ノードの数が child_limit,
+// 統計情報の要素数が statistic_limit に達したら打ち切る
+static void
+KeepVisitedNodes(int root, int node_limit, size_t child_limit, size_t statistic_limit, vector<int>& kept)
+{
+  priority_queue<pair<int, int>> frontier;  // (探索回数, インデックス)
+  child_node_t *uct_child;
+  size_t children = 0, statistics = 0;
+  int i, index;
+
+  frontier.push(make_pair(INT_MAX, root));
+
+  while (!frontier.empty() && (int)kept.size() < node_limit &&
+	 children < child_limit && statistics < statistic_limit) {
+    index = frontier.top().second;
+    frontier.pop();
+    // 合流により既に引き継いだノードは辿らない
+    if (!KeepHashIndex(index)) continue;
+    kept.push_back(index);
+    children += uct_node[index].child_num;
+    if (uct_node[index].statistic != NULL) statistics += board_max;
+    uct_child = uct_node[index].child;
+    for (i = 0; i < uct_node[index].child_num; i++) {
+      if (uct_child[i].index != NOT_EXPANDED) {
+	frontier.push(make_pair((int)uct_child[i].move_count, uct_child[i].index));
+      }
+    }
+  }
+}
+
+
+//////////////////////////////////////////////
+//  追い出したノードを参照する評価要求の破棄  //
+//////////////////////////////////////////////
+static void
+DropStaleEvalRequests(void)
+{
+  vector<shared_ptr<policy_eval_req>> policy_queue;
+  vector<shared_ptr<value_eval_req>> value_queue;
+  shared_ptr<policy_eval_req> policy_req;
+  shared_ptr<value_eval_req> req;
+
+  while (eval_policy_queue.Pop(policy_req)) {
+    if (IsHashReady(policy_req->index)) {
+      policy_queue.push_back(policy_req);
+    }
+  }
+  for (auto& kept_req : policy_queue) {
+    eval_policy_queue.Push(kept_req);
+  }
+
+  while (eval_value_queue.Pop(req)) {
+    // 評価結果は経路上のノードと親ノードの子に書き込む
+    bool alive = IsHashReady(req->index);
+    for (int current : req->path) {
+      if (current >= 0 && !IsHashReady(current)) {
+	alive = false;
+	break;
+      }
+    }
+    if (alive) {
+      value_queue.push_back(req);
+    }
+  }
+  for (auto& kept_req : value_queue) {
+    eval_value_queue.Push(kept_req);
+  }
+}
+
+
+////////////////////////////////////////////
+//  ハッシュ表が埋まったときの木の整理    //
+////////////////////////////////////////////
+// 全探索スレッドをプレイアウトの合間で止め, 評価スレッドが要求を
+// 取り出していない状態で, 探索回数の多い部分木だけを残す
+static void
+CollectTree(void)
+{
+  vector<int> kept;
+  unsigned int before;
+  int i, index;
+
+  // 整理は1スレッドだけが行い, 他のスレッドは止まって待つ
+  if (!mutex_gc.try_lock()) {
+    WaitTreeCollection();
+    return;
+  }
+
+  // 他のスレッドが既に整理を終えていれば何もしない
+  if (CheckRemainingTreeSize()) {
+    mutex_gc.unlock();
+    return;
+  }
+
+  gc_request = true;
+
+  // 評価待ちで止まっている探索スレッドを起こす
+  LOCK_QUEUE;
+  eval_space.notify_all();
+  UNLOCK_QUEUE;
+
+  // 他の探索スレッドが止まるのを待つ
+  while (gc_paused < search_running - 1) {
+    this_thread::yield();
+  }
+
+  // 評価スレッドが処理中の要求を終えるのを待ち, キューを止める
+  LOCK_QUEUE;
+  while (eval_busy) {
+    UNLOCK_QUEUE;
+    this_thread::yield();
+    LOCK_QUEUE;
+  }
+
+  before = GetUsedHashSize();
+
+  // 世代を進め, 探索回数の多いノードだけを引き継ぐ
+  ClearUctHash();
+  KeepVisitedNodes(current_root, uct_hash_limit / 2, child_arena_size / 2, statistic_pool_size / 2, kept);
+  SweepUctHash();
+
+  // 追い出したノードへの参照を外し, 次に訪れたときに展開し直す
+  for (int kept_index : kept) {
+    child_node_t *uct_child = uct_node[kept_index].child;
+    for (i = 0; i < uct_node[kept_index].child_num; i++) {
+      index = uct_child[i].index;
+      if (index != NOT_EXPANDED && !IsHashReady(index)) {
+	uct_child[i].index = NOT_EXPANDED;
+      }
+    }
+  }
+
+  DropStaleEvalRequests();
+
+  // 残したノードの子ノードと統計情報を詰め直す
+  CompactChildArena(kept);
+  CompactStatisticPool(kept);
+
+  UNLOCK_QUEUE;
+
+  PrintCollectedNodes(before, (unsigned int)kept.size());
+
+  // 止めていた評価スレッドを再開する
+  LOCK_QUEUE;
+  gc_request = false;
+  eval_ready.notify_one();
+  UNLOCK_QUEUE;
+
+  // 止めていたスレッドが再開するまで次の整理を始めない
+  while (gc_paused > 0) {
+    this_thread::yield();
+  }
+
+  mutex_gc.unlock();
+}
+
+
 /////////////////////////////////
 //  並列処理で呼び出す関数     //
 //  UCTアルゴリズムを反復する  //
@@ -1291,77 +2469,79 @@ ExtendTime(void)
 void
 ParallelUctSearch(thread_arg_t *arg)
 {
-  static std::atomic<int> queue_full;
   thread_arg_t *targ = (thread_arg_t *)arg;
-  game_info_t *game;
+  game_info_t *game, *po_game;
   int color = targ->color;
   bool interruption = false;
-  bool enough_size = true;
   int winner = 0;
   int interval = CRITICALITY_INTERVAL;
-  bool seki[BOARD_MAX] = {false};
   
-  game = AllocateGame();
+  // 局面の領域はスレッドごとに使い回す
+  if (targ->search_game == NULL) {
+    targ->search_game = AllocateGame();
+    targ->search_game->journal = AllocateJournal();
+    targ->po_game = AllocateGame();
+  }
+  game = targ->search_game;
+  po_game = targ->po_game;
 
-  CheckSeki(targ->game, seki);
+  // 探索する局面は1度だけコピーし, 以降は着手を戻して使い回す
+  CopyGame(game, targ->game);
+
+  search_running++;
   
   // スレッドIDが0のスレッドだけ別の処理をする
   // 探索回数が閾値を超える, または探索が打ち切られたらループを抜ける
   if (targ->thread_id == 0) {
     do {
-      // Wait if dcnn queue is full
-      LOCK_EXPAND;
-      while (eval_value_queue.size() > value_batch_size * 3 || eval_policy_queue.size() > policy_batch_size * 3) {
-	std::atomic_fetch_add(&queue_full, 1);
-	UNLOCK_EXPAND;
-	this_thread::sleep_for(chrono::milliseconds(10));
-	if (queue_full % 1000 == 0)
-	  cerr << "EVAL QUEUE FULL" << endl;
-	LOCK_EXPAND;
-      }
-      UNLOCK_EXPAND;
+      // 木の整理中なら止まる
+      WaitTreeCollection();
+      // 評価待ちの要求が溜まりすぎていたら止まる
+      WaitEvalQueue();
       // 探索回数を1回増やす	
       atomic_fetch_add(&po_info.count, 1);
-      // 盤面のコピー
-      CopyGame(game, targ->game);
-      memcpy(game->seki, seki, sizeof(bool) * BOARD_MAX);
       // 1回プレイアウトする
       //double value_result = -1;
       std::vector<int> path;
-      UctSearch(game, color, mt[targ->thread_id], current_root, &winner, path);
+      UctSearch(game, po_game, color, &targ->mt, current_root, &winner, path);
       // 探索を打ち切るか確認
       interruption = InterruptionCheck();
-      // ハッシュに余裕があるか確認
-      enough_size = CheckRemainingHashSize();
+      // ハッシュに余裕がなければ木を整理して探索を続ける
+      if (!CheckRemainingTreeSize()) CollectTree();
       // OwnerとCriticalityを計算する
       if (po_info.count > interval) {
-	CalculateOwner(color, po_info.count);
+	FlushStatistic();
+	CalculateOwner(color, statistic_count);
 	CalculateCriticality(color);
 	interval += CRITICALITY_INTERVAL;
       }
       if (GetSpendTime(begin_time) > time_limit) break;
-    } while (po_info.count < po_info.halt && !interruption && enough_size);
+    } while (po_info.count < po_info.halt && !interruption);
   } else {
     do {
+      // 木の整理中なら止まる
+      WaitTreeCollection();
+      // 評価待ちの要求が溜まりすぎていたら止まる
+      WaitEvalQueue();
       // 探索回数を1回増やす	
       atomic_fetch_add(&po_info.count, 1);
-      // 盤面のコピー
-      CopyGame(game, targ->game);
-      memcpy(game->seki, seki, sizeof(bool) * BOARD_MAX);
       // 1回プレイアウトする
       //double value_result = -1;
 	  std::vector<int> path;
-      UctSearch(game, color, mt[targ->thread_id], current_root, &winner, path);
+      UctSearch(game, po_game, color, &targ->mt, current_root, &winner, path);
       // 探索を打ち切るか確認
       interruption = InterruptionCheck();
-      // ハッシュに余裕があるか確認
-      enough_size = CheckRemainingHashSize();
+      // ハッシュに余裕がなければ木を整理して探索を続ける
+      if (!CheckRemainingTreeSize()) CollectTree();
       if (GetSpendTime(begin_time) > time_limit) break;
-    } while (po_info.count < po_info.halt && !interruption && enough_size);
+    } while (po_info.count < po_info.halt && !interruption);
   }
 
-  // メモリの解放
-  FreeGame(game);
+  // 溜めていた統計情報を反映する
+  FlushStatistic();
+
+  search_running--;
+
   return;
 }
 
@@ -1374,62 +2554,98 @@ void
 ParallelUctSearchPondering(thread_arg_t *arg)
 {
   thread_arg_t *targ = (thread_arg_t *)arg;
-  game_info_t *game;
+  game_info_t *game, *po_game;
   int color = targ->color;
-  bool enough_size = true;
   int winner = 0;
   int interval = CRITICALITY_INTERVAL;
 
-  game = AllocateGame();
+  // 局面の領域はスレッドごとに使い回す
+  if (targ->search_game == NULL) {
+    targ->search_game = AllocateGame();
+    targ->search_game->journal = AllocateJournal();
+    targ->po_game = AllocateGame();
+  }
+  game = targ->search_game;
+  po_game = targ->po_game;
+
+  // 探索する局面は1度だけコピーし, 以降は着手を戻して使い回す
+  CopyGame(game, targ->game);
+
+  search_running++;
 
   // スレッドIDが0のスレッドだけ別の処理をする
   // 探索回数が閾値を超える, または探索が打ち切られたらループを抜ける
   if (targ->thread_id == 0) {
     do {
+      // 木の整理中なら止まる
+      WaitTreeCollection();
+      // 評価待ちの要求が溜まりすぎていたら止まる
+      WaitEvalQueue();
       // 探索回数を1回増やす	
       atomic_fetch_add(&po_info.count, 1);
-      // 盤面のコピー
-      CopyGame(game, targ->game);
       // 1回プレイアウトする
       //double value_result = -1;
       std::vector<int> path;
-      UctSearch(game, color, mt[targ->thread_id], current_root, &winner, path);
-      // ハッシュに余裕があるか確認
-      enough_size = CheckRemainingHashSize();
+      UctSearch(game, po_game, color, &targ->mt, current_root, &winner, path);
+      // ハッシュに余裕がなければ木を整理して探索を続ける
+      if (!CheckRemainingTreeSize()) CollectTree();
       // OwnerとCriticalityを計算する
       if (po_info.count > interval) {
-	CalculateOwner(color, po_info.count);
+	FlushStatistic();
+	CalculateOwner(color, statistic_count);
 	CalculateCriticality(color);
 	interval += CRITICALITY_INTERVAL;
       }
-    } while (!pondering_stop && enough_size);
+    } while (!pondering_stop);
   } else {
     do {
+      // 木の整理中なら止まる
+      WaitTreeCollection();
+      // 評価待ちの要求が溜まりすぎていたら止まる
+      WaitEvalQueue();
       // 探索回数を1回増やす	
       atomic_fetch_add(&po_info.count, 1);
-      // 盤面のコピー
-      CopyGame(game, targ->game);
       // 1回プレイアウトする
       //double value_result = -1;
       std::vector<int> path;
-      UctSearch(game, color, mt[targ->thread_id], current_root, &winner, path);
-      // ハッシュに余裕があるか確認
-      enough_size = CheckRemainingHashSize();
-    } while (!pondering_stop && enough_size);
+      UctSearch(game, po_game, color, &targ->mt, current_root, &winner, path);
+      // ハッシュに余裕がなければ木を整理して探索を続ける
+      if (!CheckRemainingTreeSize()) CollectTree();
+    } while (!pondering_stop);
   }
 
-  // メモリの解放
-  FreeGame(game);
+  // 溜めていた統計情報を反映する
+  FlushStatistic();
+
+  search_running--;
+
   return;
 }
 
 
+//////////////////////////////////////////////////////
+//  セキの箇所をシミュレーション用の局面に書き出す  //
+//////////////////////////////////////////////////////
+static void
+CopySeki(game_info_t *po_game, const unsigned long long *seki)
+{
+  int index = NextBit(seki, SEKI_BITS_WORDS, 0);
+
+  memset(po_game->seki, false, sizeof(bool) * BOARD_MAX);
+
+  while (index >= 0) {
+    po_game->seki[onboard_pos[index]] = true;
+    index = NextBit(seki, SEKI_BITS_WORDS, index + 1);
+  }
+}
+
+
 //////////////////////////////////////////////
 //  UCT探索を行う関数                        //
 //  1回の呼び出しにつき, 1プレイアウトする    //
 //////////////////////////////////////////////
 int 
-UctSearch(game_info_t *game, int color, mt19937_64 *mt, int current, int *winner, std::vector<int>& path)
+UctSearch(game_info_t *game, game_info_t *po_game, int color, mt19937_64 *mt, int current, int *winner, std::vector<int>& path)
 {
   int result = 0, next_index;
   double score;
@@ -1448,47 +2664,74 @@ UctSearch(game_info_t *game, int color, mt19937_64 *mt, int current, int *winner
     game->record[game->moves - 1].pos == PASS &&
     game->record[game->moves - 2].pos == PASS;
 
-  if (no_expand || uct_child[next_index].move_count < expand_threshold || end_of_game) {
-    int start = game->moves;
-    path.push_back(current);
+  bool expand = !no_expand && uct_child[next_index].move_count >= expand_threshold && !end_of_game;
+
+  path.push_back(current);
+  // Virtual Lossを加算
+  AddVirtualLoss(&uct_child[next_index], current);
+
+  // ノードの展開の確認
+  // 親ノードのロックで同じ子の展開は1スレッドに限られるので,
+  // 無関係なノードの展開は並列に進む
+  // ハッシュ表に空きがなければ展開せずにシミュレーションする
+  if (expand && uct_child[next_index].index == NOT_EXPANDED) {
+    // ノードの展開
+    uct_child[next_index].index = ExpandNode(game, color, current, path);
+    expand = uct_child[next_index].index != NOT_EXPANDED;
+  }
 
-    // Virtual Lossを加算
-    AddVirtualLoss(&uct_child[next_index], current);
+  if (!expand) {
+    int start = game->moves;
 
-    memcpy(game->seki, uct_node[current].seki, sizeof(bool) * BOARD_MAX);
+    CopySeki(po_game, uct_node[current].seki);
     
     // 現在見ているノードのロックを解除
     UNLOCK_NODE(current);
 
+    // シミュレーション用の盤面に局面をコピー
+    CopyGame(po_game, game);
+
     // Enqueue value
 
     bool expected = false;
     if (use_nn
       && atomic_compare_exchange_strong(&uct_child[next_index].eval_value, &expected, true)) {
-      int move = PASS;
-
-      uct_node_t *root = &uct_node[current_root];
+      const unsigned long long nn_key = GetNNCacheKey(po_game, color);
+      float win;
 
-      double rate[PURE_BOARD_MAX];
-      AnalyzePoRating(game, color, rate);
-      auto req = make_shared<value_eval_req>();
-      req->uct_child = uct_child + next_index;
-      req->color = color;
-      //req->index = index;
-      req->trans = rand() / (RAND_MAX / 8 + 1);
-      req->path.swap(path);
-      int moveT;
-      WritePlanes(req->data, nullptr, game, root, move, &moveT, color, req->trans);
-      LOCK_EXPAND;
-      eval_value_queue.push(req);
-      UNLOCK_EXPAND;
+      // 評価済みの局面ならキャッシュの価値をそのまま反映する
+      if (LookupNNValue(nn_key, &win)) {
+	UpdateValue(current, next_index, path, win);
+      } else {
+	int move = PASS;
+
+	uct_node_t *root = &uct_node[current_root];
+
+	double rate[PURE_BOARD_MAX];
+	AnalyzePoRating(po_game, color, rate);
+	auto req = make_shared<value_eval_req>();
+	req->index = current;
+	req->child_index = next_index;
+	req->color = color;
+	req->trans = rand() / (RAND_MAX / 8 + 1);
+	req->key = nn_key;
+	req->path.swap(path);
+	int moveT;
+	WritePlanes(req->data, nullptr, po_game, root, move, &moveT, color, req->trans);
+	// キューが満杯なら次に訪れたときに改めて積む
+	if (eval_value_queue.Push(req)) {
+	  NotifyEvalThread(eval_value_queue.Size(), value_batch_size);
+	} else {
+	  uct_child[next_index].eval_value = false;
+	}
+      }
     }
 
     // 終局まで対局のシミュレーション
-    Simulation(game, color, mt);
+    Simulation(po_game, color, mt);
     
     // コミを含めない盤面のスコアを求める
-    score = (double)CalculateScore(game);
+    score = (double)CalculateScore(po_game);
     
     // コミを考慮した勝敗
     if (score - dynamic_komi[my_color] > 0) {
@@ -1500,25 +2743,12 @@ UctSearch(game_info_t *game, int color, mt19937_64 *mt, int current, int *winner
     }
     
     // 統計情報の記録
-    Statistic(game, *winner);
+    Statistic(po_game, *winner);
   } else {
-    path.push_back(current);
-    // Virtual Lossを加算
-    AddVirtualLoss(&uct_child[next_index], current);
-    // ノードの展開の確認
-    if (uct_child[next_index].index == -1) {
-      // ノードの展開中はロック
-      LOCK_EXPAND;
-      // ノードの展開
-      uct_child[next_index].index = ExpandNode(game, color, current, path);
-      //cerr << "value evaluated " << result << " " << v << " " << *value_result << endl;
-      // ノード展開のロックの解除
-      UNLOCK_EXPAND;
-    }
     // 現在見ているノードのロックを解除
     UNLOCK_NODE(current);
     // 手番を入れ替えて1手深く読む
-    result = UctSearch(game, color, mt, uct_child[next_index].index, winner, path);
+    result = UctSearch(game, po_game, color, mt, uct_child[next_index].index, winner, path);
     //
     // double v = uct_node[current].value;
     // if (*value_result < 0 && v >= 0) {
@@ -1539,8 +2769,18 @@ UctSearch(game_info_t *game, int color, mt19937_64 *mt, int current, int *winner
   // 探索結果の反映
   UpdateResult(&uct_child[next_index], result, current);
 
-  // 統計情報の更新
-  UpdateNodeStatistic(game, *winner, uct_node[current].statistic);
+  // 統計情報の更新(探索回数が閾値に達したノードだけ記録する)
+  statistic_t *node_statistic = uct_node[current].statistic;
+  if (node_statistic == NULL && !statistic_pool_full &&
+      uct_node[current].move_count >= STATISTIC_THRESHOLD) {
+    node_statistic = AllocateNodeStatistic(current);
+  }
+  if (node_statistic != NULL) {
+    UpdateNodeStatistic(statistic_buffer.owner, *winner, node_statistic);
+  }
+
+  // 着手を戻す
+  UndoMove(game);
 
   // if (*value_result >= 0)
   // 	*value_result = 1 - *value_result;
@@ -1779,24 +3019,60 @@ SelectMaxUcbChild(const game_info_t *game, int current, int color)
 }
 
 
+//////////////////////////////////////////////////////
+//  スレッドごとの統計情報を共有の統計情報に反映する  //
+//////////////////////////////////////////////////////
+static void
+FlushStatistic(void)
+{
+  statistic_buffer_t *buffer = &statistic_buffer;
+  int i, j, pos;
+
+  if (buffer->count == 0) return;
+
+  for (i = 0; i < pure_board_max; i++) {
+    pos = onboard_pos[i];
+    for (j = 0; j < 3; j++) {
+      if (buffer->colors[i][j] != 0) {
+	statistic[pos].colors[j].fetch_add(buffer->colors[i][j], memory_order_relaxed);
+	buffer->colors[i][j] = 0;
+      }
+    }
+  }
+
+  statistic_count.fetch_add(buffer->count);
+  buffer->count = 0;
+}
+
+
 ///////////////////////////////////////////////////////////
 //  OwnerやCriiticalityを計算するための情報を記録する関数  //
 ///////////////////////////////////////////////////////////
 void
 Statistic(game_info_t *game, int winner)
 {
-  char *board = game->board;
+  statistic_buffer_t *buffer = &statistic_buffer;
+  const char *board = game->board;
+  char *owner = buffer->owner;
   int i, pos, color;
 
+  // 終局図の各点の色はここで1度だけ求め, 経路上のノードの更新でも使う
+  // 空点かどうかで分岐せずに選ぶので, ループが条件付き転送で書ける
   for (i = 0; i < pure_board_max; i++) {
     pos = onboard_pos[i];
     color = board[pos];
-    if (color == S_EMPTY) color = territory[Pat3(game->pat, pos)];
+    owner[i] = (char)((color == S_EMPTY) ? territory[Pat3(game->pat, pos)] : color);
+  }
 
-    std::atomic_fetch_add(&statistic[pos].colors[color], 1);
-    if (color == winner) {
-      std::atomic_fetch_add(&statistic[pos].colors[0], 1);
-    }
+  // 共有の統計情報には直接書かず, スレッドごとに溜める
+  for (i = 0; i < pure_board_max; i++) {
+    color = owner[i];
+    buffer->colors[i][color]++;
+    buffer->colors[i][0] += (color == winner);
+  }
+
+  if (++buffer->count >= STATISTIC_FLUSH_INTERVAL) {
+    FlushStatistic();
   }
 }
 
@@ -1805,23 +3081,32 @@ Statistic(game_info_t *game, int winner)
 //  各ノードの統計情報の更新  //
 ///////////////////////////////
 void
-UpdateNodeStatistic(game_info_t *game, int winner, statistic_t *node_statistic)
+UpdateNodeStatistic(const char *owner, int winner, statistic_t *node_statistic)
 {
-  char *board = game->board;
   int i, pos, color;
 
   for (i = 0; i < pure_board_max; i++) {
     pos = onboard_pos[i];
-    color = board[pos];
-    if (color == S_EMPTY) color = territory[Pat3(game->pat, pos)];
-    std::atomic_fetch_add(&node_statistic[pos].colors[color], 1);
+    color = owner[i];
+    node_statistic[pos].colors[color].fetch_add(1, memory_order_relaxed);
     if (color == winner) {
-      std::atomic_fetch_add(&node_statistic[pos].colors[0], 1);
+      node_statistic[pos].colors[0].fetch_add(1, memory_order_relaxed);
     }
   }
 }
 
 
+////////////////////////////////////
+//  ノードの統計情報を記録した回数  //
+////////////////////////////////////
+int
+GetStatisticCount(const uct_node_t *node)
+{
+  if (node->statistic == NULL) return 0;
+  return node->move_count - node->statistic_base;
+}
+
+
 //////////////////////////////////
 //  各ノードのCriticalityの計算  //
 //////////////////////////////////
@@ -1830,7 +3115,7 @@ CalculateCriticalityIndex(uct_node_t *node, statistic_t *node_statistic, int col
 {
   double win, lose;
   int other = FLIP_COLOR(color);
-  int count = node->move_count;
+  int count = GetStatisticCount(node);
   int child_num = node->child_num;
   int i, pos;
   double tmp;
@@ -1840,6 +3125,14 @@ CalculateCriticalityIndex(uct_node_t *node, statistic_t *node_statistic, int col
 
   index[0] = 0;
 
+  // 統計情報がなければCriticalityは考慮しない
+  if (node_statistic == NULL || count <= 0) {
+    for (i = 1; i < child_num; i++) {
+      index[i] = 0;
+    }
+    return;
+  }
+
   for (i = 1; i < child_num; i++) {
     pos = node->child[i].pos;
 
@@ -1863,15 +3156,19 @@ CalculateCriticality(int color)
   int other = FLIP_COLOR(color);
   double win, lose;
 
+  int count = statistic_count;
+
   win = (double)uct_node[current_root].win / uct_node[current_root].move_count;
   lose = 1.0 - win;
 
+  if (count == 0) return;
+
   for (i = 0; i < pure_board_max; i++) {
     pos = onboard_pos[i];
 
-    tmp = ((float)statistic[pos].colors[0] / po_info.count) -
-      ((((float)statistic[pos].colors[color] / po_info.count)*win)
-       + (((float)statistic[pos].colors[other] / po_info.count)*lose));
+    tmp = ((float)statistic[pos].colors[0] / count) -
+      ((((float)statistic[pos].colors[color] / count)*win)
+       + (((float)statistic[pos].colors[other] / count)*lose));
     criticality[pos] = tmp;
     if (tmp < 0) tmp = 0;
     criticality_index[pos] = (int)(tmp * 40);
@@ -1888,11 +3185,19 @@ void
 CalculateOwnerIndex( uct_node_t *node, statistic_t *node_statistic, int color, int *index )
 {
   int i, pos;
-  int count = node->move_count;
+  int count = GetStatisticCount(node);
   int child_num = node->child_num;
 
   index[0] = 0;
 
+  // 統計情報がなければOwnerは五分とみなす
+  if (node_statistic == NULL || count <= 0) {
+    for (i = 1; i < child_num; i++) {
+      index[i] = OWNER_MAX / 2;
+    }
+    return;
+  }
+
   for (i = 1; i < child_num; i++){
     pos = node->child[i].pos;
     index[i] = (int)((double)node_statistic[pos].colors[color] * 10.0 / count + 0.5);
@@ -1912,6 +3217,8 @@ CalculateOwner( int color, int count )
 {
   int i, pos;
 
+  if (count == 0) return;
+
   for (i = 0; i < pure_board_max; i++){
     pos = onboard_pos[i];
     owner_index[pos] = (int)((double)statistic[pos].colors[color] * 10.0 / count + 0.5);
@@ -1967,15 +3274,15 @@ int
 UctAnalyze( game_info_t *game, int color )
 {
   int i, pos;
-  thread *handle[THREAD_MAX];
 
   // 探索情報をクリア
   memset(statistic, 0, sizeof(statistic_t) * board_max);  
+  statistic_count = 0;
   memset(criticality_index, 0, sizeof(int) * board_max);  
   memset(criticality, 0, sizeof(double) * board_max);     
   po_info.count = 0;
 
-  ClearUctHash();
+  ClearUctTree();
 
   current_root = ExpandRoot(game, color);
 
@@ -1988,19 +3295,8 @@ UctAnalyze( game_info_t *game, int color )
 
   po_info.halt = 10000;
 
-  for (i = 0; i < threads; i++) {
-    t_arg[i].thread_id = i;
-    t_arg[i].game = game;
-    t_arg[i].color = color;
-    handle[i] = new std::thread(ParallelUctSearch, &t_arg[i]);
-  }
-
-
-  for (i = 0; i < threads; i++) {
-    handle[i]->join();
-    delete handle[i];
-    handle[i] = nullptr;
-  }
+  StartSearchThreads(ParallelUctSearch, game, color);
+  WaitSearchThreads();
 
   use_nn = org_use_nn;
 
@@ -2031,10 +3327,17 @@ UctAnalyze( game_info_t *game, int color )
 void
 OwnerCopy( int *dest )
 {
+  const uct_node_t *root = &uct_node[current_root];
+  const statistic_t *root_statistic = root->statistic;
+  int count = GetStatisticCount(root);
   int i, pos;
   for (i = 0; i < pure_board_max; i++) {
     pos = onboard_pos[i];
-    dest[pos] = (int)((double)uct_node[current_root].statistic[pos].colors[my_color] / uct_node[current_root].move_count * 100);
+    if (root_statistic == NULL || count <= 0) {
+      dest[pos] = 50;
+    } else {
+      dest[pos] = (int)((double)root_statistic[pos].colors[my_color] / count * 100);
+    }
   }
 }
 
@@ -2072,9 +3375,9 @@ UctSearchGenmoveCleanUp( game_info_t *game, int color )
   double wp;
   int count;
   child_node_t *uct_child;
-  thread *handle[THREAD_MAX];
 
   memset(statistic, 0, sizeof(statistic_t)* board_max); 
+  statistic_count = 0;
   memset(criticality_index, 0, sizeof(int)* board_max); 
   memset(criticality, 0, sizeof(double)* board_max);    
 
@@ -2098,18 +3401,8 @@ UctSearchGenmoveCleanUp( game_info_t *game, int color )
 
   DynamicKomi(game, &uct_node[current_root], color);
 
-  for (i = 0; i < threads; i++) {
-    t_arg[i].thread_id = i;
-    t_arg[i].game = game;
-    t_arg[i].color = color;
-    handle[i] = new std::thread(ParallelUctSearch, &t_arg[i]);
-  }
-
-  for (i = 0; i < threads; i++) {
-    handle[i]->join();
-    delete handle[i];
-    handle[i] = nullptr;
-  }
+  StartSearchThreads(ParallelUctSearch, game, color);
+  WaitSearchThreads();
 
   uct_child = uct_node[current_root].child;
 
@@ -2161,47 +3454,143 @@ UctSearchGenmoveCleanUp( game_info_t *game, int color )
 
 extern char uct_params_path[1024];
 
+static nn_config_t
+GetNNConfig()
+{
+  nn_config_t config;
+
+  config.params_path = uct_params_path;
+  config.use_gpu = use_gpu;
+  // 指定がなければ全てのコアを使う
+  // CPUで推論する場合は評価待ちで探索スレッドが止まるので, 取り合いにはならない
+  config.threads = nn_threads > 0 ? nn_threads : max((int)thread::hardware_concurrency(), 1);
+  config.int8 = nn_int8;
+
+  return config;
+}
+
 void
 ReadWeights()
 {
-  cerr << "Init CNTK" << endl;
-  GetEvalF(&nn_model);
-  if (!nn_model)
-  {
-    cerr << "Get EvalModel failed\n";
+  const nn_config_t config = GetNNConfig();
+
+  if (nn_int8 && nn_backend != NN_BACKEND_CPU) {
+    cerr << "INT8 mode is only for the cpu backend" << endl;
+  }
+
+  nn_evaluator = CreateNNEvaluator(nn_backend);
+  if (!nn_evaluator) {
+    cerr << "NN backend " << nn_backend_name[nn_backend] << " is not available" << endl;
+    use_nn = false;
+    return;
+  }
+
+  if (!nn_evaluator->Load(config)) {
+    cerr << "Failed to load NN weights (" << nn_backend_name[nn_backend] << ")" << endl;
+    delete nn_evaluator;
+    nn_evaluator = nullptr;
+    use_nn = false;
   }
+}
+
+//////////////////////////////////
+//  NNの重みの読み込みを始める  //
+//////////////////////////////////
+// 読み込みは別のスレッドで行い, パターンなどの初期化と重ねる
+// 完了はInitializeUctSearchで待つ
+void
+StartReadWeights()
+{
+  if (!use_nn || nn_evaluator || nn_loader.joinable()) return;
+
+  nn_loader = thread(ReadWeights);
+}
+
+////////////////////////////
+//  NNのINT8化の較正      //
+////////////////////////////
+bool
+CalibrateNN()
+{
+  return CalibrateCpuEvaluator(GetNNConfig(), nn_calibration_file.c_str());
+}
+
+////////////////////////////
+//  NNの重みファイル変換  //
+////////////////////////////
+bool
+MakeNNModel()
+{
+  return ConvertCpuModel(GetNNConfig());
+}
+
+////////////////////////////////////
+//  方策の評価結果をノードに反映  //
+////////////////////////////////////
+// policyは盤の向きを戻したsoftmax後の値 (onboard_posの順)
+static void
+SetPolicyRate(int index, int depth, const float *policy)
+{
+  const int child_num = uct_node[index].child_num;
+  child_node_t *uct_child = uct_node[index].child;
 
-  // Load model with desired outputs
-  std::string networkConfiguration;
-  // with the ones specified.
-  //networkConfiguration += "outputNodeNames=\"h1.z:ol.z\"\n";
-  if (!use_gpu)
-    networkConfiguration += "deviceId=-1\n";
-  networkConfiguration += "modelPath=\"";
-  networkConfiguration += uct_params_path;
-  networkConfiguration += "/model.bin\"";
-  nn_model->CreateNetwork(networkConfiguration);
+  LOCK_NODE(index);
+
+#if 1
+  bool flat = depth <= 2 && child_num > 3;
+  vector<int> cs;
+  for (int i = 1; i < child_num; i++) {
+    double score = policy[onboard_index[uct_child[i].pos]];
+    if (uct_child[i].ladder) {
+      score /= 100;
+    }
+    /*if (uct_child[i].rate < 0.0) {
+      uct_child[i].nnrate = uct_child[i].rate;
+    }
+    else */{
+      //if (score > 0)
+      //uct_child[i].flag = true;
+      uct_child[i].nnrate = max(score, 0.0);
 
-  cerr << "ok" << endl;
+      if (flat) {
+	 cs.push_back(i);
+      }
+    }
+  }
+  if (flat && cs.size() >= 3) {
+     sort(cs.begin(), cs.end(),
+	[&](int a, int b) {
+	return uct_child[a].nnrate > uct_child[b].nnrate;
+     });
+     const int n = depth < 2 ? 3 : 2;
+     double topsum = 0;
+     for (int i = 0; i < n; i++) {
+	//cerr << "FLAT" << depth << " " << i << ":" << uct_child[cs[i]].nnrate << endl;
+	topsum += uct_child[cs[i]].nnrate;
+     }
+
+     for (int i = 0; i < n; i++) {
+	double org = uct_child[cs[i]].nnrate;
+	uct_child[cs[i]].nnrate = (org + topsum / n) / 2;
+	//cerr << "FLAT" << depth << " " << i << ":" << org << " -> " << uct_child[cs[i]].nnrate << endl;
+     }
+  }
+  uct_node[index].evaled = true;
+#endif
+  UNLOCK_NODE(index);
 }
 
 void
 EvalPolicy(const std::vector<std::shared_ptr<policy_eval_req>>& requests, std::vector<float>& data)
 {
-  Layer inputLayer;
-  inputLayer.insert(MapEntry(L"features", &data));
-  Layer outputLayer;
-  //std::vector<float> ownern;
-  std::vector<float> moves;
-  //ownern.reserve(pure_board_max * indices.size());
-  moves.reserve(pure_board_max * requests.size());
-  //outputLayer.insert(MapEntry(L"owner", &ownern));
-  outputLayer.insert(MapEntry(L"ol", &moves));
+  if (requests.empty()) return;
 
-  nn_model->Evaluate(inputLayer, outputLayer);
+  const int batch = (int)requests.size();
+  const int channels = (int)data.size() / (pure_board_max * batch);
+  std::vector<float> moves(pure_board_max * batch);
+  float policy[PURE_BOARD_MAX];
 
-  if (moves.size() != pure_board_max * requests.size()) {
-    cerr << "Eval move error " << moves.size() << endl;
+  if (!nn_evaluator->EvaluatePolicy(data.data(), batch, channels, pure_board_size, moves.data())) {
     return;
   }
   //if (ownern.size() != pure_board_max * indices.size()) {
@@ -2211,9 +3600,6 @@ EvalPolicy(const std::vector<std::shared_ptr<policy_eval_req>>& requests, std::v
   //cerr << "Eval " << indices.size() << " " << path.size() << endl;
   for (int j = 0; j < requests.size(); j++) {
     const auto req = requests[j];
-    const int index = req->index;
-    const int child_num = uct_node[index].child_num;
-    child_node_t *uct_child = uct_node[index].child;
     const int ofs = pure_board_max * j;
 
     float sum = 0;
@@ -2221,11 +3607,20 @@ EvalPolicy(const std::vector<std::shared_ptr<policy_eval_req>>& requests, std::v
       moves[i + ofs] = exp(moves[i + ofs]);
       sum += moves[i + ofs];
     }
-    LOCK_NODE(index);
 
-    int depth = req->depth;
+    // 盤の向きを戻し, どの向きで評価してもキャッシュから同じ形で引けるようにする
+    for (int i = 0; i < pure_board_max; i++) {
+      int pos = RevTransformMove(onboard_pos[i], req->trans);
+
+      int x = X(pos) - OB_SIZE;
+      int y = Y(pos) - OB_SIZE;
+      int n = x + y * pure_board_size;
+      policy[i] = moves[n + ofs] / sum;
+    }
+    StoreNNPolicy(req->key, policy);
+
 #if 0
-    if (index == current_root) {
+    if (req->index == current_root) {
       for (int i = 0; i < pure_board_max; i++) {
 	int x = i % pure_board_size;
 	int y = i / pure_board_size;
@@ -2234,98 +3629,58 @@ EvalPolicy(const std::vector<std::shared_ptr<policy_eval_req>>& requests, std::v
     }
 #endif
 
-#if 1
-    bool flat = depth <= 2 && child_num > 3;
-    vector<int> cs;
-    for (int i = 1; i < child_num; i++) {
-      int pos = RevTransformMove(uct_child[i].pos, req->trans);
-
-      int x = X(pos) - OB_SIZE;
-      int y = Y(pos) - OB_SIZE;
-      int n = x + y * pure_board_size;
-      double score = moves[n + ofs] / sum;
-      //if (depth == 1) cerr << "RAW POLICY " << uct_child[i].pos << " " << req->trans << " " << FormatMove(pos) << " " << x << "," << y << " " << ofs << " -> " << score << endl;
-      if (uct_child[i].ladder) {
-	score /= 100;
-      }
-      /*if (uct_child[i].rate < 0.0) {
-	uct_child[i].nnrate = uct_child[i].rate;
-      }
-      else */{
-	//if (score > 0)
-	//uct_child[i].flag = true;
-	uct_child[i].nnrate = max(score, 0.0);
-
-	if (flat) {
-	   cs.push_back(i);
-	}
-      }
-    }
-    if (flat && cs.size() >= 3) {
-       sort(cs.begin(), cs.end(),
-	  [&](int a, int b) {
-	  return uct_child[a].nnrate > uct_child[b].nnrate;
-       });
-       const int n = depth < 2 ? 3 : 2;
-       double topsum = 0;
-       for (int i = 0; i < n; i++) {
-	  //cerr << "FLAT" << depth << " " << i << ":" << uct_child[cs[i]].nnrate << endl;
-	  topsum += uct_child[cs[i]].nnrate;
-       }
-
-       for (int i = 0; i < n; i++) {
-	  double org = uct_child[cs[i]].nnrate;
-	  uct_child[cs[i]].nnrate = (org + topsum / n) / 2;
-	  //cerr << "FLAT" << depth << " " << i << ":" << org << " -> " << uct_child[cs[i]].nnrate << endl;
-       }
-    }
-    uct_node[index].evaled = true;
-#endif
-    UNLOCK_NODE(index);
+    SetPolicyRate(req->index, req->depth, policy);
   }
   eval_count_policy += requests.size();
 }
 
 
+////////////////////////////////////////
+//  価値の評価結果を経路に反映する    //
+////////////////////////////////////////
+// winは推論の実装が返した手番側から見た値 (-1から1)
+static void
+UpdateValue(int index, int child_index, const std::vector<int>& path, float win)
+{
+  double p = ((double)win + 1) / 2;
+  if (p < 0)
+    p = 0;
+  if (p > 1)
+    p = 1;
+  //cerr << "#" << index << "  " << sum << endl;
+
+  double value = 1 - p;// color[j] == S_BLACK ? p : 1 - p;
+
+  uct_node[index].child[child_index].value = value;
+  for (int i = path.size() - 1; i >= 0; i--) {
+    int current = path[i];
+    if (current < 0)
+      break;
+
+    atomic_fetch_add(&uct_node[current].value_move_count, 1);
+    atomic_fetch_add(&uct_node[current].value_win, value);
+    value = 1 - value;
+  }
+}
+
 void
 EvalValue(const std::vector<std::shared_ptr<value_eval_req>>& requests, std::vector<float>& data)
 {
-  Layer inputLayer;
-  inputLayer.insert(MapEntry(L"features", &data));
-  Layer outputLayer;
-  std::vector<float> win;
-  win.reserve(requests.size());
-  outputLayer.insert(MapEntry(L"p", &win));
+  if (requests.empty()) return;
 
-  nn_model->Evaluate(inputLayer, outputLayer);
+  const int batch = (int)requests.size();
+  const int channels = (int)data.size() / (pure_board_max * batch);
+  std::vector<float> win(batch);
 
-  if (win.size() != requests.size()) {
-    cerr << "Eval win error " << win.size() << endl;
+  if (!nn_evaluator->EvaluateValue(data.data(), batch, channels, pure_board_size, win.data())) {
     return;
   }
   //cerr << "Eval " << indices.size() << " " << path.size() << endl;
   for (int j = 0; j < requests.size(); j++) {
     auto req = requests[j];
 
-    double p = ((double)win[j] + 1) / 2;
-    if (p < 0)
-      p = 0;
-    if (p > 1)
-      p = 1;
-    //cerr << "#" << index << "  " << sum << endl;
-
-    double value = 1 - p;// color[j] == S_BLACK ? p : 1 - p;
-
-    req->uct_child->value = value;
-    for (int i = req->path.size() - 1; i >= 0; i--) {
-      int current = req->path[i];
-      if (current < 0)
-	break;
-
-      atomic_fetch_add(&uct_node[current].value_move_count, 1);
-      atomic_fetch_add(&uct_node[current].value_win, value);
-      value = 1 - value;
-    }
+    StoreNNValue(req->key, win[j]);
+    UpdateValue(req->index, req->child_index, req->path, win[j]);
   }
   eval_count_value += requests.size();
 }
@@ -2335,58 +3690,74 @@ static std::vector<float> eval_input_data;
 void EvalNode() {
 #if 1
   while (true) {
-    LOCK_EXPAND;
-    bool running = handle[0] != nullptr;
+    unique_lock<mutex> lock(mutex_queue);
+    bool running = searching;
     if (!running
-      && ((!reuse_subtree && !ponder) || (eval_policy_queue.empty() && eval_value_queue.empty()))) {
-      UNLOCK_EXPAND;
+      && ((!reuse_subtree && !ponder) || (eval_policy_queue.Empty() && eval_value_queue.Empty()))) {
       break;
     }
 
-    if (eval_policy_queue.empty() && eval_value_queue.empty()) {
-      UNLOCK_EXPAND;
-      this_thread::sleep_for(chrono::milliseconds(1));
-      //cerr << "EMPTY QUEUE" << endl;
+    // 木の整理中は要求を取り出さない
+    // 要求がなければ積まれるまで眠る
+    // 眠ることを先に示してから確かめるので, 積んだ側が必ず起こす
+    eval_waiting = true;
+    if (gc_request || (eval_policy_queue.Empty() && eval_value_queue.Empty())) {
+      eval_ready.wait(lock);
+      eval_waiting = false;
       continue;
     }
+    eval_waiting = false;
+
+    // バッチが埋まるか, 期限が来るまで待つ
+    if (running && !IsEvalBatchReady()) {
+      eval_ready.wait_for(lock, chrono::microseconds(EVAL_BATCH_DEADLINE), [] {
+	return !searching || gc_request || IsEvalBatchReady();
+      });
+      if (gc_request) continue;
+    }
 
-    if (eval_policy_queue.size() == 0) {
-    } else {
+    eval_busy = true;
+    lock.unlock();
+
+    if (!eval_policy_queue.Empty()) {
       std::vector<std::shared_ptr<policy_eval_req>> requests;
+      std::shared_ptr<policy_eval_req> req;
 
-      for (int i = 0; i < policy_batch_size && !eval_policy_queue.empty(); i++) {
-	auto req = eval_policy_queue.front();
+      for (int i = 0; i < policy_batch_size && eval_policy_queue.Pop(req); i++) {
 	requests.push_back(req);
-	eval_policy_queue.pop();
       }
-      UNLOCK_EXPAND;
 
-      eval_input_data.resize(0);
-      for (auto& req : requests) {
-	std::copy(req->data.begin(), req->data.end(), std::back_inserter(eval_input_data));
+      if (!requests.empty()) {
+	eval_input_data.resize(0);
+	for (auto& req : requests) {
+	  std::copy(req->data.begin(), req->data.end(), std::back_inserter(eval_input_data));
+	}
+	EvalPolicy(requests, eval_input_data);
       }
-      EvalPolicy(requests, eval_input_data);
-      LOCK_EXPAND;
     }
 
-    if (running && eval_value_queue.size() == 0) {
-      UNLOCK_EXPAND;
-    } else {
+    if (!running || !eval_value_queue.Empty()) {
       std::vector<std::shared_ptr<value_eval_req>> requests;
+      std::shared_ptr<value_eval_req> req;
 
-      for (int i = 0; i < value_batch_size && !eval_value_queue.empty(); i++) {
-	auto req = eval_value_queue.front();
+      for (int i = 0; i < value_batch_size && eval_value_queue.Pop(req); i++) {
 	requests.push_back(req);
-	eval_value_queue.pop();
       }
-      UNLOCK_EXPAND;
 
-      eval_input_data.resize(0);
-      for (auto& req : requests) {
-	std::copy(req->data.begin(), req->data.end(), std::back_inserter(eval_input_data));
+      // 探索の停止後は値の要求がなくてもここに来るので, 取り出せたときだけ評価する
+      if (!requests.empty()) {
+	eval_input_data.resize(0);
+	for (auto& req : requests) {
+	  std::copy(req->data.begin(), req->data.end(), std::back_inserter(eval_input_data));
+	}
+	EvalValue(requests, eval_input_data);
       }
-      EvalValue(requests, eval_input_data);
     }
+
+    // 空きを待っている探索スレッドを起こす
+    lock.lock();
+    eval_busy = false;
+    eval_space.notify_all();
   }
 #endif
 }
@@ -5,10 +5,9 @@
 #include <random>
 
 #include "GoBoard.h"
+#include "NeuralNet.h"
 #include "ZobristHash.h"
 
-const int THREAD_MAX = 32;              // 使用するスレッド数の最大値
-const int MAX_NODES = 1000000;          // UCTのノードの配列のサイズ
 const double ALL_THINKING_TIME = 90.0;  // 持ち時間(デフォルト)
 const int CONST_PLAYOUT = 10000;        // 1手あたりのプレイアウト回数(デフォルト)
 const double CONST_TIME = 10.0;         // 1手あたりの思考時間(デフォルト)
@@ -25,6 +24,9 @@ const int TIME_MAXPLY_19 = 80;
 // CriticalityとOwnerを計算する間隔
 const int CRITICALITY_INTERVAL = 100;
 
+// スレッドごとに溜めたプレイアウトの統計情報を共有の統計情報に反映する間隔
+const int STATISTIC_FLUSH_INTERVAL = 32;
+
 // 先頭打着緊急度
 const double FPU = 5.0;
 
@@ -44,6 +46,32 @@ const int UCT_CHILD_MAX = PURE_BOARD_MAX + 1;
 // 未展開のノードのインデックス
 const int NOT_EXPANDED = -1;
 
+// 探索スレッドが木の領域に最初に書き込む単位(バイト)
+// ページは最初に書き込んだスレッドのNUMAノードに置かれるので, この単位でスレッドに振り分ける
+const size_t TREE_TOUCH_CHUNK = 2 * 1024 * 1024;
+
+// 評価スレッドがバッチが埋まるのを待つ時間の上限(マイクロ秒)
+const int EVAL_BATCH_DEADLINE = 500;
+// 評価待ちのキューにバッチいくつ分まで溜めたら探索スレッドを止めるか
+const int EVAL_QUEUE_BATCHES = 3;
+
+// 子ノードの領域
+// 各スレッドは領域からCHILD_CHUNK_SIZE個ずつ切り出し, その中で子ノードを割り当てる
+const int CHILD_CHUNK_SIZE = 4096;
+// 子ノードの領域を確保する単位(切り出す単位の倍数)
+// 領域は木が育つのに合わせて, この単位で切り出すときに確保する
+const int CHILD_BLOCK_SIZE = CHILD_CHUNK_SIZE * 64;
+// 子ノードの領域の上限(全ノードの子ノード数の最大値に対する割合)
+// 子ノードの領域が埋まったら, ハッシュ表が埋まったときと同様に木を整理する
+const double CHILD_ARENA_RATE = 0.75;
+
+// 統計情報(OwnerとCriticality)を記録し始める探索回数
+// これより探索回数の少ないノードには統計情報の領域を割り当てない
+const int STATISTIC_THRESHOLD = 64;
+// 統計情報を割り当てるノード数の見込み(ハッシュ表の大きさに対する割合)
+// 統計情報の領域が埋まったら, ハッシュ表が埋まったときと同様に木を整理する
+const double STATISTIC_POOL_RATE = 0.25;
+
 // パスのインデックス
 const int PASS_INDEX = 0;
 
@@ -56,6 +84,11 @@ const double PASS_THRESHOLD = 0.90;
 // 投了する勝率の閾値
 const double RESIGN_THRESHOLD = 0.20;
 
+// ノードのロックのバックオフ
+// 待つ間のループ回数を倍々に増やし, 上限に達したらスレッドを譲る
+const int NODE_LOCK_BACKOFF_MIN = 4;
+const int NODE_LOCK_BACKOFF_MAX = 1024;
+
 // Virtual Loss (Best Parameter)
 const int VIRTUAL_LOSS = 1;
 
@@ -73,6 +106,15 @@ struct thread_arg_t {
   game_info_t *game; // 探索対象の局面
   int thread_id;   // スレッド識別番号
   int color;       // 探索する手番
+  game_info_t *search_game;  // 木を降りる局面(スレッドごとに使い回す)
+  game_info_t *po_game;      // シミュレーションする局面(スレッドごとに使い回す)
+  std::mt19937_64 mt;        // 乱数生成器
+};
+
+// ノードの排他制御用のロック
+// ノードの先頭に置き, 統計情報と同じキャッシュラインに載せる
+struct node_lock_t {
+  std::atomic<bool> locked;  // ロック中ならtrue
 };
 
 struct statistic_t {
@@ -93,19 +135,23 @@ struct child_node_t {
   bool ladder; // シチョウのフラグ
 };
 
-//  9x9  : 1828bytes
-// 13x13 : 3764bytes
-// 19x19 : 7988bytes
+// 64bit環境でのノード本体の大きさ
+// (子ノードは子ノードの領域に1つ56bytes, 統計情報はプールに別に持つ)
+//  9x9  :   88bytes
+// 13x13 :   96bytes
+// 19x19 :  120bytes
 struct uct_node_t {
+  node_lock_t lock;                   // ノードのロック
   int previous_move1;                 // 1手前の着手
   int previous_move2;                 // 2手前の着手
   std::atomic<int> move_count;
   std::atomic<int> win;
   int width;                          // 探索幅
   int child_num;                      // 子ノードの数
-  child_node_t child[UCT_CHILD_MAX];  // 子ノードの情報
-  statistic_t statistic[BOARD_MAX];   // 統計情報 
-  bool seki[BOARD_MAX];
+  child_node_t *child;                // 子ノードの情報(子ノードの領域のchild_num個分)
+  std::atomic<statistic_t *> statistic;  // 統計情報(盤の大きさ分, 割り当てるまではNULL)
+  int statistic_base;                 // 統計情報を割り当てたときの探索回数
+  unsigned long long seki[SEKI_BITS_WORDS];  // セキの箇所(onboard_indexのビット集合)
   bool evaled;
   //std::atomic<double> value;
   std::atomic<int> value_move_count;
@@ -118,6 +164,13 @@ struct po_info_t {
   std::atomic<int> count;       // 現在の探索回数
 };
 
+// ノードのロックの競合の統計
+struct node_lock_stat_t {
+  std::atomic<long long> contended;  // 待たされた回数
+  std::atomic<long long> spin;       // 待つ間に回ったループの回数
+  std::atomic<long long> yield;      // 待つ間にスレッドを譲った回数
+};
+
 struct rate_order_t {
   int index;    // ノードのインデックス
   double rate;  // その手のレート
@@ -157,6 +210,9 @@ void SetConstTime( double time );
 // 使用するスレッド数の指定
 void SetThread( int new_thread );
 
+// 探索スレッドをCPUに固定するかの指定
+void SetThreadAffinity( bool flag );
+
 // 持ち時間の指定
 void SetTime( double time );
 
@@ -202,13 +258,18 @@ void ParallelUctSearch( thread_arg_t *arg );
 void ParallelUctSearchPondering( thread_arg_t *arg );
 
 // UCT探索(1回の呼び出しにつき, 1回の探索)
-int UctSearch( game_info_t *game, int color, std::mt19937_64 *mt, int current, int *winner, std::vector<int>& path );
+// gameで木を降り, 末端でpo_gameにコピーしてシミュレーションし, gameの着手は戻す
+int UctSearch( game_info_t *game, game_info_t *po_game, int color, std::mt19937_64 *mt, int current, int *winner, std::vector<int>& path );
 
 // UCB値が最大の子ノードを返す
 int SelectMaxUcbChild( const game_info_t *game, int current, int color );
 
 // 各ノードの統計情報の更新
-void UpdateNodeStatistic( game_info_t *game, int winner, statistic_t *node_statistic );
+// ownerはStatisticで求めた終局図の各点の色
+void UpdateNodeStatistic( const char *owner, int winner, statistic_t *node_statistic );
+
+// ノードの統計情報を記録した回数
+int GetStatisticCount( const uct_node_t *node );
 
 // 各座標の統計処理
 void Statistic( game_info_t *game, int winner );
@@ -263,4 +324,34 @@ void SetUseNN(bool flag);
 
 void SetUseGPU(bool flag);
 
+// NNの推論の実装の指定
+void SetNNBackend(NN_BACKEND backend);
+
+// CPUでのNNの推論に使うスレッド数の指定
+void SetNNThreads(int threads);
+
+// CPUでのNNの推論をINT8で行うかの指定
+void SetNNInt8(bool flag);
+
+// INT8化の較正に使う局面のファイルの指定
+void SetNNCalibration(const char *data_file);
+
+// INT8化の較正をするモードか
+bool IsNNCalibration(void);
+
+// INT8化の較正をする
+bool CalibrateNN(void);
+
+// NNの重みファイルを変換するモードの設定
+void SetMakeNNModel(bool flag);
+
+// NNの重みファイルを変換するモードか
+bool IsMakeNNModel(void);
+
+// CPUでの推論の重みファイルを変換済みの重みファイルに書き出す
+bool MakeNNModel(void);
+
+// NNの重みの読み込みを別のスレッドで始める
+void StartReadWeights(void);
+
 #endif
@@ -2,6 +2,7 @@
 #include <cmath>
 #include <iostream>
 #include <random>
+#include <thread>
 
 #include "Nakade.h"
 #include "ZobristHash.h"
@@ -15,13 +16,16 @@ unsigned long long shape_bit[BOARD_MAX];
 
 
 node_hash_t *node_hash;
-static unsigned int used;
-static int oldest_move;
+static std::atomic<unsigned int> used;
+
+// 現在の世代
+// 世代の異なる要素は未使用とみなすので, 世代を進めるだけで表をクリアできる
+static unsigned int generation;
 
 unsigned int uct_hash_size = UCT_HASH_SIZE;
 unsigned int uct_hash_limit = UCT_HASH_SIZE * 9 / 10;
 
-bool enough_size;
+static std::atomic<bool> enough_size;
 
 void
 SetHashSize(unsigned int new_size)
@@ -78,6 +82,36 @@ InitializeHash(void)
 }
 
 
+//////////////////////////////
+//  要素の状態と世代の取り出し  //
+//////////////////////////////
+static inline unsigned int
+HashState(unsigned int word)
+{
+  return word & HASH_STATE_MASK;
+}
+
+static inline unsigned int
+HashGeneration(unsigned int word)
+{
+  return word >> HASH_STATE_BITS;
+}
+
+static inline unsigned int
+HashWord(unsigned int state)
+{
+  return (generation << HASH_STATE_BITS) | state;
+}
+
+// 現在の世代で使用中ならtrue
+static inline bool
+IsLiveHash(unsigned int word)
+{
+  return HashGeneration(word) == generation &&
+    HashState(word) != HASH_EMPTY && HashState(word) != HASH_DELETED;
+}
+
+
 //////////////////////////////////
 //  UCTノードのハッシュの初期化  //
 //////////////////////////////////
@@ -86,13 +120,15 @@ InitializeUctHash(void)
 {
   unsigned int i;
 
-  oldest_move = 1;
+  generation = 1;
   used = 0;
+  enough_size = true;
 
   for (i = 0; i < uct_hash_size; i++) {
-    node_hash[i].flag = false;
+    node_hash[i].state = HASH_EMPTY;
     node_hash[i].hash = 0;
     node_hash[i].color = 0;
+    node_hash[i].moves = 0;
   }
 }
 
@@ -105,42 +141,111 @@ ClearUctHash(void)
 {
   unsigned int i;
 
+  // 世代が一周したときだけ表全体の世代を0に戻す
+  // キーは残すので, 直後にKeepHashIndexで引き継げる
+  if (generation == HASH_GENERATION_MAX) {
+    for (i = 0; i < uct_hash_size; i++) {
+      node_hash[i].state = HashState(node_hash[i].state);
+    }
+    generation = 0;
+  }
+
+  generation++;
   used = 0;
   enough_size = true;
+}
 
-  for (i = 0; i < uct_hash_size; i++) {
-    node_hash[i].flag = false;
-    node_hash[i].hash = 0;
-    node_hash[i].color = 0;
-    node_hash[i].moves = 0;
+
+//////////////////////////////////////
+//  要素を現在の世代に引き継ぐ       //
+//////////////////////////////////////
+bool
+KeepHashIndex(unsigned int index)
+{
+  unsigned int word = node_hash[index].state.load(memory_order_relaxed);
+
+  if (HashGeneration(word) == generation) {
+    return false;
   }
+
+  node_hash[index].state.store(HashWord(HashState(word)), memory_order_relaxed);
+
+  if (++used > uct_hash_limit) enough_size = false;
+
+  return true;
 }
 
 
-///////////////////////
-//  古いデータの削除  //
-///////////////////////
+//////////////////////////////////////////
+//  引き継がなかった要素の整理          //
+//////////////////////////////////////////
+// 引き継いだ要素の探索列の途中にある要素は削除済み, それ以外は未使用に戻す
+// 古い世代の要素を残したままだと探索列が未使用の要素で打ち切れず,
+// 毎回 UCT_HASH_PROBE_MAX 個の要素を調べることになる
+// 探索を止めている間に, 引き継ぎを終えてから呼ぶ
 void
-DeleteOldHash(game_info_t *game)
+SweepUctHash(void)
 {
-  unsigned int i;
+  unsigned int i, j;
 
-  while (oldest_move < game->moves) {
-    for (i = 0; i < uct_hash_size; i++) {
-      if (node_hash[i].flag && node_hash[i].moves == oldest_move) {
-	node_hash[i].flag = false;
-	node_hash[i].hash = 0;
-	node_hash[i].color = 0;
-	node_hash[i].moves = 0;
-	used--;
+  for (i = 0; i < uct_hash_size; i++) {
+    if (!IsLiveHash(node_hash[i].state.load(memory_order_relaxed))) {
+      node_hash[i].state.store(HashWord(HASH_EMPTY), memory_order_relaxed);
+    }
+  }
+
+  for (i = 0; i < uct_hash_size; i++) {
+    if (!IsLiveHash(node_hash[i].state.load(memory_order_relaxed))) continue;
+    for (j = TransHash(node_hash[i].hash); j != i; j = (j + 1) & (uct_hash_size - 1)) {
+      if (!IsLiveHash(node_hash[j].state.load(memory_order_relaxed))) {
+	node_hash[j].state.store(HashWord(HASH_DELETED), memory_order_relaxed);
       }
     }
-    oldest_move++;
   }
+}
 
-  enough_size = true;
+
+////////////////////////////////////////
+//  要素のキーが確定するまで待つ      //
+////////////////////////////////////////
+static unsigned int
+WaitHashKey(unsigned int i)
+{
+  unsigned int word;
+
+  // 確保からキーの書き込みまでは短いので, スレッドを譲りながら待つ
+  while (HashState(word = node_hash[i].state.load(memory_order_acquire)) == HASH_CLAIMED &&
+	 HashGeneration(word) == generation) {
+    this_thread::yield();
+  }
+
+  return word;
+}
+
+
+////////////////////////////////////
+//  空き要素を確保してキーを書く  //
+////////////////////////////////////
+static bool
+ClaimHashIndex(unsigned int i, unsigned int expected, unsigned long long hash, int color, int moves)
+{
+  if (!node_hash[i].state.compare_exchange_strong(expected, HashWord(HASH_CLAIMED), memory_order_acquire)) {
+    return false;
+  }
+
+  node_hash[i].hash = hash;
+  node_hash[i].moves = moves;
+  node_hash[i].color = color;
+  node_hash[i].state.store(HashWord(HASH_EXPANDING), memory_order_release);
+
+  if (used.fetch_add(1, memory_order_relaxed) + 1 > uct_hash_limit) {
+    enough_size = false;
+  }
+
+  return true;
 }
 
+
 //////////////////////////////////////
 //  未使用のインデックスを探して返す  //
 //////////////////////////////////////
@@ -149,20 +254,18 @@ SearchEmptyIndex(unsigned long long hash, int color, int moves)
 {
   unsigned int key = TransHash(hash);
   unsigned int i = key;
+  unsigned int probe, word;
 
-  do {
-    if (!node_hash[i].flag) {
-      node_hash[i].flag = true;
-      node_hash[i].hash = hash;
-      node_hash[i].moves = moves;
-      node_hash[i].color = color;
-      used++;
-      if (used > uct_hash_limit) enough_size = false;
+  for (probe = 0; probe < UCT_HASH_PROBE_MAX && probe < uct_hash_size; probe++) {
+    word = node_hash[i].state.load(memory_order_relaxed);
+    if (!IsLiveHash(word) &&
+	ClaimHashIndex(i, word, hash, color, moves)) {
       return i;
     }
-    i++;
-    if (i >= uct_hash_size) i = 0;
-  } while (i != key);
+    i = (i + 1) & (uct_hash_size - 1);
+  }
+
+  enough_size = false;
 
   return uct_hash_size;
 }
@@ -170,28 +273,111 @@ SearchEmptyIndex(unsigned long long hash, int color, int moves)
 ////////////////////////////////////////////
 //  ハッシュ値に対応するインデックスを返す  //
 ////////////////////////////////////////////
+// 古い世代と削除済みの要素は読み飛ばし, 未使用の要素で探索列を打ち切る
 unsigned int
 FindSameHashIndex(unsigned long long hash, int color, int moves)
 {
   unsigned int key = TransHash(hash);
   unsigned int i = key;
+  unsigned int probe, word;
 
-  do {
-    if (!node_hash[i].flag) {
+  for (probe = 0; probe < UCT_HASH_PROBE_MAX && probe < uct_hash_size; probe++) {
+    word = WaitHashKey(i);
+    if (HashState(word) == HASH_EMPTY) {
       return uct_hash_size;
-    } else if (node_hash[i].hash == hash &&
+    } else if (IsLiveHash(word) &&
+	       node_hash[i].hash == hash &&
 	       node_hash[i].color == color &&
 	       node_hash[i].moves == moves) {
       return i;
     }
-    i++;
-    if (i >= uct_hash_size) i = 0;
-  } while (i != key);
+    i = (i + 1) & (uct_hash_size - 1);
+  }
 
   return uct_hash_size;
 }
 
 
+//////////////////////////////////////////////////////
+//  ハッシュ値に対応するインデックスを返す           //
+//  なければ同じ探索列の最初の空き要素を確保して返す  //
+//////////////////////////////////////////////////////
+// 同じキーを挿入するスレッドは同じ順に要素を調べるので,
+// 先に確保された要素で必ず合流し, 重複して確保されることはない
+unsigned int
+FindOrInsertHashIndex(unsigned long long hash, int color, int moves, bool *inserted)
+{
+  unsigned int key = TransHash(hash);
+  unsigned int i, probe, word;
+  unsigned int reuse, reuse_word = 0;
+
+  *inserted = false;
+
+  while (true) {
+    reuse = uct_hash_size;
+    i = key;
+
+    for (probe = 0; probe < UCT_HASH_PROBE_MAX && probe < uct_hash_size; probe++) {
+      word = WaitHashKey(i);
+      if (!IsLiveHash(word)) {
+	// 最初の空き要素を確保の候補にする
+	if (reuse == uct_hash_size) {
+	  reuse = i;
+	  reuse_word = word;
+	}
+	if (HashState(word) == HASH_EMPTY) break;
+      } else if (node_hash[i].hash == hash &&
+		 node_hash[i].color == color &&
+		 node_hash[i].moves == moves) {
+	return i;
+      }
+      i = (i + 1) & (uct_hash_size - 1);
+    }
+
+    if (reuse == uct_hash_size) {
+      enough_size = false;
+      return uct_hash_size;
+    }
+
+    if (ClaimHashIndex(reuse, reuse_word, hash, color, moves)) {
+      *inserted = true;
+      return reuse;
+    }
+    // 他のスレッドに先に確保されたので, 探索列を調べ直す
+  }
+}
+
+
+////////////////////////////////
+//  ノードの展開の完了を記録  //
+////////////////////////////////
+void
+SetHashReady(unsigned int index)
+{
+  node_hash[index].state.store(HashWord(HASH_READY), memory_order_release);
+}
+
+
+//////////////////////////////////
+//  ノードの展開が完了したか確認  //
+//////////////////////////////////
+bool
+IsHashReady(unsigned int index)
+{
+  return node_hash[index].state.load(memory_order_acquire) == HashWord(HASH_READY);
+}
+
+
+////////////////////////////////
+//  使用中の要素数を返す      //
+////////////////////////////////
+unsigned int
+GetUsedHashSize(void)
+{
+  return used;
+}
+
+
 bool
 CheckRemainingHashSize(void)
 {
@@ -2,6 +2,8 @@
 #define _ZOBRISTHASH_H_
 
 
+#include <atomic>
+
 #include "GoBoard.h"
 
 enum hash{
@@ -14,11 +16,30 @@ enum hash{
 
 const unsigned int UCT_HASH_SIZE = 16384;
 
+// 空きを探すときに調べる要素数の上限
+// 超えた場合は表が埋まっているとみなす
+const unsigned int UCT_HASH_PROBE_MAX = 256;
+
+// ハッシュ表の要素の状態
+// 空き要素はCASで確保し, キーを書き込んでから状態を進めて公開する
+// 状態は世代と合わせて1語に詰め, 世代の異なる要素は未使用とみなす
+enum hash_state {
+  HASH_EMPTY,      // 未使用
+  HASH_CLAIMED,    // 確保してキーを書き込み中
+  HASH_EXPANDING,  // キーは確定し, ノードを展開中
+  HASH_READY,      // ノードの展開が完了
+  HASH_DELETED,    // 引き継がれなかった要素 (探索では読み飛ばし, 確保には使える)
+};
+
+const unsigned int HASH_STATE_BITS = 3;
+const unsigned int HASH_STATE_MASK = (1U << HASH_STATE_BITS) - 1;
+const unsigned int HASH_GENERATION_MAX = 0xffffffffU >> HASH_STATE_BITS;
+
 struct node_hash_t {
   unsigned long long hash;
   int color;
   int moves;
-  bool flag;
+  std::atomic<unsigned int> state;  // 世代 << HASH_STATE_BITS | 状態
 };
 
 
@@ -29,6 +50,7 @@ extern unsigned long long shape_bit[BOARD_MAX];
 extern node_hash_t *node_hash;
 
 extern unsigned int uct_hash_size; 
+extern unsigned int uct_hash_limit;
 
 //  ハッシュテーブルのサイズの設定
 void SetHashSize( unsigned int new_size );
@@ -42,8 +64,11 @@ void InitializeUctHash( void );
 //  UCTノードのハッシュ情報のクリア
 void ClearUctHash( void );
 
-//  古いデータの削除
-void DeleteOldHash( game_info_t *game );
+//  要素を現在の世代に引き継ぐ(引き継いだらtrue)
+bool KeepHashIndex( unsigned int index );
+
+//  引き継がなかった要素を未使用か削除済みに戻す
+void SweepUctHash( void );
 
 //  未使用のインデックスを探す
 unsigned int SearchEmptyIndex( unsigned long long hash, int color, int moves );
@@ -51,6 +76,18 @@ unsigned int SearchEmptyIndex( unsigned long long hash, int color, int moves );
 //  ハッシュ値に対応するインデックスを返す
 unsigned int FindSameHashIndex( unsigned long long hash, int color, int moves );
 
+//  ハッシュ値に対応するインデックスを返し, なければ確保する
+unsigned int FindOrInsertHashIndex( unsigned long long hash, int color, int moves, bool *inserted );
+
+//  ノードの展開の完了を記録
+void SetHashReady( unsigned int index );
+
+//  ノードの展開が完了したか確認
+bool IsHashReady( unsigned int index );
+
+//  使用中の要素数を返す
+unsigned int GetUsedHashSize( void );
+
 //  ハッシュ表が埋まっていないか確認
 bool CheckRemainingHashSize( void );
 
@@ -0,0 +1,313 @@
+// CPUでの推論(NeuralNetCpu.cpp)の確認
+// 乱数で作ったネットワークを重みファイルに書き出して読み込ませ,
+// 素朴な畳み込みで計算した方策と価値と比べる
+//
+//   make nn-test
+//
+// 引数に作業用のディレクトリを指定できる (既定は test)
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "NeuralNet.h"
+
+using namespace std;
+
+
+////////////////
+//    定数    //
+////////////////
+
+// 盤の大きさ
+const int BOARD_SIZE = 19;
+
+// 交点数
+const int POINTS = BOARD_SIZE * BOARD_SIZE;
+
+// 入力チャネル数
+const int INPUT_CHANNELS = 52;
+
+// 共通部分のチャネル数
+const int TRUNK_CHANNELS = 16;
+
+// 共通部分の残差ブロックの数
+const int TRUNK_BLOCKS = 2;
+
+// 一度に評価する局面数 (スレッド数で割り切れない数にする)
+const int BATCH = 5;
+
+// 推論のスレッド数
+const int THREADS = 3;
+
+// 価値の出力の変換
+const float VALUE_SCALE = 0.01f;
+const float VALUE_OFFSET = -0.3f;
+
+// 許容する誤差
+const double TOLERANCE = 1e-4;
+
+
+//////////////////
+//  構造体宣言  //
+//////////////////
+
+// バイアスの種類
+enum BIAS_TYPE {
+  BIAS_NONE,
+  BIAS_CHANNEL,
+  BIAS_POINT,
+};
+
+// 畳み込み層
+struct test_conv_t {
+  int kernel, in, out;
+  bool relu;
+  BIAS_TYPE bias_type;
+  bool bn;
+  vector<float> weight, bias;
+  vector<float> scale, shift, mean, inv_std;
+};
+
+// 層 (残差ブロックなら2層)
+struct test_layer_t {
+  bool residual;
+  test_conv_t conv[2];
+};
+
+
+static mt19937 mt(1);
+static FILE *model_fp;
+
+
+// -range から range の乱数
+static float
+Random( float range )
+{
+  return uniform_real_distribution<float>(-range, range)(mt);
+}
+
+
+// 値を1行で書き出す
+static void
+WriteValues( const vector<float> &values )
+{
+  for (float v : values) {
+    fprintf(model_fp, "%.9g ", v);
+  }
+  fprintf(model_fp, "\n");
+}
+
+
+//////////////////////////////////////
+//  畳み込み層を作って書き出す      //
+//////////////////////////////////////
+static test_conv_t
+MakeConv( int kernel, int in, int out, bool relu, BIAS_TYPE bias_type, bool bn )
+{
+  test_conv_t conv;
+  const float range = 1.7f / sqrtf((float)(in * kernel * kernel));
+  const char *bias_name[] = { "none", "channel", "point" };
+
+  conv.kernel = kernel;
+  conv.in = in;
+  conv.out = out;
+  conv.relu = relu;
+  conv.bias_type = bias_type;
+  conv.bn = bn;
+
+  for (int i = 0; i < out * in * kernel * kernel; i++) {
+    conv.weight.push_back(Random(range));
+  }
+  const int bias_size = bias_type == BIAS_POINT ? out * POINTS : bias_type == BIAS_CHANNEL ? out : 0;
+  for (int i = 0; i < bias_size; i++) {
+    conv.bias.push_back(Random(0.3f));
+  }
+  if (bn) {
+    for (int i = 0; i < out; i++) {
+      conv.scale.push_back(1.0f + Random(0.3f));
+      conv.shift.push_back(Random(0.2f));
+      conv.mean.push_back(Random(0.2f));
+      conv.inv_std.push_back(1.0f + Random(0.3f));
+    }
+  }
+
+  fprintf(model_fp, "conv %d %d %d %s %s %s\n", kernel, in, out,
+          relu ? "relu" : "linear", bias_name[bias_type], bn ? "bn" : "nobn");
+  WriteValues(conv.weight);
+  WriteValues(conv.bias);
+  if (bn) {
+    for (auto *values : { &conv.scale, &conv.shift, &conv.mean, &conv.inv_std }) {
+      WriteValues(*values);
+    }
+  }
+
+  return conv;
+}
+
+
+// 畳み込み層
+static test_layer_t
+ConvLayer( int kernel, int in, int out, bool relu, BIAS_TYPE bias_type, bool bn )
+{
+  test_layer_t layer;
+
+  layer.residual = false;
+  layer.conv[0] = MakeConv(kernel, in, out, relu, bias_type, bn);
+
+  return layer;
+}
+
+
+// 残差ブロック
+static test_layer_t
+ResidualLayer( int channels )
+{
+  test_layer_t layer;
+
+  fprintf(model_fp, "res %d\n", channels);
+  layer.residual = true;
+  layer.conv[0] = MakeConv(3, channels, channels, true, BIAS_NONE, true);
+  layer.conv[1] = MakeConv(3, channels, channels, false, BIAS_NONE, true);
+
+  return layer;
+}
+
+
+//////////////////////////////
+//  素朴な畳み込みの計算    //
+//////////////////////////////
+static vector<float>
+Convolution( const test_conv_t &conv, const vector<float> &in, const vector<float> *residual )
+{
+  vector<float> out(conv.out * POINTS);
+  const int pad = conv.kernel / 2;
+
+  for (int o = 0; o < conv.out; o++) {
+    for (int y = 0; y < BOARD_SIZE; y++) {
+      for (int x = 0; x < BOARD_SIZE; x++) {
+        double sum = 0;
+        for (int i = 0; i < conv.in; i++) {
+          for (int ky = 0; ky < conv.kernel; ky++) {
+            for (int kx = 0; kx < conv.kernel; kx++) {
+              const int sy = y + ky - pad, sx = x + kx - pad;
+              if (sy < 0 || sy >= BOARD_SIZE || sx < 0 || sx >= BOARD_SIZE) continue;
+              sum += conv.weight[((o * conv.in + i) * conv.kernel + ky) * conv.kernel + kx] *
+                in[i * POINTS + sy * BOARD_SIZE + sx];
+            }
+          }
+        }
+        const int p = y * BOARD_SIZE + x;
+        if (conv.bias_type == BIAS_CHANNEL) sum += conv.bias[o];
+        if (conv.bias_type == BIAS_POINT) sum += conv.bias[o * POINTS + p];
+        if (conv.bn) sum = conv.scale[o] * (sum - conv.mean[o]) * conv.inv_std[o] + conv.shift[o];
+        if (residual != NULL) sum += (*residual)[o * POINTS + p];
+        if (conv.relu || residual != NULL) sum = max(sum, 0.0);
+        out[o * POINTS + p] = (float)sum;
+      }
+    }
+  }
+
+  return out;
+}
+
+
+// 層の並びの計算
+static vector<float>
+RunTower( const vector<test_layer_t> &tower, vector<float> x )
+{
+  for (const test_layer_t &layer : tower) {
+    if (layer.residual) {
+      x = Convolution(layer.conv[1], Convolution(layer.conv[0], x, NULL), &x);
+    } else {
+      x = Convolution(layer.conv[0], x, NULL);
+    }
+  }
+  return x;
+}
+
+
+int
+main( int argc, char **argv )
+{
+  const string dir = argc > 1 ? argv[1] : "test";
+  const string filename = dir + "/model.txt";
+  vector<test_layer_t> trunk, policy_head, value_head;
+
+  // 共通部分は5x5の畳み込みと残差ブロック, 方策は1x1, 残差ブロック, チャネルごとのバイアスの3x3,
+  // 価値は1x1と交点ごとのバイアスの1x1 (ResNetV25の構成を小さくしたもの)
+  model_fp = fopen(filename.c_str(), "w");
+  if (model_fp == NULL) {
+    cerr << "can not open -" << filename << "-" << endl;
+    return 1;
+  }
+  fprintf(model_fp, "ray-nn 1\nboard %d\ninput %d\n", BOARD_SIZE, INPUT_CHANNELS);
+  fprintf(model_fp, "tower trunk %d\n", 1 + TRUNK_BLOCKS);
+  trunk.push_back(ConvLayer(5, INPUT_CHANNELS, TRUNK_CHANNELS, true, BIAS_NONE, true));
+  for (int i = 0; i < TRUNK_BLOCKS; i++) {
+    trunk.push_back(ResidualLayer(TRUNK_CHANNELS));
+  }
+  fprintf(model_fp, "tower policy 3\n");
+  policy_head.push_back(ConvLayer(1, TRUNK_CHANNELS, 8, true, BIAS_NONE, true));
+  policy_head.push_back(ResidualLayer(8));
+  policy_head.push_back(ConvLayer(3, 8, 1, false, BIAS_CHANNEL, false));
+  fprintf(model_fp, "tower value 2\n");
+  value_head.push_back(ConvLayer(1, TRUNK_CHANNELS, 6, true, BIAS_NONE, true));
+  value_head.push_back(ConvLayer(1, 6, 1, false, BIAS_POINT, false));
+  fprintf(model_fp, "value %.9g %.9g\nend\n", VALUE_SCALE, VALUE_OFFSET);
+  fclose(model_fp);
+
+  // 変換済みの重みファイルが残っていると, そちらが読まれる
+  remove((dir + "/model.nnw").c_str());
+
+  nn_evaluator_t *evaluator = CreateNNEvaluator(NN_BACKEND_CPU);
+  nn_config_t config;
+  config.params_path = dir;
+  config.use_gpu = false;
+  config.threads = THREADS;
+  config.int8 = false;
+  if (evaluator == nullptr || !evaluator->Load(config)) {
+    cerr << "NG : can not load " << filename << endl;
+    return 1;
+  }
+
+  vector<float> input(BATCH * INPUT_CHANNELS * POINTS);
+  for (float &v : input) {
+    v = (float)(mt() % 3 == 0);
+  }
+
+  vector<float> policy(BATCH * POINTS), value(BATCH);
+  if (!evaluator->EvaluatePolicy(input.data(), BATCH, INPUT_CHANNELS, BOARD_SIZE, policy.data()) ||
+      !evaluator->EvaluateValue(input.data(), BATCH, INPUT_CHANNELS, BOARD_SIZE, value.data())) {
+    cerr << "NG : evaluation failed" << endl;
+    return 1;
+  }
+  delete evaluator;
+
+  double policy_diff = 0, value_diff = 0;
+  for (int b = 0; b < BATCH; b++) {
+    const vector<float> x(input.begin() + b * INPUT_CHANNELS * POINTS,
+                          input.begin() + (b + 1) * INPUT_CHANNELS * POINTS);
+    const vector<float> features = RunTower(trunk, x);
+    const vector<float> p = RunTower(policy_head, features);
+    const vector<float> v = RunTower(value_head, features);
+
+    double sum = 0;
+    for (int i = 0; i < POINTS; i++) {
+      policy_diff = max(policy_diff, fabs((double)p[i] - policy[b * POINTS + i]));
+      sum += tanh(v[i]);
+    }
+    value_diff = max(value_diff, fabs(tanh(VALUE_SCALE * sum + VALUE_OFFSET) - value[b]));
+  }
+
+  const bool ok = policy_diff < TOLERANCE && value_diff < TOLERANCE;
+  cerr << (ok ? "OK" : "NG") << " : policy max diff " << policy_diff
+       << ", value max diff " << value_diff << endl;
+
+  return ok ? 0 : 1;
+}